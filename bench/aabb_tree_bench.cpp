@@ -0,0 +1,134 @@
+// compares aabb_tree queries against testing every box, build with make bench
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+
+#include "aabb_tree.hpp"
+#include "frustum.hpp"
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+static float frand(float low, float high)
+{
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+static aabb_t random_box(float world_size)
+{
+    vec3_t<> p(frand(0.0f, world_size), frand(0.0f, 0.1f * world_size), frand(0.0f, world_size));
+    vec3_t<> s(frand(0.5f, 2.0f), frand(0.5f, 2.0f), frand(0.5f, 2.0f));
+    aabb_t box;
+    box.low = p - s;
+    box.high = p + s;
+    return box;
+}
+
+static void bench(int count)
+{
+    const int query_count = 200;
+    // keep the density roughly constant, like a growing level would
+    float world_size = 30.0f * sqrtf(count);
+
+    std::vector<aabb_t> boxes(count);
+    for (int i = 0; i < count; i++)
+    {
+        boxes[i] = random_box(world_size);
+    }
+
+    aabb_tree_t tree;
+    aabb_tree_init(&tree, 0.5f);
+    std::vector<int> proxies(count);
+    double t0 = now();
+    for (int i = 0; i < count; i++)
+    {
+        proxies[i] = aabb_tree_insert(&tree, boxes[i], i);
+    }
+    double build_time = now() - t0;
+
+    // move a tenth of the boxes a little, like one tick of physics
+    t0 = now();
+    int reinserted = 0;
+    for (int i = 0; i < count; i += 10)
+    {
+        vec3_t<> d(frand(-1.0f, 1.0f), 0.0f, frand(-1.0f, 1.0f));
+        boxes[i].low += d;
+        boxes[i].high += d;
+        reinserted += aabb_tree_move(&tree, proxies[i], boxes[i]);
+    }
+    double move_time = now() - t0;
+
+    std::vector<frustum_t> frustums(query_count);
+    std::vector<vec3_t<> > centers(query_count);
+    std::vector<vec3_t<> > directions(query_count);
+    std::vector<vec3_t<> > ray_origins(query_count);
+    for (int i = 0; i < query_count; i++)
+    {
+        centers[i] = vec3_t<>(frand(0.0f, world_size), frand(0.0f, 0.1f * world_size), frand(0.0f, world_size));
+        directions[i] = vec3_t<>(frand(-1.0f, 1.0f), 0.0f, frand(-1.0f, 1.0f)).normalized();
+        // rays start inside a box, like a pick from the player would
+        const aabb_t &start = boxes[rand() % count];
+        ray_origins[i] = 0.5f * (start.low + start.high);
+        mat4_t<> view = mat4_t<>::lookat(centers[i], centers[i] + directions[i], vec3_t<>(0.0f, 1.0f, 0.0f));
+        frustums[i] = frustum_from_matrix(mat4_t<>::perspective(60.0f * M_PI / 180.0f, 16.0f / 9.0f, 0.1f, 300.0f) * view);
+    }
+
+    std::vector<int> results;
+    double tree_times[3];
+    double linear_times[3];
+    int tree_hits[3] = { 0, 0, 0 };
+    int linear_hits[3] = { 0, 0, 0 };
+
+    for (int kind = 0; kind < 3; kind++)
+    {
+        t0 = now();
+        for (int q = 0; q < query_count; q++)
+        {
+            results.clear();
+            if (kind == 0) aabb_tree_query_frustum(tree, frustums[q], &results);
+            if (kind == 1) aabb_tree_query_sphere(tree, centers[q], 50.0f, &results);
+            if (kind == 2) aabb_tree_query_ray(tree, ray_origins[q], directions[q], 300.0f, &results);
+            tree_hits[kind] += results.size();
+        }
+        tree_times[kind] = now() - t0;
+
+        t0 = now();
+        for (int q = 0; q < query_count; q++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                const aabb_t &b = boxes[i];
+                bool hit = false;
+                if (kind == 0) hit = frustum_test_box(frustums[q], b.low, b.high);
+                if (kind == 1) hit = aabb_overlap_sphere(b, centers[q], 50.0f);
+                if (kind == 2) hit = aabb_intersect_ray(b, ray_origins[q], directions[q], 300.0f);
+                linear_hits[kind] += hit;
+            }
+        }
+        linear_times[kind] = now() - t0;
+    }
+
+    const char *names[] = { "frustum", "sphere", "ray" };
+    printf("%d boxes: build %.2f ms, height %d, moved %d (%d reinserted) in %.3f ms\n", count, 1000.0 * build_time, aabb_tree_height(tree), (count + 9) / 10, reinserted, 1000.0 * move_time);
+    for (int kind = 0; kind < 3; kind++)
+    {
+        // the tree tests fat boxes, so it may report a few more hits
+        printf("  %-8s tree %8.4f ms/query (%7.1f hits)   linear %8.4f ms/query (%7.1f hits)\n", names[kind],
+            1000.0 * tree_times[kind] / query_count, tree_hits[kind] / (float)query_count,
+            1000.0 * linear_times[kind] / query_count, linear_hits[kind] / (float)query_count);
+    }
+}
+
+int main()
+{
+    srand(1);
+    bench(1000);
+    bench(10000);
+    bench(100000);
+    return 0;
+}
@@ -0,0 +1,17 @@
+uniform fragment_uniforms
+{
+    float blend; // how far to move towards the new average this frame
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+void main()
+{
+    // drawn into a single pixel, so the tex coord derivatives select the last mip level
+    float average = exp(texture2D(tex[0], v_tex_coord).r);
+    float previous = texture2D(tex[1], vec2(0.5)).r;
+
+    gl_FragColor = vec4(mix(previous, average, blend), 0.0, 0.0, 1.0);
+}
@@ -7,24 +7,33 @@ uniform fragment_uniforms
     vec3 light_position; // when pointlight (0) or spotlight (1), this is the position
     vec3 light_direction; // when directional (2), this is the direction the light shines
     vec3 light_color;
+    float radius; // when pointlight (0) or spotlight (1)
+    vec2 screen_size;
+    int shadow_map_count;
+    mat4 shadow_matrices[4]; // view space to the clip space of each shadow map, nearest cascade first
+    vec4 shadow_rects[4]; // offset and size of each shadow map's atlas tile
 };
 
-varying vec2 v_tex_coord;
-
 uniform sampler2D tex[8];
 
-float shadow(vec4 projected, float point_depth)
+// fraction of the 3x3 taps around the point that are lit in shadow map i
+float shadow_taps(int i, vec3 projected)
 {
-    vec2 sample_base = 0.5 * projected.xy + 0.5;
+    vec4 rect = shadow_rects[i];
+    vec2 sample_base = rect.xy + (0.5 * projected.xy + 0.5) * rect.zw;
+    float point_depth = projected.z * 0.5 + 0.5;
     //float shadow_depth = texture2D(tex[4], sample_base).r;
-    vec2 d = vec2(1.0/512.0);
+    // one atlas texel, the taps are kept inside the tile
+    vec2 d = vec2(1.0/4096.0);
+    vec2 tile_low = rect.xy + 0.5 * d;
+    vec2 tile_high = rect.xy + rect.zw - 0.5 * d;
 
     float accum = 0.0;
     int dxs[9] = { -1, -1, -1,  0,  0,  0,  1,  1,  1 };
     int dys[9] = { -1,  0,  1, -1,  0,  1, -1,  0,  1 };
-    for (int i = 0; i < 9; i++)
+    for (int j = 0; j < 9; j++)
     {
-        if (texture2D(tex[4], sample_base + d * vec2(dxs[i], dys[i])).r > point_depth * 0.9999)
+        if (texture2D(tex[4], clamp(sample_base + d * vec2(dxs[j], dys[j]), tile_low, tile_high)).r > point_depth * 0.9999)
         {
             accum += 1.0;
         }
@@ -34,8 +43,35 @@ float shadow(vec4 projected, float point_depth)
     //return point_depth * 0.9999 < shadow_depth;
 }
 
+// 1 where the view space position is lit, from the first shadow map covering it
+float shadow(vec3 position)
+{
+    for (int i = 0; i < shadow_map_count; i++)
+    {
+        vec4 projected = shadow_matrices[i] * vec4(position, 1.0);
+        projected /= projected.w;
+        if (all(lessThan(abs(projected.xyz), vec3(0.99, 0.99, 1.0))))
+        {
+            return shadow_taps(i, projected.xyz);
+        }
+    }
+
+    return 1.0;
+}
+
+// goes smoothly to zero at the attenuation radius
+float attenuation_window(float distance)
+{
+    float x = distance / radius;
+    float w = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return w * w;
+}
+
 void main()
 {
+    // also drawn over light volumes, so the g-buffer is addressed by window position
+    vec2 v_tex_coord = gl_FragCoord.xy / screen_size;
+
     vec3 position = texture2D(tex[0], v_tex_coord).xyz;
     vec3 normal   = texture2D(tex[1], v_tex_coord).xyz;
     vec3 diffuse  = texture2D(tex[2], v_tex_coord).xyz;
@@ -51,24 +87,29 @@ void main()
         to_light = normalize(view_light_position - position);
 
         float falloff_r = length(view_light_position - position);
-        falloff = exp(-0.1 * falloff_r);
+        if (falloff_r > radius)
+        {
+            discard;
+        }
+        falloff = exp(-0.1 * falloff_r) * attenuation_window(falloff_r);
     }
     else if (type == 1)
     {
         to_light = normalize(view_light_position - position);
 
         float falloff_r = length(view_light_position - position);
-        falloff = exp(-0.1 * falloff_r);
+        if (falloff_r > radius)
+        {
+            discard;
+        }
 
         vec4 pos_light_view =  view_to_light_view * vec4(position, 1.0);
         vec4 projected = light_projection * pos_light_view;
 
         projected /= projected.w;
 
-        float point_depth = projected.z * 0.5 + 0.5;
-
         float l = length(projected.xy);
-        falloff = 1.0 - smoothstep(0.9, 1.0, l);
+        falloff = (1.0 - smoothstep(0.9, 1.0, l)) * attenuation_window(falloff_r);
 
         if (pos_light_view.z > 0.0)
         {
@@ -76,7 +117,7 @@ void main()
         }
 
         //float shadow_depth = texture2D(tex[4], 0.5 * projected.xy + 0.5).r;
-        falloff *= shadow(projected, point_depth);
+        falloff *= shadow(position);
         //if (point_depth * 0.9999 - shadow_depth > 0)
         //{
             //discard;
@@ -88,7 +129,7 @@ void main()
     {
         to_light = (view * vec4(-light_direction, 0.0)).xyz;
 
-        falloff = 1.0f;
+        falloff = shadow(position);
     }
 
     float d = max(0.0, dot(normal, to_light));
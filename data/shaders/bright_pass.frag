@@ -0,0 +1,18 @@
+uniform fragment_uniforms
+{
+    float key;
+    float threshold;
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+void main()
+{
+    float adapted = texture2D(tex[1], vec2(0.5)).r;
+    vec3 color = texture2D(tex[0], v_tex_coord).rgb * key / adapted;
+    float luminance = dot(color, vec3(0.27, 0.67, 0.06));
+
+    gl_FragColor = vec4(color * max(0.0, luminance - threshold) / max(luminance, 0.0001), 1.0);
+}
@@ -0,0 +1,63 @@
+uniform fragment_uniforms
+{
+    vec2 screen_size;
+    float near;
+    float far;
+    vec3 cluster_counts; // tiles in x and y, depth slices
+    float light_texture_height;
+    vec2 index_texture_size;
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+// center of a texel of a data texture
+vec2 texel(vec2 xy, vec2 size)
+{
+    return (xy + 0.5) / size;
+}
+
+void main()
+{
+    vec3 position = texture2D(tex[0], v_tex_coord).xyz;
+    vec3 normal   = texture2D(tex[1], v_tex_coord).xyz;
+    vec3 diffuse  = texture2D(tex[2], v_tex_coord).xyz;
+    vec3 specular = texture2D(tex[3], v_tex_coord).xyz;
+    float shininess = texture2D(tex[3], v_tex_coord).w;
+
+    // find the cluster of this fragment, slices are exponential in depth
+    vec2 tile = floor(gl_FragCoord.xy / screen_size * cluster_counts.xy);
+    float slice = floor(log(-position.z / near) / log(far / near) * cluster_counts.z);
+    slice = clamp(slice, 0.0, cluster_counts.z - 1.0);
+    vec2 cluster = texture2D(tex[5], texel(vec2(tile.x + tile.y * cluster_counts.x, slice), vec2(cluster_counts.x * cluster_counts.y, cluster_counts.z))).xy;
+
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < int(cluster.y); i++)
+    {
+        float j = cluster.x + float(i);
+        float index = texture2D(tex[6], texel(vec2(mod(j, index_texture_size.x), floor(j / index_texture_size.x)), index_texture_size)).r;
+        vec4 position_radius = texture2D(tex[4], texel(vec2(0.0, index), vec2(2.0, light_texture_height)));
+        vec3 light_color = texture2D(tex[4], texel(vec2(1.0, index), vec2(2.0, light_texture_height))).rgb;
+
+        vec3 to_light = position_radius.xyz - position;
+        float distance = length(to_light);
+        if (distance > position_radius.w)
+        {
+            continue;
+        }
+        to_light /= distance;
+
+        // smooth window reaching zero at the attenuation radius
+        float x = distance / position_radius.w;
+        float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        float falloff = exp(-0.1 * distance) * window * window;
+        float d = max(0.0, dot(normal, to_light));
+        vec3 r = reflect(-to_light, normal);
+        float s = pow(max(0.0, dot(r, -normalize(position))), shininess);
+
+        color += falloff * light_color * (d * diffuse + s * specular);
+    }
+
+    gl_FragColor = vec4(color, 1.0);
+}
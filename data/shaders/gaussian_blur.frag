@@ -0,0 +1,23 @@
+uniform fragment_uniforms
+{
+    vec2 texel_step; // one texel along the blur direction
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+void main()
+{
+    // 9 tap gaussian, neighbouring taps are merged into single bilinear fetches
+    vec2 d1 = 1.3846153846 * texel_step;
+    vec2 d2 = 3.2307692308 * texel_step;
+
+    vec3 color = 0.2270270270 * texture2D(tex[0], v_tex_coord).rgb;
+    color += 0.3162162162 * texture2D(tex[0], v_tex_coord + d1).rgb;
+    color += 0.3162162162 * texture2D(tex[0], v_tex_coord - d1).rgb;
+    color += 0.0702702703 * texture2D(tex[0], v_tex_coord + d2).rgb;
+    color += 0.0702702703 * texture2D(tex[0], v_tex_coord - d2).rgb;
+
+    gl_FragColor = vec4(color, 1.0);
+}
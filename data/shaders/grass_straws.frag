@@ -1,13 +1,7 @@
-uniform fragment_uniforms
-{
-    mat4 projection;
-    mat4 view;
-    mat4 model;
-};
-
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_fragment_position;
+varying float v_id;
 
 uniform sampler2D tex[8];
 
@@ -31,5 +25,6 @@ void main()
     gl_FragData[1] = vec4(normal, 1.0);  
     gl_FragData[2] = vec4(d.rgb, 1.0);
     gl_FragData[3] = vec4(specular, shininess);
+    gl_FragData[4] = vec4(v_id, 0.0, 0.0, 1.0);
 }
 
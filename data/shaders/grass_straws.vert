@@ -1,18 +1,27 @@
-uniform vertex_uniforms
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
-    mat4 model;
     float time;
 };
 
+uniform vertex_uniforms
+{
+    mat4 model;
+};
+
 attribute vec3 pos;
 attribute vec3 normal;
 attribute vec2 tex_coord;
+attribute mat4 instance_model;
 
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_fragment_position;
+varying float v_id;
+
+// id of the first instance of the batch, see renderl_batch_t
+uniform float base_id;
 
 float snoise(vec4 v);
 
@@ -26,10 +35,11 @@ float wind_strength(vec3 p)
 
 void main()
 {
-    mat4 vm = view * model;
+    mat4 m = instance_model * model;
+    mat4 vm = view * m;
     mat4 pvm = projection * vm;
 
-    vec3 world_position = (model * vec4(pos, 1.0)).xyz;
+    vec3 world_position = (m * vec4(pos, 1.0)).xyz;
     vec2 world_xz = world_position.xz;
 
     //vec2 offset = wind_dir * (0.5 + 0.1 * tex_coord.t * snoise(vec4(0.1 * world_xz - 0.1 * 2.0 * time * wind_dir, 0.0, 0.1 * 0.1 * time)));
@@ -39,5 +49,6 @@ void main()
     v_tex_coord = tex_coord;
     v_normal = (vm * vec4(normal, 0.0)).xyz;
     v_fragment_position = (vm * vec4(pos, 1.0)).xyz;
+    v_id = base_id + float(gl_InstanceID);
 }
 
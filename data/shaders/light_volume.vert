@@ -9,7 +9,5 @@ attribute vec3 pos;
 
 void main()
 {
-    mat4 pvm = projection * view * model;
-    gl_Position = pvm * vec4(pos, 1.0);
+    gl_Position = projection * view * model * vec4(pos, 1.0);
 }
-
@@ -0,0 +1,17 @@
+uniform fragment_uniforms
+{
+    float dummy;
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+void main()
+{
+    vec3 color = texture2D(tex[0], v_tex_coord).rgb;
+    float luminance = dot(color, vec3(0.27, 0.67, 0.06));
+
+    // the mip chain averages this, so its last level holds the log-average luminance
+    gl_FragColor = vec4(log(0.0001 + max(luminance, 0.0)), 0.0, 0.0, 1.0);
+}
@@ -1,16 +1,22 @@
-uniform fragment_uniforms
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
-    mat4 model;
     float time;
 };
 
+// the per draw block of the vertex stage
+uniform vertex_uniforms
+{
+    mat4 model;
+};
+
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_fragment_position;
 
 varying vec3 v_ray_start;
+varying float v_id;
 
 uniform sampler2D tex[8];
 
@@ -125,6 +131,7 @@ void main()
             gl_FragData[1] = vec4((view * model * vec4(n, 0.0)).xyz, 1.0);  
             gl_FragData[2] = vec4(1.0, 0.0, 1.0, 1.0);
             gl_FragData[3] = vec4(0.0, 0.0, 0.0, 1.0);
+            gl_FragData[4] = vec4(v_id, 0.0, 0.0, 1.0);
             return;
         }
         else
@@ -146,5 +153,6 @@ void main()
     //gl_FragData[2] = vec4(1.0, 0.0, 1.0, 1.0);
     gl_FragData[2] = vec4(ray_dir, 1.0);
     gl_FragData[3] = vec4(0.0, 0.0, 0.0, 1.0);
+    gl_FragData[4] = vec4(v_id, 0.0, 0.0, 1.0);
 }
 
@@ -1,23 +1,33 @@
-uniform vertex_uniforms
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
+    float time;
+};
+
+uniform vertex_uniforms
+{
     mat4 model;
 };
 
 attribute vec3 pos;
 attribute vec3 normal;
 attribute vec2 tex_coord;
+attribute mat4 instance_model;
 
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_fragment_position;
 
 varying vec3 v_ray_start;
+varying float v_id;
+
+// id of the first instance of the batch, see renderl_batch_t
+uniform float base_id;
 
 void main()
 {
-    mat4 vm = view * model;
+    mat4 vm = view * instance_model * model;
     mat4 pvm = projection * vm;
     gl_Position = pvm * vec4(pos, 1.0);
     v_tex_coord = tex_coord;
@@ -25,5 +35,6 @@ void main()
     v_fragment_position = (vm * vec4(pos, 1.0)).xyz;
 
     v_ray_start = pos;
+    v_id = base_id + float(gl_InstanceID);
 }
 
@@ -1,55 +1,46 @@
-uniform fragment_uniforms
+uniform material_uniforms
 {
-    mat4 projection;
-    mat4 view;
-    mat4 model;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
     float shininess;
-    bool has_ambient_map;
-    bool has_diffuse_map;
-    bool has_specular_map;
-    bool has_normal_map;
-    vec2 normal_map_dimensions;
 };
 
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_tangent;
 varying vec3 v_fragment_position;
+varying float v_id;
 
 uniform sampler2D tex[8];
 
+// the maps are bound in this order, each one only with its feature defined
+#ifdef AMBIENT_MAP
+#define AMBIENT_MAP_COUNT 1
+#else
+#define AMBIENT_MAP_COUNT 0
+#endif
+#ifdef DIFFUSE_MAP
+#define DIFFUSE_MAP_COUNT 1
+#else
+#define DIFFUSE_MAP_COUNT 0
+#endif
+#ifdef SPECULAR_MAP
+#define SPECULAR_MAP_COUNT 1
+#else
+#define SPECULAR_MAP_COUNT 0
+#endif
+#define DIFFUSE_MAP_INDEX AMBIENT_MAP_COUNT
+#define SPECULAR_MAP_INDEX (DIFFUSE_MAP_INDEX + DIFFUSE_MAP_COUNT)
+#define NORMAL_MAP_INDEX (SPECULAR_MAP_INDEX + SPECULAR_MAP_COUNT)
+
 void main()
 {
-    int next_sampler = 0;
-    int ambient_map_index;
-    int diffuse_map_index;
-    int specular_map_index;
-    int normal_map_index;
-    if (has_ambient_map)
-    {
-        ambient_map_index = next_sampler++;
-    }
-    if (has_diffuse_map)
-    {
-        diffuse_map_index = next_sampler++;
-    }
-    if (has_specular_map)
-    {
-        specular_map_index = next_sampler++;
-    }
-    if (has_normal_map)
-    {
-        normal_map_index = next_sampler++;
-    }
-
     vec3 normal = normalize(v_normal);
     vec4 d = vec4(1.0);
-    if (has_diffuse_map) 
+#ifdef DIFFUSE_MAP
     {
-        d = texture2D(tex[diffuse_map_index], v_tex_coord);
+        d = texture2D(tex[DIFFUSE_MAP_INDEX], v_tex_coord);
         if (d.a < 0.5)
         {
             discard;
@@ -60,14 +51,18 @@ void main()
             d = d;
         }
     }
-    if (has_normal_map) 
+#endif
+#ifdef NORMAL_MAP
     {
         vec3 tangent = normalize(v_tangent);
         vec3 bitangent = cross(normal, tangent);
         mat3 m = mat3(tangent, bitangent, normal);
-        vec3 sampled_normal = normalize(vec3(2.0, 2.0, 2.0) * (texture2D(tex[normal_map_index], v_tex_coord).xyz - vec3(0.5, 0.5, 0.5)));
+        // z from x and y, cooked normal maps only store those two
+        vec2 xy = 2.0 * texture2D(tex[NORMAL_MAP_INDEX], v_tex_coord).xy - vec2(1.0);
+        vec3 sampled_normal = vec3(xy, sqrt(max(0.0, 1.0 - dot(xy, xy))));
         normal = m * sampled_normal;
     }
+#endif
     vec3 specular = vec3(0.0);
     float shininess = 50.0;
 
@@ -75,5 +70,6 @@ void main()
     gl_FragData[1] = vec4(normal, 1.0);  
     gl_FragData[2] = vec4(d.rgb, 1.0);
     gl_FragData[3] = vec4(specular, shininess);
+    gl_FragData[4] = vec4(v_id, 0.0, 0.0, 1.0);
 }
 
@@ -1,7 +1,12 @@
-uniform vertex_uniforms
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
+    float time;
+};
+
+uniform vertex_uniforms
+{
     mat4 model;
 };
 
@@ -9,20 +14,26 @@ attribute vec3 pos;
 attribute vec3 normal;
 attribute vec3 tangent;
 attribute vec2 tex_coord;
+attribute mat4 instance_model;
 
 varying vec2 v_tex_coord;
 varying vec3 v_normal;
 varying vec3 v_tangent;
 varying vec3 v_fragment_position;
+varying float v_id;
+
+// id of the first instance of the batch, see renderl_batch_t
+uniform float base_id;
 
 void main()
 {
-    mat4 vm = view * model;
+    mat4 vm = view * instance_model * model;
     mat4 pvm = projection * vm;
     gl_Position = pvm * vec4(pos, 1.0);
     v_tex_coord = tex_coord;
     v_normal = (vm * vec4(normal, 0.0)).xyz;
     v_tangent = (vm * vec4(tangent, 0.0)).xyz;
     v_fragment_position = (vm * vec4(pos, 1.0)).xyz;
+    v_id = base_id + float(gl_InstanceID);
 }
 
@@ -1,22 +1,36 @@
-uniform fragment_uniforms
+#extension GL_EXT_texture_array : enable
+
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
-    mat4 model;
+    float time;
+};
+
+uniform material_uniforms
+{
+    vec3 xyz_low;
+    vec3 xyz_high;
+    float lod_range_ratio;
+    float grid_size;
+    vec2 heightmap_size;
     vec3 diffuse;
     vec3 specular;
     float shininess;
+    bool use_baked_noise;
 };
 
-varying vec3 v_normal;
 varying vec3 v_fragment_position;
-varying vec3 v_world_normal;
 varying vec3 v_world_position;
 varying vec2 v_lookup;
+varying vec2 v_terrain_uv;
 
 varying vec3 v_distance_to_edge;
+varying float v_id;
 
 uniform sampler2D tex[8];
+// layer 0 grass, 1 dirt, 2 sand
+uniform sampler2DArray tex_array;
 
 float snoise(vec4 v);
 
@@ -40,7 +54,7 @@ float rnoise(int r, vec4 v)
 
 vec4 get_normal(vec2 p)
 {
-    //return texture2D(tex[4], p);
+    //return texture2D(tex[1], p);
     vec2 myTexResolution = vec2(2048.0, 2048.0);
 
     p = p*myTexResolution + 0.5;
@@ -51,32 +65,35 @@ vec4 get_normal(vec2 p)
     p = i + f;
 
     p = (p - 0.5)/myTexResolution;
-    return texture2D(tex[4], p);
+    return texture2D(tex[1], p);
 }
 
 void main()
 {
-    vec3 world_normal = normalize(v_world_normal);
-    //world_normal = 2.0 * (get_normal(v_lookup).xyz - 0.5);
+    // per pixel normals keep the lighting detail of the heightmap on coarse patches
+    vec3 world_normal = normalize(2.0 * (texture2D(tex[1], v_lookup).xyz - 0.5));
     //world_normal = vec3(0.0, 1.0, 0.0);
     float x_contribution = abs(dot(world_normal, vec3(1.0, 0.0, 0.0)));
     float y_contribution = abs(dot(world_normal, vec3(0.0, 1.0, 0.0)));
     float z_contribution = abs(dot(world_normal, vec3(0.0, 0.0, 1.0)));
 
-    float grass = smoothstep(0.6, 2.5, v_world_position.y + 2.0 * (rnoise(2, vec4(0.05 * v_world_position, 0.0))));
+    // the noise doesn't change over time, so it can come from the bake
+    float noise = use_baked_noise ? texture2D(tex[2], v_terrain_uv).r : rnoise(2, vec4(0.05 * v_world_position, 0.0));
+    float grass = smoothstep(0.6, 2.5, v_world_position.y + 2.0 * noise);
 
-    vec3 x_color = texture2D(tex[1], 0.2*v_world_position.zy).rgb;
-    vec3 y_color = mix(texture2D(tex[2], 0.2*v_world_position.xz).rgb, texture2D(tex[0], 0.2*v_world_position.xz).rgb, grass);
-    vec3 z_color = texture2D(tex[1], 0.2*v_world_position.xy).rgb;
+    vec3 x_color = texture2DArray(tex_array, vec3(0.2*v_world_position.zy, 1.0)).rgb;
+    vec3 y_color = mix(texture2DArray(tex_array, vec3(0.2*v_world_position.xz, 2.0)).rgb, texture2DArray(tex_array, vec3(0.2*v_world_position.xz, 0.0)).rgb, grass);
+    vec3 z_color = texture2DArray(tex_array, vec3(0.2*v_world_position.xy, 1.0)).rgb;
 
     float dist = max(max(v_distance_to_edge.x, v_distance_to_edge.y), v_distance_to_edge.z);
 
     gl_FragData[0] = vec4(v_fragment_position, 1.0);
-    gl_FragData[1] = vec4(normalize(v_normal), 1.0);  
+    gl_FragData[1] = vec4(normalize((view * vec4(world_normal, 0.0)).xyz), 1.0);  
     gl_FragData[2] = vec4(diffuse * (x_contribution * x_color + y_contribution * y_color + z_contribution * z_color), 1.0);
-    //gl_FragData[2] = vec4(texture2D(tex[4], v_lookup).rgb, 1.0);
+    //gl_FragData[2] = vec4(texture2D(tex[1], v_lookup).rgb, 1.0);
     //gl_FragData[2] = vec4(world_normal, 1.0);
     //gl_FragData[2] -= vec4(vec3(smoothstep(0.8, 1.0, dist)), 1.0);
     gl_FragData[3] = vec4(vec3(0.0), 1.0);
+    gl_FragData[4] = vec4(v_id, 0.0, 0.0, 1.0);
 }
 
@@ -1,22 +1,42 @@
-uniform vertex_uniforms
+uniform frame_uniforms
 {
     mat4 projection;
     mat4 view;
+    float time;
+};
+
+uniform vertex_uniforms
+{
     mat4 model;
+    vec3 lod_origin;
+};
+
+uniform material_uniforms
+{
     vec3 xyz_low;
     vec3 xyz_high;
+    float lod_range_ratio;
+    float grid_size;
+    vec2 heightmap_size;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+    bool use_baked_noise;
 };
 
 attribute vec3 pos;
-attribute vec3 normal;
+attribute mat4 instance_model;
 
-varying vec3 v_normal;
 varying vec3 v_fragment_position;
-varying vec3 v_world_normal;
 varying vec3 v_world_position;
 varying vec2 v_lookup;
+varying vec2 v_terrain_uv;
 
 varying vec3 v_distance_to_edge;
+varying float v_id;
+
+// id of the first instance of the batch, see renderl_batch_t
+uniform float base_id;
 
 uniform sampler2D tex[8];
 
@@ -40,23 +60,45 @@ float rnoise(int r, vec4 v)
     return accum;
 }
 
+// fraction of its lod range after which a patch starts morphing to its parent
+const float morph_start = 0.7;
+
+// heightmap texture coordinate of a world position, the corner samples
+// sit on the terrain corners
+vec2 heightmap_lookup(vec2 xz)
+{
+    vec2 uv = (xz - xyz_low.xz) / (xyz_high.xz - xyz_low.xz);
+    return (uv * (heightmap_size - 1.0) + 0.5) / heightmap_size;
+}
+
+float sample_height(vec2 xz)
+{
+    return xyz_low.y + (xyz_high.y - xyz_low.y) * texture2D(tex[0], heightmap_lookup(xz)).r;
+}
+
 void main()
 {
-    vec3 world_pos = (model * vec4(pos, 1.0)).xyz;
+    // patches are unit grids scaled to their node, the scale gives the level
+    mat4 m = instance_model * model;
+    vec3 world_pos = (m * vec4(pos, 1.0)).xyz;
+    world_pos.y = sample_height(world_pos.xz);
 
-    vec3 diff = xyz_high - xyz_low;
-    vec2 lookup = (world_pos.xz - xyz_low.xz) / diff.xz;
-    world_pos.y = xyz_low.y + diff.y * texture2D(tex[3], lookup).r;
+    // odd grid vertices slide onto their even neighbours towards the end of
+    // the range, where the patch has to match the parent level next to it
+    float range = lod_range_ratio * m[0][0];
+    float morph = clamp((distance(world_pos, lod_origin) - morph_start * range) / ((1.0 - morph_start) * range), 0.0, 1.0);
+    vec2 grid_pos = pos.xz * grid_size;
+    vec2 morphed = (grid_pos - 2.0 * fract(0.5 * grid_pos) * morph) / grid_size;
+    world_pos = (m * vec4(morphed.x, 0.0, morphed.y, 1.0)).xyz;
+    world_pos.y = sample_height(world_pos.xz);
+
+    v_lookup = heightmap_lookup(world_pos.xz);
+    v_terrain_uv = (world_pos.xz - xyz_low.xz) / (xyz_high.xz - xyz_low.xz);
     v_distance_to_edge = vec3(1.0);
     v_distance_to_edge[gl_VertexID % 3] = 0.0;
-    v_lookup = lookup;
 
-    mat4 vm = view * model;
-    mat4 pvm = projection * vm;
     gl_Position = projection * view * vec4(world_pos, 1.0);
-    v_normal = (vm * vec4(normal, 0.0)).xyz;
     v_fragment_position = (view * vec4(world_pos, 1.0)).xyz;
-    v_world_normal = (model * vec4(normal, 0.0)).xyz;
-    v_world_position = world_pos;//(model * vec4(pos, 0.0)).xyz;
+    v_world_position = world_pos;
+    v_id = base_id + float(gl_InstanceID);
 }
-
@@ -0,0 +1,41 @@
+uniform fragment_uniforms
+{
+    vec3 xyz_low;
+    vec3 xyz_high;
+    vec2 heightmap_size;
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+float snoise(vec4 v);
+
+float rnoise(int r, vec4 v)
+{
+    float accum = 0.0;
+
+    float weight = 1.0;
+    while (r > 0)
+    {
+        accum += weight * snoise(v);
+
+        weight *= 0.5;
+        v *= 2.0;
+
+        r -= 1;
+    }
+
+    return accum;
+}
+
+// the grass noise of terrain_material.frag at the terrain surface under each texel
+void main()
+{
+    vec2 lookup = (v_tex_coord * (heightmap_size - 1.0) + 0.5) / heightmap_size;
+    vec3 position = vec3(0.0);
+    position.xz = mix(xyz_low.xz, xyz_high.xz, v_tex_coord);
+    position.y = mix(xyz_low.y, xyz_high.y, texture2D(tex[0], lookup).r);
+
+    gl_FragColor = vec4(rnoise(2, vec4(0.05 * position, 0.0)), 0.0, 0.0, 1.0);
+}
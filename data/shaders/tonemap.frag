@@ -0,0 +1,29 @@
+uniform fragment_uniforms
+{
+    float key;
+    float white; // the exposed luminance mapped to white
+    float bloom_strength;
+};
+
+varying vec2 v_tex_coord;
+
+uniform sampler2D tex[8];
+
+void main()
+{
+    float adapted = texture2D(tex[1], vec2(0.5)).r;
+    vec3 color = texture2D(tex[0], v_tex_coord).rgb * key / adapted;
+
+    // the bloom levels are already exposed
+    vec3 bloom = texture2D(tex[2], v_tex_coord).rgb;
+    bloom += texture2D(tex[3], v_tex_coord).rgb;
+    bloom += texture2D(tex[4], v_tex_coord).rgb;
+    bloom += texture2D(tex[5], v_tex_coord).rgb;
+    color += bloom_strength * bloom;
+
+    // reinhard
+    float l = dot(color, vec3(0.27, 0.67, 0.06));
+    float ld = l * (1.0 + l / (white * white)) / (1.0 + l);
+
+    gl_FragColor = vec4(color * ld / max(l, 0.0001), 1.0);
+}
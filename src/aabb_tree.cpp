@@ -0,0 +1,382 @@
+#include <cmath>
+#include <cassert>
+
+#include "aabb_tree.hpp"
+
+static aabb_t combine(const aabb_t &a, const aabb_t &b)
+{
+    aabb_t res;
+    for (int i = 0; i < 3; i++)
+    {
+        res.low.c[i] = fminf(a.low.c[i], b.low.c[i]);
+        res.high.c[i] = fmaxf(a.high.c[i], b.high.c[i]);
+    }
+    return res;
+}
+
+static float surface_area(const aabb_t &box)
+{
+    vec3_t<> d = box.high - box.low;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool contains(const aabb_t &outer, const aabb_t &inner)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (inner.low.c[i] < outer.low.c[i] || inner.high.c[i] > outer.high.c[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool aabb_overlap(const aabb_t &a, const aabb_t &b)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (a.high.c[i] < b.low.c[i] || b.high.c[i] < a.low.c[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool aabb_overlap_sphere(const aabb_t &box, const vec3_t<> &center, float radius)
+{
+    float d2 = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        float v = center.c[i];
+        if (v < box.low.c[i])
+        {
+            d2 += (box.low.c[i] - v) * (box.low.c[i] - v);
+        }
+        else if (v > box.high.c[i])
+        {
+            d2 += (v - box.high.c[i]) * (v - box.high.c[i]);
+        }
+    }
+    return d2 <= radius * radius;
+}
+
+bool aabb_intersect_ray(const aabb_t &box, const vec3_t<> &origin, const vec3_t<> &direction, float max_t)
+{
+    float t0 = 0.0f;
+    float t1 = max_t;
+    for (int i = 0; i < 3; i++)
+    {
+        if (direction.c[i] == 0.0f)
+        {
+            if (origin.c[i] < box.low.c[i] || origin.c[i] > box.high.c[i])
+            {
+                return false;
+            }
+            continue;
+        }
+
+        float inv_d = 1.0f / direction.c[i];
+        float near = (box.low.c[i] - origin.c[i]) * inv_d;
+        float far = (box.high.c[i] - origin.c[i]) * inv_d;
+        if (near > far)
+        {
+            float tmp = near;
+            near = far;
+            far = tmp;
+        }
+        t0 = fmaxf(t0, near);
+        t1 = fminf(t1, far);
+        if (t0 > t1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void aabb_tree_init(aabb_tree_t *tree, float margin)
+{
+    tree->nodes.clear();
+    tree->root = -1;
+    tree->free_list = -1;
+    tree->margin = margin;
+}
+
+static int allocate_node(aabb_tree_t *tree)
+{
+    int index;
+    if (tree->free_list == -1)
+    {
+        index = tree->nodes.size();
+        tree->nodes.push_back(aabb_tree_node_t());
+    }
+    else
+    {
+        index = tree->free_list;
+        tree->free_list = tree->nodes[index].parent;
+    }
+
+    aabb_tree_node_t &node = tree->nodes[index];
+    node.parent = -1;
+    node.children[0] = -1;
+    node.children[1] = -1;
+    node.height = 0;
+    node.user_data = -1;
+    return index;
+}
+
+static void free_node(aabb_tree_t *tree, int index)
+{
+    tree->nodes[index].parent = tree->free_list;
+    tree->nodes[index].height = -1;
+    tree->free_list = index;
+}
+
+static void replace_child(aabb_tree_t *tree, int parent, int old_child, int new_child)
+{
+    if (parent == -1)
+    {
+        tree->root = new_child;
+    }
+    else if (tree->nodes[parent].children[0] == old_child)
+    {
+        tree->nodes[parent].children[0] = new_child;
+    }
+    else
+    {
+        tree->nodes[parent].children[1] = new_child;
+    }
+}
+
+static void refit(aabb_tree_t *tree, int index)
+{
+    aabb_tree_node_t &node = tree->nodes[index];
+    const aabb_tree_node_t &a = tree->nodes[node.children[0]];
+    const aabb_tree_node_t &b = tree->nodes[node.children[1]];
+    node.box = combine(a.box, b.box);
+    node.height = 1 + (a.height > b.height ? a.height : b.height);
+}
+
+// if one child of a is two levels higher than the other, rotate its higher
+// grandchild up. returns the index of the new subtree root
+static int rotate(aabb_tree_t *tree, int a)
+{
+    std::vector<aabb_tree_node_t> &nodes = tree->nodes;
+    if (nodes[a].children[0] == -1 || nodes[a].height < 2)
+    {
+        return a;
+    }
+
+    int balance = nodes[nodes[a].children[1]].height - nodes[nodes[a].children[0]].height;
+    if (balance >= -1 && balance <= 1)
+    {
+        return a;
+    }
+
+    // c is the higher child and becomes the parent of a, b stays below a
+    int side = balance > 1 ? 1 : 0;
+    int c = nodes[a].children[side];
+    int f = nodes[c].children[0];
+    int g = nodes[c].children[1];
+
+    nodes[c].children[0] = a;
+    nodes[c].parent = nodes[a].parent;
+    nodes[a].parent = c;
+    replace_child(tree, nodes[c].parent, a, c);
+
+    // the higher grandchild stays with c, the other one moves under a
+    int keep = nodes[f].height > nodes[g].height ? f : g;
+    int move = keep == f ? g : f;
+    nodes[c].children[1] = keep;
+    nodes[a].children[side] = move;
+    nodes[move].parent = a;
+
+    refit(tree, a);
+    refit(tree, c);
+    return c;
+}
+
+static void refit_upwards(aabb_tree_t *tree, int index)
+{
+    while (index != -1)
+    {
+        index = rotate(tree, index);
+        refit(tree, index);
+        index = tree->nodes[index].parent;
+    }
+}
+
+static void insert_leaf(aabb_tree_t *tree, int leaf)
+{
+    if (tree->root == -1)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = -1;
+        return;
+    }
+
+    // descend towards the sibling which grows the tree surface area the least
+    aabb_t leaf_box = tree->nodes[leaf].box;
+    int index = tree->root;
+    while (tree->nodes[index].children[0] != -1)
+    {
+        const aabb_tree_node_t &node = tree->nodes[index];
+        float area = surface_area(node.box);
+        float combined_area = surface_area(combine(node.box, leaf_box));
+
+        // cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combined_area;
+        // cost pushed down to the children by growing this node
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        float child_costs[2];
+        for (int i = 0; i < 2; i++)
+        {
+            const aabb_tree_node_t &child = tree->nodes[node.children[i]];
+            float grown_area = surface_area(combine(child.box, leaf_box));
+            if (child.children[0] == -1)
+            {
+                child_costs[i] = grown_area + inheritance_cost;
+            }
+            else
+            {
+                child_costs[i] = grown_area - surface_area(child.box) + inheritance_cost;
+            }
+        }
+
+        if (cost < child_costs[0] && cost < child_costs[1])
+        {
+            break;
+        }
+        index = child_costs[0] < child_costs[1] ? node.children[0] : node.children[1];
+    }
+
+    int sibling = index;
+    int old_parent = tree->nodes[sibling].parent;
+    int new_parent = allocate_node(tree);
+    tree->nodes[new_parent].parent = old_parent;
+    tree->nodes[new_parent].children[0] = sibling;
+    tree->nodes[new_parent].children[1] = leaf;
+    tree->nodes[sibling].parent = new_parent;
+    tree->nodes[leaf].parent = new_parent;
+    replace_child(tree, old_parent, sibling, new_parent);
+
+    refit_upwards(tree, new_parent);
+}
+
+static void remove_leaf(aabb_tree_t *tree, int leaf)
+{
+    if (leaf == tree->root)
+    {
+        tree->root = -1;
+        return;
+    }
+
+    int parent = tree->nodes[leaf].parent;
+    int grandparent = tree->nodes[parent].parent;
+    int sibling = tree->nodes[parent].children[0] == leaf ? tree->nodes[parent].children[1] : tree->nodes[parent].children[0];
+
+    replace_child(tree, grandparent, parent, sibling);
+    tree->nodes[sibling].parent = grandparent;
+    free_node(tree, parent);
+
+    refit_upwards(tree, grandparent);
+}
+
+static aabb_t fatten(const aabb_tree_t &tree, const aabb_t &box)
+{
+    vec3_t<> m(tree.margin, tree.margin, tree.margin);
+    aabb_t res;
+    res.low = box.low - m;
+    res.high = box.high + m;
+    return res;
+}
+
+int aabb_tree_insert(aabb_tree_t *tree, const aabb_t &box, int user_data)
+{
+    int proxy = allocate_node(tree);
+    tree->nodes[proxy].box = fatten(*tree, box);
+    tree->nodes[proxy].user_data = user_data;
+    insert_leaf(tree, proxy);
+    return proxy;
+}
+
+void aabb_tree_remove(aabb_tree_t *tree, int proxy)
+{
+    assert(tree->nodes[proxy].children[0] == -1);
+    remove_leaf(tree, proxy);
+    free_node(tree, proxy);
+}
+
+bool aabb_tree_move(aabb_tree_t *tree, int proxy, const aabb_t &box)
+{
+    if (contains(tree->nodes[proxy].box, box))
+    {
+        return false;
+    }
+
+    remove_leaf(tree, proxy);
+    tree->nodes[proxy].box = fatten(*tree, box);
+    insert_leaf(tree, proxy);
+    return true;
+}
+
+int aabb_tree_height(const aabb_tree_t &tree)
+{
+    return tree.root == -1 ? 0 : tree.nodes[tree.root].height;
+}
+
+template <typename T>
+static void query(const aabb_tree_t &tree, const T &test, std::vector<int> *results)
+{
+    if (tree.root == -1)
+    {
+        return;
+    }
+
+    // the tree is balanced, so the stack never gets deeper than its height + 1
+    int stack[128];
+    int stack_size = 0;
+    stack[stack_size++] = tree.root;
+    while (stack_size > 0)
+    {
+        const aabb_tree_node_t &node = tree.nodes[stack[--stack_size]];
+        if (!test(node.box))
+        {
+            continue;
+        }
+
+        if (node.children[0] == -1)
+        {
+            results->push_back(node.user_data);
+        }
+        else
+        {
+            assert(stack_size + 2 <= 128);
+            stack[stack_size++] = node.children[0];
+            stack[stack_size++] = node.children[1];
+        }
+    }
+}
+
+void aabb_tree_query_box(const aabb_tree_t &tree, const aabb_t &box, std::vector<int> *results)
+{
+    query(tree, [&box](const aabb_t &b) { return aabb_overlap(b, box); }, results);
+}
+
+void aabb_tree_query_sphere(const aabb_tree_t &tree, const vec3_t<> &center, float radius, std::vector<int> *results)
+{
+    query(tree, [&center, radius](const aabb_t &b) { return aabb_overlap_sphere(b, center, radius); }, results);
+}
+
+void aabb_tree_query_frustum(const aabb_tree_t &tree, const frustum_t &frustum, std::vector<int> *results)
+{
+    query(tree, [&frustum](const aabb_t &b) { return frustum_test_box(frustum, b.low, b.high); }, results);
+}
+
+void aabb_tree_query_ray(const aabb_tree_t &tree, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, std::vector<int> *results)
+{
+    query(tree, [&origin, &direction, max_t](const aabb_t &b) { return aabb_intersect_ray(b, origin, direction, max_t); }, results);
+}
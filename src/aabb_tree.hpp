@@ -0,0 +1,56 @@
+#ifndef _AABB_TREE_HPP
+#define _AABB_TREE_HPP
+
+#include <vector>
+
+#include "math.hpp"
+#include "frustum.hpp"
+
+struct aabb_t
+{
+    vec3_t<> low;
+    vec3_t<> high;
+};
+
+struct aabb_tree_node_t
+{
+    // leaves store their box grown by the tree margin
+    aabb_t box;
+    // next free node when the node is unused
+    int parent;
+    // -1 for leaves
+    int children[2];
+    // 0 for leaves, -1 when unused
+    int height;
+    int user_data;
+};
+
+// dynamic bounding volume hierarchy, balanced with avl style rotations.
+// proxies are node indices and stay valid until removed
+struct aabb_tree_t
+{
+    std::vector<aabb_tree_node_t> nodes;
+    int root;
+    int free_list;
+    float margin;
+};
+
+void aabb_tree_init(aabb_tree_t *tree, float margin);
+int aabb_tree_insert(aabb_tree_t *tree, const aabb_t &box, int user_data);
+void aabb_tree_remove(aabb_tree_t *tree, int proxy);
+// reinserts the proxy only if box left its fat box, returns true if it did
+bool aabb_tree_move(aabb_tree_t *tree, int proxy, const aabb_t &box);
+int aabb_tree_height(const aabb_tree_t &tree);
+
+// queries append the user data of every leaf whose fat box passes the test
+void aabb_tree_query_box(const aabb_tree_t &tree, const aabb_t &box, std::vector<int> *results);
+void aabb_tree_query_sphere(const aabb_tree_t &tree, const vec3_t<> &center, float radius, std::vector<int> *results);
+void aabb_tree_query_frustum(const aabb_tree_t &tree, const frustum_t &frustum, std::vector<int> *results);
+void aabb_tree_query_ray(const aabb_tree_t &tree, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, std::vector<int> *results);
+
+bool aabb_overlap(const aabb_t &a, const aabb_t &b);
+bool aabb_overlap_sphere(const aabb_t &box, const vec3_t<> &center, float radius);
+// slab test, direction need not be normalized, max_t is in units of direction
+bool aabb_intersect_ray(const aabb_t &box, const vec3_t<> &origin, const vec3_t<> &direction, float max_t);
+
+#endif // _AABB_TREE_HPP
@@ -4,11 +4,18 @@
 #include <AL/al.h> // for alGetError
 #endif
 
+#include <algorithm>
+#include <vector>
+
 #include "audiol.hpp"
 #include "audio_system.hpp"
 #include "entity_system.hpp"
 #include "components.hpp"
 #include "renderh.hpp"
+#include "engine.hpp"
+
+// sources further away than this are stopped
+static const float audible_distance = 60.0f;
 
 audio_system_t::audio_system_t()
 {
@@ -34,15 +41,44 @@ void audio_system_t::update(float dt)
 
     audiol_place_listener(position->xyz, orientation->rotation);
 
-    entity_manager_t::default_manager->iterate_nodes<sound_source_component_t, position_component_t>(1, [](sound_source_component_t *sound_source, position_component_t *pos)
+    // only sources near the listener keep a playing voice
+    static std::vector<int> audible;
+    static std::vector<int> previously_audible;
+    previously_audible.swap(audible);
+    audible.clear();
+    engine_t::instance->spatial_system.query_sphere(position->xyz, audible_distance, &audible);
+    std::sort(audible.begin(), audible.end());
+
+    for (int i = 0; i < (int)previously_audible.size(); i++)
+    {
+        int entity = previously_audible[i];
+        if (!std::binary_search(audible.begin(), audible.end(), entity))
+        {
+            sound_source_component_t *sound_source = entity_manager_t::default_manager->get_component<sound_source_component_t>(entity);
+            if (sound_source && sound_source->voice.currently_playing != NULL)
+            {
+                audiol_detach_wave(&sound_source->voice);
+            }
+        }
+    }
+
+    for (int i = 0; i < (int)audible.size(); i++)
     {
+        int entity = audible[i];
+        sound_source_component_t *sound_source = entity_manager_t::default_manager->get_component<sound_source_component_t>(entity);
+        if (sound_source == NULL)
+        {
+            continue;
+        }
+        position_component_t *pos = entity_manager_t::default_manager->get_component<position_component_t>(entity);
+
         audiol_place_voice(sound_source->voice, pos->xyz);
 
         if (sound_source->voice.currently_playing == NULL)
         {
             audiol_attach_wave(&sound_source->voice, *sound_source->wave);
         }
-    });
+    }
     if (alGetError() != AL_NO_ERROR)
     {
         std::cout << "omg problem!" << std::endl;
@@ -109,3 +109,10 @@ void audiol_attach_wave(audiol_voice_t *voice, const audiol_wave_t &wave)
     alSourcePlay(voice->handle);
 }
 
+void audiol_detach_wave(audiol_voice_t *voice)
+{
+    alSourceStop(voice->handle);
+    alSourcei(voice->handle, AL_BUFFER, 0);
+    voice->currently_playing = NULL;
+}
+
@@ -33,6 +33,7 @@ void audiol_delete_voice(const audiol_voice_t &voice);
 void audiol_place_voice(const audiol_voice_t &voice, const vec3_t<> &position);
 void audiol_place_listener(const vec3_t<> &position, const quat_t<> &orientation);
 void audiol_attach_wave(audiol_voice_t *voice, const audiol_wave_t &wave);
+void audiol_detach_wave(audiol_voice_t *voice);
 
 #endif // AUDIOL_HPP
 
@@ -40,6 +40,17 @@ void print_component_contents(const component_t *component)
         puts("  render_model");
         printf("    model: %p\n", r->model);
     }
+    else if (const render_model_instances_component_t *r = dynamic_cast<const render_model_instances_component_t *>(component))
+    {
+        puts("  render_model_instances");
+        printf("    model: %p\n", r->model);
+        printf("    instances: %d\n", (int)r->model_matrices.size());
+    }
+    else if (const render_terrain_component_t *t = dynamic_cast<const render_terrain_component_t *>(component))
+    {
+        puts("  render_terrain");
+        printf("    terrain: %p\n", t->terrain);
+    }
     else if (const render_water_surface_component_t *w = dynamic_cast<const render_water_surface_component_t *>(component))
     {
         puts("  render_water_surface");
@@ -49,6 +60,13 @@ void print_component_contents(const component_t *component)
     {
         puts("  point_light");
         print_vec3("color", l->color);
+        print_float("radius", l->radius);
+    }
+    else if (const spot_light_component_t *l = dynamic_cast<const spot_light_component_t *>(component))
+    {
+        puts("  spot_light");
+        print_vec3("color", l->color);
+        print_float("radius", l->radius);
     }
     else if (const directional_light_component_t *l = dynamic_cast<const directional_light_component_t *>(component))
     {
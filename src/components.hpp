@@ -2,6 +2,7 @@
 #define _COMPONENTS_HPP
 
 #include <string>
+#include <vector>
 
 #include "entity_system.hpp"
 #include "audiol.hpp"
@@ -51,6 +52,22 @@ public:
     const class renderh_model_t *model;
 };
 
+// many static copies of one model (vegetation and such), much cheaper
+// than one entity per copy. the model matrices are in world space
+class render_model_instances_component_t : public component_t
+{
+public:
+    const class renderh_model_t *model;
+    std::vector<mat4_t<> > model_matrices;
+};
+
+// chunked lod terrain, positioned by its heightmap rather than a position component
+class render_terrain_component_t : public component_t
+{
+public:
+    const struct terrain_t *terrain;
+};
+
 class render_water_surface_component_t : public component_t
 {
 public:
@@ -61,12 +78,16 @@ class point_light_component_t : public component_t
 {
 public:
     vec3_t<> color;
+    // attenuation radius, the light has no effect beyond it
+    float radius;
 };
 
 class spot_light_component_t : public component_t
 {
 public:
     vec3_t<> color;
+    // attenuation radius, the light has no effect beyond it
+    float radius;
 };
 
 class directional_light_component_t : public component_t
@@ -88,10 +109,34 @@ public:
     bool in_system;
 };
 
+// one tile of the render system's shadow atlas
+struct shadow_map_t
+{
+    // -1 until one is handed out
+    int tile;
+    // light matrix the tile was last drawn with, valid once it has been drawn
+    mat4_t<> view_projection;
+    bool valid;
+    // something moved inside the frustum of view_projection since then
+    bool dirty;
+};
+
 class shadow_caster_component_t : public component_t
 {
 public:
-    class renderl_frame_buffer_t *shadow_fbo;
+    shadow_map_t shadow_map;
+};
+
+#define SHADOW_CASCADE_COUNT 4
+
+// shadow maps of a directional light, fit to consecutive slices of the
+// camera frustum, nearest first
+class cascaded_shadow_caster_component_t : public component_t
+{
+public:
+    shadow_map_t cascades[SHADOW_CASCADE_COUNT];
+    // distance from the camera the last cascade reaches
+    float max_distance;
 };
 
 void print_component_contents(const component_t *component);
@@ -3,6 +3,8 @@
 
 #include "engine.hpp"
 #include "fswatch.hpp"
+#include "headless.hpp"
+#include "jobs.hpp"
 #include "renderl.hpp"
 #include "renderm.hpp"
 #include "renderh.hpp"
@@ -16,9 +18,17 @@ int window_height = 480;
 float window_aspect = (float)window_width/(float)window_height;
 bool window_fullscreen = false;
 bool running = true;
+// no window, frames go to an offscreen frame buffer and time advances a
+// fixed tick per frame. frame_limit 0 runs until closed, with a
+// frame_dump_pattern every frame is written to the png it formats to
+bool headless = false;
+int frame_limit = 0;
+const char *frame_dump_pattern = NULL;
 
 engine_t *engine_t::instance = NULL;
 
+double precision_time_now();
+
 static void key_callback(int key, int action)
 {
     if (action == GLFW_PRESS)
@@ -74,61 +84,90 @@ void engine_t::init()
     lua_init();
     lua_load_file("data/scripts/init.lua");
 
-    glfwInit();
+    if (headless)
+    {
+        assert(headless_init());
+    }
+    else
+    {
+        glfwInit();
 
-    glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
-    glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
-    glfwOpenWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+        glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+        glfwOpenWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    assert(glfwOpenWindow(window_width, window_height, 8, 8, 8, 8, 24, 0, window_fullscreen ? GLFW_FULLSCREEN : GLFW_WINDOW) == GL_TRUE);
+        assert(glfwOpenWindow(window_width, window_height, 8, 8, 8, 8, 24, 0, window_fullscreen ? GLFW_FULLSCREEN : GLFW_WINDOW) == GL_TRUE);
 
-    assert(glfwGetWindowParam(GLFW_OPENGL_VERSION_MAJOR) == 3);
-    assert(glfwGetWindowParam(GLFW_OPENGL_VERSION_MINOR) == 2);
-    assert(glfwGetWindowParam(GLFW_OPENGL_FORWARD_COMPAT) == GL_TRUE);
-    assert(glfwGetWindowParam(GLFW_OPENGL_PROFILE) == GLFW_OPENGL_CORE_PROFILE);
+        assert(glfwGetWindowParam(GLFW_OPENGL_VERSION_MAJOR) == 3);
+        assert(glfwGetWindowParam(GLFW_OPENGL_VERSION_MINOR) == 2);
+        assert(glfwGetWindowParam(GLFW_OPENGL_FORWARD_COMPAT) == GL_TRUE);
+        assert(glfwGetWindowParam(GLFW_OPENGL_PROFILE) == GLFW_OPENGL_CORE_PROFILE);
+    }
 
     // without the following line glGenFramebuffers and others are NULL on my computer:
     //Experimental Drivers
     //
     //GLEW obtains information on the supported extensions from the graphics driver. Experimental or pre-release drivers, however, might not report every available extension through the standard mechanism, in which case GLEW will report it unsupported. To circumvent this situation, the glewExperimental global switch can be turned on by setting it to GL_TRUE before calling glewInit(), which ensures that all extensions with valid entry points will be exposed.
     glewExperimental = GL_TRUE;
-    assert(glewInit() == GLEW_OK);
+    // glewInit also wants a glx display, which an egl context doesn't come with
+    assert((headless ? glewContextInit() : glewInit()) == GLEW_OK);
     assert(GLEW_VERSION_3_2);
     render_print_errors("glewInit()");
 
-    glfwSetKeyCallback(key_callback);
-    glfwSetMouseButtonCallback(button_callback);
-    glfwSetMousePosCallback(mouse_pos_callback);
-    glfwSetWindowCloseCallback(window_close_callback);
+    if (!headless)
+    {
+        glfwSetKeyCallback(key_callback);
+        glfwSetMouseButtonCallback(button_callback);
+        glfwSetMousePosCallback(mouse_pos_callback);
+        glfwSetWindowCloseCallback(window_close_callback);
+    }
 
     fswatch_init();
+    jobs_init(0);
     renderl_init();
+    if (headless)
+    {
+        // what the window would have had, rgba8 with depth and stencil
+        static renderl_frame_buffer_t window_fbo = renderl_create_frame_buffer(window_width, window_height, 1, GL_RGBA8, true);
+        renderl_set_window_frame_buffer(&window_fbo);
+    }
     //renderm_init();
-    renderh_init();
     audiol_init();
     resource_init();
     render_system.init();
     input_system.init();
     audio_system.init();
     physics_system.init();
+    spatial_system.init();
+}
+
+// headless runs step a clock of their own, one tick per frame, so every
+// run simulates and draws the same frames however slow the gpu is
+static double headless_time = 0.0;
+
+static double current_time()
+{
+    return headless ? headless_time : glfwGetTime();
 }
 
 void engine_t::run()
 {
     audio_system.unpause();
 
-    double next_update_time = glfwGetTime();
+    double next_update_time = current_time();
     const int ticks_per_second = 60;
 
     double next_frame_time = 1.0;
     int frames = 0;
+    int frame_count = 0;
+    double run_start = precision_time_now();
 
 	// here we go!
 	while (running && !input_system.keys[GLFW_KEY_ESC])
 	{
-		static double last_frame = glfwGetTime();
-		double this_frame = glfwGetTime();
+		static double last_frame = current_time();
+		double this_frame = current_time();
         time_now = this_frame;
 
 		while (next_update_time < this_frame)
@@ -143,16 +182,36 @@ void engine_t::run()
 			//update_world(t, dt);
 		}
 
+        spatial_system.update(this_frame - last_frame);
         audio_system.update(this_frame - last_frame);
         render_system.update(this_frame - last_frame);
 
 		last_frame = this_frame;
 
-        glfwSwapBuffers();
+        if (headless)
+        {
+            if (frame_dump_pattern)
+            {
+                char filename[256];
+                snprintf(filename, sizeof(filename), frame_dump_pattern, frame_count);
+                headless_write_png(filename, window_width, window_height);
+            }
+            headless_time += 1.0 / ticks_per_second;
+        }
+        else
+        {
+            glfwSwapBuffers();
+        }
 
 		render_print_errors("end of main loop");
 
-		if (next_frame_time <= this_frame)
+        frame_count++;
+        if (frame_limit > 0 && frame_count >= frame_limit)
+        {
+            running = false;
+        }
+
+		if (!headless && next_frame_time <= this_frame)
 		{
             char title[] = "SEE";
 			char s[64];
@@ -164,11 +223,21 @@ void engine_t::run()
 		frames += 1;
 
         fswatch_poll();
+        jobs_poll();
 
         //glfwSleep(0.01);
 	}
 
-    glfwCloseWindow();
+    if (headless)
+    {
+        // wall time, dumped frames included
+        printf("%d frames in %.3f s\n", frame_count, precision_time_now() - run_start);
+        headless_shutdown();
+    }
+    else
+    {
+        glfwCloseWindow();
+    }
 }
 
 /*
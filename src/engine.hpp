@@ -6,6 +6,7 @@
 #include "input_system.hpp"
 #include "audio_system.hpp"
 #include "physics_system.hpp"
+#include "spatial_system.hpp"
 
 class engine_t
 {
@@ -17,6 +18,7 @@ public:
     input_system_t input_system;
     audio_system_t audio_system;
     physics_system_t physics_system;
+    spatial_system_t spatial_system;
 
     engine_t();
 
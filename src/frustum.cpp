@@ -0,0 +1,111 @@
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "frustum.hpp"
+
+frustum_t frustum_from_matrix(const mat4_t<> &m)
+{
+    // rows of the column major matrix
+    vec4_t<> rows[4];
+    for (int i = 0; i < 4; i++)
+    {
+        rows[i] = vec4_t<>(m.c[i], m.c[4 + i], m.c[8 + i], m.c[12 + i]);
+    }
+
+    frustum_t frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+
+    for (int i = 0; i < 6; i++)
+    {
+        vec4_t<> &p = frustum.planes[i];
+        float inv_length = 1.0f / sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+        p = p * inv_length;
+    }
+
+    return frustum;
+}
+
+bool frustum_test_sphere(const frustum_t &frustum, const vec3_t<> &center, float radius)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const vec4_t<> &p = frustum.planes[i];
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool frustum_test_box(const frustum_t &frustum, const vec3_t<> &low, const vec3_t<> &high)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        // the corner furthest along the plane normal
+        const vec4_t<> &p = frustum.planes[i];
+        float x = p.x > 0.0f ? high.x : low.x;
+        float y = p.y > 0.0f ? high.y : low.y;
+        float z = p.z > 0.0f ? high.z : low.z;
+        if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int frustum_cull_spheres(const frustum_t &frustum, int sphere_count, const vec4_t<> *spheres, unsigned char *visible)
+{
+    int visible_count = 0;
+
+#ifdef __SSE__
+    // planes transposed so one sphere is tested against four planes at a time,
+    // the last two slots repeat the first plane
+    __m128 px[2], py[2], pz[2], pw[2];
+    for (int i = 0; i < 2; i++)
+    {
+        const vec4_t<> &p0 = frustum.planes[i * 4 + 0];
+        const vec4_t<> &p1 = frustum.planes[i * 4 + 1];
+        const vec4_t<> &p2 = frustum.planes[i == 0 ? 2 : 0];
+        const vec4_t<> &p3 = frustum.planes[i == 0 ? 3 : 0];
+        px[i] = _mm_setr_ps(p0.x, p1.x, p2.x, p3.x);
+        py[i] = _mm_setr_ps(p0.y, p1.y, p2.y, p3.y);
+        pz[i] = _mm_setr_ps(p0.z, p1.z, p2.z, p3.z);
+        pw[i] = _mm_setr_ps(p0.w, p1.w, p2.w, p3.w);
+    }
+
+    for (int i = 0; i < sphere_count; i++)
+    {
+        __m128 s = _mm_loadu_ps(spheres[i].c);
+        __m128 x = _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[0], x), _mm_mul_ps(py[0], y)), _mm_add_ps(_mm_mul_ps(pz[0], z), pw[0]));
+        __m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[1], x), _mm_mul_ps(py[1], y)), _mm_add_ps(_mm_mul_ps(pz[1], z), pw[1]));
+        __m128 outside = _mm_or_ps(_mm_cmplt_ps(d0, neg_r), _mm_cmplt_ps(d1, neg_r));
+
+        visible[i] = _mm_movemask_ps(outside) == 0;
+        visible_count += visible[i];
+    }
+#else
+    for (int i = 0; i < sphere_count; i++)
+    {
+        const vec4_t<> &s = spheres[i];
+        visible[i] = frustum_test_sphere(frustum, vec3_t<>(s.x, s.y, s.z), s.w);
+        visible_count += visible[i];
+    }
+#endif
+
+    return visible_count;
+}
@@ -0,0 +1,19 @@
+#ifndef _FRUSTUM_HPP
+#define _FRUSTUM_HPP
+
+#include "math.hpp"
+
+// six normalized planes (n, d) with n pointing inwards, dot(n, p) + d >= 0 inside
+struct frustum_t
+{
+    vec4_t<> planes[6];
+};
+
+// extracts the planes of projection * view, world space if view is a world to eye matrix
+frustum_t frustum_from_matrix(const mat4_t<> &view_projection);
+bool frustum_test_sphere(const frustum_t &frustum, const vec3_t<> &center, float radius);
+bool frustum_test_box(const frustum_t &frustum, const vec3_t<> &low, const vec3_t<> &high);
+// spheres are (center, radius). visible[i] is set to 0 or 1, returns the number of visible spheres
+int frustum_cull_spheres(const frustum_t &frustum, int sphere_count, const vec4_t<> *spheres, unsigned char *visible);
+
+#endif // _FRUSTUM_HPP
@@ -0,0 +1,251 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <GL/glew.h>
+#ifdef _OSX
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.hpp"
+#include "renderl.hpp"
+
+#ifdef _OSX
+
+bool headless_init()
+{
+    printf("Headless rendering needs egl, which this platform doesn't have\n");
+    return false;
+}
+
+void headless_shutdown()
+{
+}
+
+#else
+
+static struct
+{
+    EGLDisplay display;
+    EGLContext context;
+} egl;
+
+bool headless_init()
+{
+    // the surfaceless platform needs no gpu or display server at all, the
+    // default display is the fallback for drivers without it
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    egl.display = EGL_NO_DISPLAY;
+    if (get_platform_display)
+    {
+        egl.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (egl.display == EGL_NO_DISPLAY)
+    {
+        egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (egl.display == EGL_NO_DISPLAY || !eglInitialize(egl.display, &major, &minor))
+    {
+        printf("Couldn't initialize egl (0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        printf("Egl %d.%d has no desktop opengl\n", major, minor);
+        return false;
+    }
+
+    // nothing is ever drawn to a surface, the config only has to exist
+    const EGLint config_attributes[] =
+    {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint config_count;
+    if (!eglChooseConfig(egl.display, config_attributes, &config, 1, &config_count) || config_count == 0)
+    {
+        printf("No egl config for opengl\n");
+        return false;
+    }
+
+    // the same context the window asks glfw for
+    const EGLint context_attributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+        EGL_NONE
+    };
+    egl.context = eglCreateContext(egl.display, config, EGL_NO_CONTEXT, context_attributes);
+    if (egl.context == EGL_NO_CONTEXT)
+    {
+        printf("Couldn't create an opengl 3.2 core context (0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl.context))
+    {
+        printf("Couldn't make the context current without a surface (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+void headless_shutdown()
+{
+    eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl.display, egl.context);
+    eglTerminate(egl.display);
+}
+
+#endif
+
+static unsigned int crc_table[256];
+
+static unsigned int update_crc(unsigned int crc, const unsigned char *data, int size)
+{
+    if (crc_table[1] == 0)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void write_chunk(FILE *f, const char *type, const unsigned char *data, int size)
+{
+    unsigned char header[8];
+    put_u32(header, size);
+    memcpy(header + 4, type, 4);
+
+    unsigned char footer[4];
+    unsigned int crc = update_crc(0xffffffff, header + 4, 4);
+    crc = update_crc(crc, data, size);
+    put_u32(footer, crc ^ 0xffffffff);
+
+    fwrite(header, 1, 8, f);
+    fwrite(data, 1, size, f);
+    fwrite(footer, 1, 4, f);
+}
+
+// rows of width * 4 bytes, top first. the zlib stream is made of stored
+// blocks, bigger files but no compressor to carry around
+static bool write_png(const char *filename, int width, int height, const unsigned char *rgba)
+{
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        printf("Couldn't open %s for writing\n", filename);
+        return false;
+    }
+
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    fwrite(signature, 1, 8, f);
+
+    // 8 bits per channel, rgba, no interlacing
+    unsigned char header[13];
+    put_u32(header, width);
+    put_u32(header + 4, height);
+    header[8] = 8;
+    header[9] = 6;
+    header[10] = header[11] = header[12] = 0;
+    write_chunk(f, "IHDR", header, 13);
+
+    // every row starts with filter type 0, none
+    int row_size = 1 + 4 * width;
+    int raw_size = row_size * height;
+    unsigned char *raw = new unsigned char[raw_size];
+    for (int y = 0; y < height; y++)
+    {
+        raw[y * row_size] = 0;
+        memcpy(raw + y * row_size + 1, rgba + y * 4 * width, 4 * width);
+    }
+
+    int block_count = (raw_size + 65534) / 65535;
+    int data_size = 2 + 5 * block_count + raw_size + 4;
+    unsigned char *data = new unsigned char[data_size];
+    unsigned char *p = data;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    unsigned int a = 1, b = 0;
+    for (int offset = 0; offset < raw_size; offset += 65535)
+    {
+        int size = raw_size - offset < 65535 ? raw_size - offset : 65535;
+        *p++ = offset + size == raw_size ? 1 : 0;
+        *p++ = size & 0xff;
+        *p++ = size >> 8;
+        *p++ = ~size & 0xff;
+        *p++ = (~size >> 8) & 0xff;
+        memcpy(p, raw + offset, size);
+        p += size;
+
+        for (int i = 0; i < size; i++)
+        {
+            a = (a + raw[offset + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    put_u32(p, (b << 16) | a);
+    write_chunk(f, "IDAT", data, data_size);
+    write_chunk(f, "IEND", NULL, 0);
+
+    delete[] data;
+    delete[] raw;
+    fclose(f);
+    return true;
+}
+
+bool headless_write_png(const char *filename, int width, int height)
+{
+    unsigned char *pixels = new unsigned char[4 * width * height];
+    renderl_bind_frame_buffer(NULL);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    // gl reads bottom up. whatever the passes left in alpha isn't meant to
+    // be seen, a window would show the pixels opaque
+    unsigned char *flipped = new unsigned char[4 * width * height];
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(flipped + y * 4 * width, pixels + (height - 1 - y) * 4 * width, 4 * width);
+    }
+    for (int i = 0; i < width * height; i++)
+    {
+        flipped[4 * i + 3] = 255;
+    }
+
+    bool res = write_png(filename, width, height, flipped);
+    delete[] flipped;
+    delete[] pixels;
+    return res;
+}
@@ -0,0 +1,11 @@
+#ifndef _HEADLESS_HPP
+#define _HEADLESS_HPP
+
+// an opengl 3.2 core context without a window or a display, from mesa's
+// surfaceless egl platform (llvmpipe will do). false when there is none
+bool headless_init();
+void headless_shutdown();
+// the pixels of the window frame buffer as an rgba png, top row first
+bool headless_write_png(const char *filename, int width, int height);
+
+#endif // _HEADLESS_HPP
@@ -0,0 +1,220 @@
+#include <cassert>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "jobs.hpp"
+
+#define MAX_WORKER_COUNT 16
+
+struct job_t
+{
+    void (*work)(void *user_data);
+    void (*done)(void *user_data);
+    void *user_data;
+};
+
+static struct
+{
+    pthread_t workers[MAX_WORKER_COUNT];
+    int worker_count;
+
+    pthread_mutex_t mutex;
+    // signalled when a job is queued and when one is finished
+    pthread_cond_t queued;
+    pthread_cond_t finished;
+
+    std::deque<job_t> queue;
+    std::vector<job_t> done;
+    // submitted jobs whose done callback hasn't run yet
+    int pending_count;
+
+    // the indices of the running jobs_run, handed out one at a time. the
+    // generation tells helpers that start late that their loop is over
+    struct
+    {
+        int generation;
+        int count;
+        int next;
+        int finished;
+        void (*work)(int index, void *user_data);
+        void *user_data;
+    } loop;
+} jobs;
+
+static void *worker_main(void *)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&jobs.mutex);
+        while (jobs.queue.empty())
+        {
+            pthread_cond_wait(&jobs.queued, &jobs.mutex);
+        }
+        job_t job = jobs.queue.front();
+        jobs.queue.pop_front();
+        pthread_mutex_unlock(&jobs.mutex);
+
+        job.work(job.user_data);
+
+        pthread_mutex_lock(&jobs.mutex);
+        jobs.done.push_back(job);
+        pthread_cond_signal(&jobs.finished);
+        pthread_mutex_unlock(&jobs.mutex);
+    }
+    return NULL;
+}
+
+void jobs_init(int worker_count)
+{
+    // 0 leaves one core to the main thread
+    if (worker_count <= 0)
+    {
+        worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    if (worker_count < 1)
+    {
+        worker_count = 1;
+    }
+    if (worker_count > MAX_WORKER_COUNT)
+    {
+        worker_count = MAX_WORKER_COUNT;
+    }
+
+    pthread_mutex_init(&jobs.mutex, NULL);
+    pthread_cond_init(&jobs.queued, NULL);
+    pthread_cond_init(&jobs.finished, NULL);
+    jobs.pending_count = 0;
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        int err = pthread_create(&jobs.workers[i], NULL, worker_main, NULL);
+        if (err != 0)
+        {
+            printf("Couldn't start worker thread %d (%d)\n", i, err);
+            assert(0);
+        }
+    }
+    jobs.worker_count = worker_count;
+}
+
+void jobs_submit(void (*work)(void *user_data), void (*done)(void *user_data), void *user_data)
+{
+    assert(jobs.worker_count > 0);
+
+    job_t job;
+    job.work = work;
+    job.done = done;
+    job.user_data = user_data;
+
+    pthread_mutex_lock(&jobs.mutex);
+    jobs.queue.push_back(job);
+    jobs.pending_count++;
+    pthread_cond_signal(&jobs.queued);
+    pthread_mutex_unlock(&jobs.mutex);
+}
+
+void jobs_poll()
+{
+    static std::vector<job_t> done;
+
+    // callbacks run unlocked, they may submit more jobs
+    pthread_mutex_lock(&jobs.mutex);
+    done.swap(jobs.done);
+    pthread_mutex_unlock(&jobs.mutex);
+
+    for (int i = 0; i < (int)done.size(); i++)
+    {
+        if (done[i].done)
+        {
+            done[i].done(done[i].user_data);
+        }
+    }
+
+    pthread_mutex_lock(&jobs.mutex);
+    jobs.pending_count -= done.size();
+    pthread_mutex_unlock(&jobs.mutex);
+
+    done.clear();
+}
+
+void jobs_finish()
+{
+    pthread_mutex_lock(&jobs.mutex);
+    while (jobs.pending_count > 0)
+    {
+        while (jobs.done.empty())
+        {
+            pthread_cond_wait(&jobs.finished, &jobs.mutex);
+        }
+        pthread_mutex_unlock(&jobs.mutex);
+
+        jobs_poll();
+
+        pthread_mutex_lock(&jobs.mutex);
+    }
+    pthread_mutex_unlock(&jobs.mutex);
+}
+
+static void run_loop_indices(int generation)
+{
+    pthread_mutex_lock(&jobs.mutex);
+    while (jobs.loop.generation == generation && jobs.loop.next < jobs.loop.count)
+    {
+        int index = jobs.loop.next++;
+        pthread_mutex_unlock(&jobs.mutex);
+
+        // the loop can't end before this index is finished, so work and
+        // user_data stay put
+        jobs.loop.work(index, jobs.loop.user_data);
+
+        pthread_mutex_lock(&jobs.mutex);
+        jobs.loop.finished++;
+        if (jobs.loop.finished == jobs.loop.count)
+        {
+            pthread_cond_broadcast(&jobs.finished);
+        }
+    }
+    pthread_mutex_unlock(&jobs.mutex);
+}
+
+static void loop_work(void *user_data)
+{
+    run_loop_indices((int)(intptr_t)user_data);
+}
+
+void jobs_run(int count, void (*work)(int index, void *user_data), void *user_data)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&jobs.mutex);
+    int generation = ++jobs.loop.generation;
+    jobs.loop.count = count;
+    jobs.loop.next = 0;
+    jobs.loop.finished = 0;
+    jobs.loop.work = work;
+    jobs.loop.user_data = user_data;
+    pthread_mutex_unlock(&jobs.mutex);
+
+    // workers busy with longer jobs just join late, or find nothing left
+    int helper_count = count - 1 < jobs.worker_count ? count - 1 : jobs.worker_count;
+    for (int i = 0; i < helper_count; i++)
+    {
+        jobs_submit(loop_work, NULL, (void *)(intptr_t)generation);
+    }
+    run_loop_indices(generation);
+
+    pthread_mutex_lock(&jobs.mutex);
+    while (jobs.loop.finished < jobs.loop.count)
+    {
+        pthread_cond_wait(&jobs.finished, &jobs.mutex);
+    }
+    pthread_mutex_unlock(&jobs.mutex);
+}
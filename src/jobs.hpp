@@ -0,0 +1,17 @@
+#ifndef _JOBS_HPP
+#define _JOBS_HPP
+
+// small pool of worker threads for work that doesn't touch gl. work runs on
+// a worker, done runs on the main thread from jobs_poll once work returned
+void jobs_init(int worker_count);
+void jobs_submit(void (*work)(void *user_data), void (*done)(void *user_data), void *user_data);
+// runs the done callbacks of the finished jobs
+void jobs_poll();
+// blocks until every job submitted so far is done, callbacks included
+void jobs_finish();
+// calls work for every index below count, spread over the workers and the
+// calling thread, and returns once all calls have returned. unlike
+// jobs_finish it doesn't wait for other jobs. main thread only
+void jobs_run(int count, void (*work)(int index, void *user_data), void *user_data);
+
+#endif // _JOBS_HPP
@@ -0,0 +1,199 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+#ifdef _OSX
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "lightgrid.hpp"
+
+#define CLUSTER_COUNT (LIGHTGRID_TILES_X * LIGHTGRID_TILES_Y * LIGHTGRID_SLICES)
+#define MAX_INDICES (LIGHTGRID_INDEX_TEXTURE_WIDTH * LIGHTGRID_INDEX_TEXTURE_HEIGHT)
+
+struct cluster_range_t
+{
+    int low[3];
+    int high[3];
+};
+
+static int clamp_int(int v, int low, int high)
+{
+    return v < low ? low : (v > high ? high : v);
+}
+
+static int tile_of_ndc(float ndc, int tile_count)
+{
+    return clamp_int((int)floorf((0.5f * ndc + 0.5f) * tile_count), 0, tile_count - 1);
+}
+
+static int slice_of_depth(float depth, float near, float far)
+{
+    return clamp_int((int)floorf(logf(depth / near) / logf(far / near) * LIGHTGRID_SLICES), 0, LIGHTGRID_SLICES - 1);
+}
+
+// conservative cluster range of a view space sphere, false if it is outside the frustum
+static bool cluster_range(const lightgrid_light_t &light, float sx, float sy, float near, float far, cluster_range_t *range)
+{
+    const vec3_t<> &c = light.position;
+    float r = light.radius;
+
+    float d0 = -c.z - r;
+    float d1 = -c.z + r;
+    if (d1 < near || d0 > far)
+    {
+        return false;
+    }
+    d0 = fmaxf(d0, near);
+    d1 = fminf(d1, far);
+
+    // the extremes of x / depth are found at the nearest depth on the far
+    // side of the axis and at the furthest depth on the near side
+    float ndc_low[2];
+    float ndc_high[2];
+    float scales[2] = { sx, sy };
+    for (int i = 0; i < 2; i++)
+    {
+        float low = c.c[i] - r;
+        float high = c.c[i] + r;
+        ndc_low[i] = scales[i] * low / (low < 0.0f ? d0 : d1);
+        ndc_high[i] = scales[i] * high / (high > 0.0f ? d0 : d1);
+        if (ndc_high[i] < -1.0f || ndc_low[i] > 1.0f)
+        {
+            return false;
+        }
+    }
+
+    range->low[0] = tile_of_ndc(ndc_low[0], LIGHTGRID_TILES_X);
+    range->high[0] = tile_of_ndc(ndc_high[0], LIGHTGRID_TILES_X);
+    range->low[1] = tile_of_ndc(ndc_low[1], LIGHTGRID_TILES_Y);
+    range->high[1] = tile_of_ndc(ndc_high[1], LIGHTGRID_TILES_Y);
+    range->low[2] = slice_of_depth(d0, near, far);
+    range->high[2] = slice_of_depth(d1, near, far);
+    return true;
+}
+
+static int cluster_index(int x, int y, int z)
+{
+    return x + (y + z * LIGHTGRID_TILES_Y) * LIGHTGRID_TILES_X;
+}
+
+void lightgrid_init(lightgrid_t *grid)
+{
+    grid->light_texture = renderl_create_data_texture(2, LIGHTGRID_MAX_LIGHTS, GL_RGBA32F);
+    grid->cluster_texture = renderl_create_data_texture(LIGHTGRID_TILES_X * LIGHTGRID_TILES_Y, LIGHTGRID_SLICES, GL_RG32F);
+    grid->index_texture = renderl_create_data_texture(LIGHTGRID_INDEX_TEXTURE_WIDTH, LIGHTGRID_INDEX_TEXTURE_HEIGHT, GL_R32F);
+    grid->near = 0.0f;
+    grid->far = 0.0f;
+    grid->light_count = 0;
+    grid->overflow_count = 0;
+}
+
+void lightgrid_build(lightgrid_t *grid, const mat4_t<> &projection, int light_count, const lightgrid_light_t *lights)
+{
+    static std::vector<cluster_range_t> ranges;
+    static std::vector<unsigned char> in_frustum;
+    static float light_data[LIGHTGRID_MAX_LIGHTS * 8];
+    static float cluster_data[CLUSTER_COUNT * 2];
+    static float index_data[MAX_INDICES];
+    static int counts[CLUSTER_COUNT];
+    static int cursors[CLUSTER_COUNT];
+
+    if (light_count > LIGHTGRID_MAX_LIGHTS)
+    {
+        light_count = LIGHTGRID_MAX_LIGHTS;
+    }
+
+    // perspective parameters back from the matrix
+    float sx = projection.c[0];
+    float sy = projection.c[5];
+    float near = projection.c[14] / (projection.c[10] - 1.0f);
+    float far = projection.c[14] / (projection.c[10] + 1.0f);
+
+    ranges.resize(light_count);
+    in_frustum.resize(light_count);
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < light_count; i++)
+    {
+        const lightgrid_light_t &light = lights[i];
+        light_data[i * 8 + 0] = light.position.x;
+        light_data[i * 8 + 1] = light.position.y;
+        light_data[i * 8 + 2] = light.position.z;
+        light_data[i * 8 + 3] = light.radius;
+        light_data[i * 8 + 4] = light.color.x;
+        light_data[i * 8 + 5] = light.color.y;
+        light_data[i * 8 + 6] = light.color.z;
+        light_data[i * 8 + 7] = 0.0f;
+
+        in_frustum[i] = cluster_range(light, sx, sy, near, far, &ranges[i]);
+        if (!in_frustum[i])
+        {
+            continue;
+        }
+
+        const cluster_range_t &r = ranges[i];
+        for (int z = r.low[2]; z <= r.high[2]; z++)
+        {
+            for (int y = r.low[1]; y <= r.high[1]; y++)
+            {
+                for (int x = r.low[0]; x <= r.high[0]; x++)
+                {
+                    counts[cluster_index(x, y, z)]++;
+                }
+            }
+        }
+    }
+
+    // lay the per cluster lists out back to back, clipping at the texture size
+    int offset = 0;
+    grid->overflow_count = 0;
+    for (int i = 0; i < CLUSTER_COUNT; i++)
+    {
+        int count = counts[i];
+        if (offset + count > MAX_INDICES)
+        {
+            grid->overflow_count += offset + count - MAX_INDICES;
+            count = MAX_INDICES - offset;
+        }
+        cluster_data[i * 2 + 0] = offset;
+        cluster_data[i * 2 + 1] = count;
+        cursors[i] = offset;
+        counts[i] = count;
+        offset += count;
+    }
+
+    for (int i = 0; i < light_count; i++)
+    {
+        if (!in_frustum[i])
+        {
+            continue;
+        }
+
+        const cluster_range_t &r = ranges[i];
+        for (int z = r.low[2]; z <= r.high[2]; z++)
+        {
+            for (int y = r.low[1]; y <= r.high[1]; y++)
+            {
+                for (int x = r.low[0]; x <= r.high[0]; x++)
+                {
+                    int cluster = cluster_index(x, y, z);
+                    if (cursors[cluster] < cluster_data[cluster * 2 + 0] + counts[cluster])
+                    {
+                        index_data[cursors[cluster]++] = i;
+                    }
+                }
+            }
+        }
+    }
+
+    renderl_update_texture(grid->light_texture, GL_RGBA, GL_FLOAT, light_data);
+    renderl_update_texture(grid->cluster_texture, GL_RG, GL_FLOAT, cluster_data);
+    renderl_update_texture(grid->index_texture, GL_RED, GL_FLOAT, index_data);
+
+    grid->near = near;
+    grid->far = far;
+    grid->light_count = light_count;
+}
@@ -0,0 +1,43 @@
+#ifndef _LIGHTGRID_HPP
+#define _LIGHTGRID_HPP
+
+#include "renderl.hpp"
+#include "math.hpp"
+
+// the view frustum is cut into screen tiles and exponential depth slices,
+// each cluster lists the lights reaching into it
+#define LIGHTGRID_TILES_X 16
+#define LIGHTGRID_TILES_Y 9
+#define LIGHTGRID_SLICES 24
+#define LIGHTGRID_MAX_LIGHTS 1024
+#define LIGHTGRID_INDEX_TEXTURE_WIDTH 1024
+#define LIGHTGRID_INDEX_TEXTURE_HEIGHT 64
+
+// view space point light
+struct lightgrid_light_t
+{
+    vec3_t<> position;
+    float radius;
+    vec3_t<> color;
+};
+
+struct lightgrid_t
+{
+    // two texels per light, (position, radius) and (color, 0)
+    renderl_texture_t light_texture;
+    // one texel per cluster, (first index, light count)
+    renderl_texture_t cluster_texture;
+    // light indices of all clusters back to back
+    renderl_texture_t index_texture;
+
+    float near;
+    float far;
+    int light_count;
+    // lights dropped from clusters because the index texture was full
+    int overflow_count;
+};
+
+void lightgrid_init(lightgrid_t *grid);
+void lightgrid_build(lightgrid_t *grid, const mat4_t<> &projection, int light_count, const lightgrid_light_t *lights);
+
+#endif // _LIGHTGRID_HPP
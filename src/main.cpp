@@ -26,12 +26,16 @@
 #include "components.hpp"
 #include "entity_system.hpp"
 #include "heightmap.hpp"
+#include "terrain.hpp"
 
 extern int window_width;
 extern int window_height;
 extern float window_aspect;
 extern bool running;
 extern bool window_fullscreen;
+extern bool headless;
+extern int frame_limit;
+extern const char *frame_dump_pattern;
 
 #define BLEND(a, b, t) ((1.0f - t) * a + t * b)
 
@@ -79,16 +83,7 @@ renderm_mesh_t create_water_mesh(int width, int height)
         indices[i] = i;
     }
 
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, sizeof(positions));
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, sizeof(normals));
-    res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    res.tex_coord_buffer.handle = 0;
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_BYTE, indices, sizeof(indices));
-    res.index_count = 4;
-    res.primitive_type = GL_TRIANGLE_STRIP;
-
-    return res;
+    return renderm_create_mesh(4, (const vec3_t<> *)positions, (const vec3_t<> *)normals, (const vec3_t<> *)tangents, NULL, GL_UNSIGNED_BYTE, indices, 4, GL_TRIANGLE_STRIP, RENDERM_PACK_NORMALS);
 }
 
 
@@ -132,16 +127,7 @@ renderm_mesh_t create_portal_mesh()
         indices[i] = i;
     }
 
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, sizeof(positions));
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, sizeof(normals));
-    res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_BYTE, indices, sizeof(indices));
-    res.index_count = 4;
-    res.primitive_type = GL_TRIANGLE_STRIP;
-
-    return res;
+    return renderm_create_mesh(4, (const vec3_t<> *)positions, (const vec3_t<> *)normals, (const vec3_t<> *)tangents, (const vec2_t<> *)tex_coords, GL_UNSIGNED_BYTE, indices, 4, GL_TRIANGLE_STRIP, RENDERM_PACK_NORMALS | RENDERM_PACK_TEX_COORDS);
 }
 
 renderm_mesh_t create_cube_mesh()
@@ -369,16 +355,9 @@ renderm_mesh_t create_cube_mesh()
         indices[i] = i;
     }
 
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, sizeof(positions));
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, sizeof(normals));
-    res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_BYTE, indices, sizeof(indices));
-    res.index_count = index_count;
-    res.primitive_type = GL_TRIANGLE_STRIP;
-
-    return res;
+    // positions stay unquantized, the skydome uses them as directions
+    int vertex_count = sizeof(positions) / sizeof(vec3_t<>);
+    return renderm_create_mesh(vertex_count, (const vec3_t<> *)positions, (const vec3_t<> *)normals, (const vec3_t<> *)tangents, (const vec2_t<> *)tex_coords, GL_UNSIGNED_BYTE, indices, index_count, GL_TRIANGLE_STRIP, RENDERM_PACK_NORMALS | RENDERM_PACK_TEX_COORDS);
 }
 
 struct triangle_t
@@ -1189,16 +1168,7 @@ renderm_mesh_t create_field_mesh(float (*field)(vec3_t<> p), float isolevel, vec
         }
     }
 
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, 3 * 3 * sizeof(float) * total_triangle_count);
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, 3 * 3 * sizeof(float) * total_triangle_count);
-    res.tangent_buffer.handle = 0;
-    res.tex_coord_buffer.handle = 0;
-    //res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    //res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_INT, indices, 3 * sizeof(unsigned int) * total_triangle_count);
-    res.index_count = 3 * total_triangle_count;
-    res.primitive_type = GL_TRIANGLES;
+    renderm_mesh_t res = renderm_create_mesh(3 * total_triangle_count, positions, normals, NULL, NULL, GL_UNSIGNED_INT, indices, 3 * total_triangle_count, GL_TRIANGLES, RENDERM_PACK_NORMALS);
 
     delete[] triangles;
     delete[] positions;
@@ -1208,390 +1178,6 @@ renderm_mesh_t create_field_mesh(float (*field)(vec3_t<> p), float isolevel, vec
     return res;
 }
 
-renderm_mesh_t create_heightmap_mesh(const heightmap_t &heightmap)
-{
-    vec3_t<> diff = heightmap.xyz_high - heightmap.xyz_low;
-
-    vec3_t<> *points = new vec3_t<>[heightmap.width * heightmap.height];
-    vec3_t<> *normals = new vec3_t<>[heightmap.width * heightmap.height];
-    int index_count = 2 * 3 * (heightmap.width - 1) * (heightmap.height - 1);
-    unsigned int *indices = new unsigned int[index_count];
-    int ip = 0;
-
-    // set all points and reset normals
-    for (int y = 0; y < heightmap.height; y++)
-    {
-        for (int x = 0; x < heightmap.width; x++)
-        {
-            int index = x + y * heightmap.width;
-            points[index].x = heightmap.xyz_low.x + (((float)x) / (heightmap.width - 1)) * diff.x;
-            points[index].y = heightmap.xyz_low.y + heightmap.heights[index] * diff.y;
-            points[index].z = heightmap.xyz_low.z + (((float)y) / (heightmap.height - 1)) * diff.z;
-
-            normals[index] = vec3_t<>(0.0f, 0.0f, 0.0f);
-        }
-    }
-
-    // loop through all cells (quadratic areas)
-    for (int col = 0; col < heightmap.height - 1; col++)
-    {
-        for (int row = 0; row < heightmap.width - 1; row++)
-        {
-            // each such cell has two triangles...
-            int index_a, index_b, index_c;
-            vec3_t<> *a, *b, *c;
-            vec3_t<> *na, *nb, *nc;
-            vec3_t<> ab, ac;
-            vec3_t<> normal;
-
-
-            // select the point/normal indices for the first triangle
-            index_a = row + col * heightmap.width;
-            index_b = row + (col + 1) * heightmap.width;
-            index_c = (row + 1) + col * heightmap.width;
-
-            a = &points[index_a];
-            b = &points[index_b];
-            c = &points[index_c];
-
-            na = &normals[index_a];
-            nb = &normals[index_b];
-            nc = &normals[index_c];
-
-            ab = *b - *a;
-            ac = *c - *a;
-            normal = ab.cross(ac).normalized();
-
-            *na += normal;
-            *nb += normal;
-            *nc += normal;
-
-            indices[ip++] = index_a;
-            indices[ip++] = index_b;
-            indices[ip++] = index_c;
-
-
-            // select the point/normal indices for the second triangle
-            index_a = (row + 1) + col * heightmap.width;
-            index_b = row + (col + 1) * heightmap.width;
-            index_c = (row + 1) + (col + 1) * heightmap.width;
-
-            a = &points[index_a];
-            b = &points[index_b];
-            c = &points[index_c];
-
-            na = &normals[index_a];
-            nb = &normals[index_b];
-            nc = &normals[index_c];
-
-            ab = *b - *a;
-            ac = *c - *a;
-            normal = ab.cross(ac).normalized();
-
-            *na += normal;
-            *nb += normal;
-            *nc += normal;
-
-            indices[ip++] = index_a;
-            indices[ip++] = index_b;
-            indices[ip++] = index_c;
-        }
-    }
-
-    assert(ip == index_count);
-
-    // normalize all normals
-    for (int i = 0; i < heightmap.width * heightmap.height; i++)
-    {
-        points[i].y = 0.0f;
-        normals[i] = normals[i].normalized();
-    }
-
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, points, 3 * sizeof(float) * heightmap.width * heightmap.height);
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, 3 * sizeof(float) * heightmap.width * heightmap.height);
-    res.tangent_buffer.handle = 0;
-    res.tex_coord_buffer.handle = 0;
-    //res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    //res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_INT, indices, sizeof(unsigned int) * index_count);
-    res.index_count = index_count;
-    res.primitive_type = GL_TRIANGLES;
-
-    delete[] points;
-    delete[] normals;
-
-    return res;
-}
-
-renderm_mesh_t create_heightmap_mesh2(const heightmap_t &heightmap)
-{
-    float rwidth = 0.03f;
-
-    int radius_count = 1000;
-    int segment_count = 32;
-
-    int index_count = radius_count * segment_count * 6;
-
-    vec3_t<> *positions = new vec3_t<>[radius_count * segment_count * 6];
-    vec3_t<> *normals = new vec3_t<>[radius_count * segment_count * 6];
-    vec3_t<> *p = positions;
-    vec3_t<> *n = normals;
-
-    unsigned short *indices = new unsigned short[index_count];
-
-    for (int r = 0; r < radius_count; r++)
-    {
-        for (int s = 0; s < segment_count; s++)
-        {
-            float radians0 = 2.0f * M_PI * s / (float)segment_count;
-            float radians1 = 2.0f * M_PI * (s + 1) / (float)segment_count;
-
-            float radius0 = pow(rwidth * r, 2.0f);
-            float radius1 = pow(rwidth * (r + 1), 2.0f);
-
-            float x0 = radius0 * cos(radians0);
-            float x1 = radius1 * cos(radians0);
-            float x2 = radius0 * cos(radians1);
-            float x3 = x2;
-            float x4 = x1;
-            float x5 = radius1 * cos(radians1);
-
-            float z0 = radius0 * sin(-radians0);
-            float z1 = radius1 * sin(-radians0);
-            float z2 = radius0 * sin(-radians1);
-            float z3 = z2;
-            float z4 = z1;
-            float z5 = radius1 * sin(-radians1);
-
-            *p++ = vec3_t<>(x0, 0.0f, z0);
-            *p++ = vec3_t<>(x1, 0.0f, z1);
-            *p++ = vec3_t<>(x2, 0.0f, z2);
-            *p++ = vec3_t<>(x3, 0.0f, z3);
-            *p++ = vec3_t<>(x4, 0.0f, z4);
-            *p++ = vec3_t<>(x5, 0.0f, z5);
-
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-            *n++ = vec3_t<>(0.0f, 1.0f, 0.0f);
-        }
-    }
-
-    for (int i = 0; i < index_count; i++)
-    {
-        indices[i] = i;
-    }
-
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, sizeof(vec3_t<>) * radius_count * segment_count * 6);
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, sizeof(vec3_t<>) * radius_count * segment_count * 6);
-    res.tangent_buffer.handle = 0;
-    res.tex_coord_buffer.handle = 0;
-    //res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    //res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_SHORT, indices, sizeof(unsigned int) * index_count);
-    res.index_count = index_count;
-    res.primitive_type = GL_TRIANGLES;
-
-    delete[] positions;
-    delete[] normals;
-    delete[] indices;
-
-    return res;
-}
-
-renderm_mesh_t create_heightmap_mesh3(const heightmap_t &heightmap)
-{
-    vec3_t<> diff = heightmap.xyz_high - heightmap.xyz_low;
-
-    vec3_t<> *points = new vec3_t<>[heightmap.width * heightmap.height];
-    vec3_t<> *normals = new vec3_t<>[heightmap.width * heightmap.height];
-    int index_count = 2 * 3 * (heightmap.width - 1) * (heightmap.height - 1);
-    unsigned int *indices = new unsigned int[index_count];
-    int ip = 0;
-
-    // set all points and reset normals
-    for (int y = 0; y < heightmap.height; y++)
-    {
-        for (int x = 0; x < heightmap.width; x++)
-        {
-            int index = x + y * heightmap.width;
-            points[index].x = heightmap.xyz_low.x + (((float)x) / (heightmap.width - 1)) * diff.x;
-            points[index].y = heightmap.xyz_low.y + heightmap.heights[index] * diff.y;
-            points[index].z = heightmap.xyz_low.z + (((float)y) / (heightmap.height - 1)) * diff.z;
-
-            normals[index] = vec3_t<>(0.0f, 0.0f, 0.0f);
-        }
-    }
-
-    // loop through all cells (quadratic areas)
-    for (int col = 0; col < heightmap.height - 1; col++)
-    {
-        for (int row = 0; row < heightmap.width - 1; row++)
-        {
-            // each such cell has two triangles...
-            int index_a, index_b, index_c;
-            vec3_t<> *a, *b, *c;
-            vec3_t<> *na, *nb, *nc;
-            vec3_t<> ab, ac;
-            vec3_t<> normal;
-
-
-            // select the point/normal indices for the first triangle
-            index_a = row + col * heightmap.width;
-            index_b = row + (col + 1) * heightmap.width;
-            index_c = (row + 1) + col * heightmap.width;
-
-            a = &points[index_a];
-            b = &points[index_b];
-            c = &points[index_c];
-
-            na = &normals[index_a];
-            nb = &normals[index_b];
-            nc = &normals[index_c];
-
-            ab = *b - *a;
-            ac = *c - *a;
-            normal = ab.cross(ac);//.normalized();
-
-            *na += normal;
-            *nb += normal;
-            *nc += normal;
-
-            indices[ip++] = index_a;
-            indices[ip++] = index_b;
-            indices[ip++] = index_c;
-
-
-            // select the point/normal indices for the second triangle
-            index_a = (row + 1) + col * heightmap.width;
-            index_b = row + (col + 1) * heightmap.width;
-            index_c = (row + 1) + (col + 1) * heightmap.width;
-
-            a = &points[index_a];
-            b = &points[index_b];
-            c = &points[index_c];
-
-            na = &normals[index_a];
-            nb = &normals[index_b];
-            nc = &normals[index_c];
-
-            ab = *b - *a;
-            ac = *c - *a;
-            normal = ab.cross(ac);//.normalized();
-
-            *na += normal;
-            *nb += normal;
-            *nc += normal;
-
-            indices[ip++] = index_a;
-            indices[ip++] = index_b;
-            indices[ip++] = index_c;
-        }
-    }
-
-    assert(ip == index_count);
-
-    // normalize all normals
-    for (int i = 0; i < heightmap.width * heightmap.height; i++)
-    {
-        points[i].y = 0.0f;
-        normals[i] = normals[i].normalized();
-    }
-
-    int middle_x = heightmap.width / 2;
-    int middle_y = heightmap.height / 2;
-
-    int sector_width = heightmap.width / 16;
-    int sector_height = heightmap.height / 16;
-
-    ip = 0;
-
-    for (int sec_y = 0; sec_y < 16; sec_y++)
-    {
-        for (int sec_x = 0; sec_x < 16; sec_x++)
-        {
-            int sec_middle_x = sector_width * sec_x + 64;
-            int sec_middle_y = sector_height * sec_y + 64;
-
-            int bdx = sec_middle_x - middle_x;
-            int bdy = sec_middle_y - middle_y;
-
-            float distance = sqrt(bdx * bdx + bdy * bdy);
-
-            int d = (int)(0.008 * distance);
-            if (d > 10)
-            {
-                d = 10;
-            }
-            int gran = (int)(powf(2, d) + 0.5f);
-            if (gran == 0)
-            {
-                gran = 1;
-            }
-            if (gran > 16)
-            {
-                gran = 16;
-            }
-            //int gran = 16;
-
-            for (int dy = 0; dy < 128; dy += gran)
-            {
-                for (int dx = 0; dx < 128; dx += gran)
-                {
-                    int x0 = sec_x * sector_width + dx;
-                    int x1 = sec_x * sector_width + dx + gran;
-                    int y0 = sec_y * sector_height + dy;
-                    int y1 = sec_y * sector_height + dy + gran;
-
-                    if (x1 >= heightmap.width || y1 >= heightmap.height)
-                    {
-                        continue;
-                    }
-
-                    int index_a = x0 + y0 * heightmap.width;
-                    int index_b = x0 + y1 * heightmap.width;
-                    int index_c = x1 + y0 * heightmap.width;
-
-                    indices[ip++] = index_a;
-                    indices[ip++] = index_b;
-                    indices[ip++] = index_c;
-
-                    index_a = x1 + y0 * heightmap.width;
-                    index_b = x0 + y1 * heightmap.width;
-                    index_c = x1 + y1 * heightmap.width;
-
-                    indices[ip++] = index_a;
-                    indices[ip++] = index_b;
-                    indices[ip++] = index_c;
-                }
-            }
-        }
-    }
-
-    index_count = ip;
-
-    renderm_mesh_t res;
-    res.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, points, 3 * sizeof(float) * heightmap.width * heightmap.height);
-    res.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, 3 * sizeof(float) * heightmap.width * heightmap.height);
-    res.tangent_buffer.handle = 0;
-    res.tex_coord_buffer.handle = 0;
-    //res.tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangents, sizeof(tangents));
-    //res.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-    res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_INT, indices, sizeof(unsigned int) * index_count);
-    res.index_count = index_count;
-    res.primitive_type = GL_TRIANGLES;
-
-    delete[] points;
-    delete[] normals;
-    delete[] indices;
-
-    return res;
-}
-
 renderl_texture_t create_heightmap_normal_map(const heightmap_t &heightmap)
 {
     vec3_t<> diff = heightmap.xyz_high - heightmap.xyz_low;
@@ -1697,24 +1283,12 @@ renderl_texture_t create_heightmap_normal_map(const heightmap_t &heightmap)
     return res;
 }
 
+// single channel, the terrain vertex shader displaces its patches with it
 renderl_texture_t create_heightmap_texture(const heightmap_t &heightmap)
 {
-    float *data = new float[heightmap.width * heightmap.height * 3];
-
-    for (int y = 0; y < heightmap.height; y++)
-    {
-        for (int x = 0; x < heightmap.width; x++)
-        {
-            int index = x + y * heightmap.width;
-            data[index * 3 + 0] = heightmap.heights[index];
-            data[index * 3 + 1] = heightmap.heights[index];
-            data[index * 3 + 2] = heightmap.heights[index];
-        }
-    }
-
-    renderl_texture_t res = renderl_upload_texture_adv(heightmap.width, heightmap.height, GL_RGBA16F, GL_RGB, GL_FLOAT, data);
-
-    delete[] data;
+    renderl_texture_t res = renderl_create_data_texture(heightmap.width, heightmap.height, GL_R16F);
+    renderl_update_texture(res, GL_RED, GL_FLOAT, heightmap.heights);
+    renderl_set_texture_filter(res, GL_LINEAR);
 
     return res;
 }
@@ -1756,9 +1330,25 @@ int main(int argc, char *argv[])
 		{
 			window_fullscreen = true;
 		}
+		else if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			frame_limit = atoi(argv[i + 1]);
+			i += 1;
+		}
+		else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+		{
+			frame_dump_pattern = argv[i + 1];
+			i += 1;
+		}
 		else if (strcmp(argv[i], "--help") == 0)
 		{
-            printf("usage: %s [--fullscreen] [--width <w>] [--height <h>]\n", argv[0]);
+            printf("usage: %s [--fullscreen] [--width <w>] [--height <h>] [--headless] [--frames <n>] [--dump <pattern>]\n", argv[0]);
+            printf("--headless draws offscreen without a window or display, --dump writes\n");
+            printf("every frame to a png named by a printf pattern like frame%%04d.png\n");
 			return 0;
 		}
         else
@@ -1778,25 +1368,26 @@ int main(int argc, char *argv[])
     void rendering_emit_fullscreen_quad_batch(const renderl_texture_t &texture);
 
     const renderl_texture_t *loading_texture = resource_upload_texture("data/images/loading.png");
+    resource_finish_textures();
     rendering_emit_fullscreen_quad_batch(*loading_texture);
-    glfwSwapBuffers();
+    if (!headless)
+    {
+        glfwSwapBuffers();
+    }
 
 
-    const renderl_texture_t *grass_texture = resource_upload_texture("data/images/grass.png");
-    const renderl_texture_t *dirt_texture = resource_upload_texture("data/images/dirt.png");
-    const renderl_texture_t *sand_texture = resource_upload_texture("data/images/sand.png");
+    const char *splat_layer_filenames[] = { "data/images/grass.png", "data/images/dirt.png", "data/images/sand.png" };
+    const renderl_texture_t *splat_layers = resource_upload_texture_array(3, splat_layer_filenames);
 
     const renderl_texture_t *crate_diffuse = resource_upload_texture("data/images/crate_diffuse.png");
     const renderl_texture_t *crate_normal_map = resource_upload_texture("data/images/crate_normal.png");
 
     heightmap_t heightmap = create_heightmap(512, 512, vec3_t<>(-100.0f, -10.0f, -100.0f), vec3_t<>( 100.0f, 15.0f,  100.0f));
-    renderm_mesh_t heightmap_mesh = create_heightmap_mesh3(heightmap);
     renderl_texture_t heightmap_texture = create_heightmap_texture(heightmap);
     renderl_texture_t heightmap_normal_map = create_heightmap_normal_map(heightmap);
 
 
     simple_material_t simple_material;
-    simple_material.program = resource_upload_program(2, "data/shaders/simple_material.vert", "data/shaders/simple_material.frag");
     simple_material.ambient = vec3_t<>(1.0f, 1.0f, 1.0f);
     simple_material.diffuse = vec3_t<>(1.0f, 1.0f, 1.0f);
     simple_material.specular = vec3_t<>(1.0f, 1.0f, 1.0f);
@@ -1805,11 +1396,11 @@ int main(int argc, char *argv[])
     simple_material.diffuse_texture = crate_diffuse;
     simple_material.specular_texture = NULL;
     simple_material.normal_texture = crate_normal_map;
+    simple_material.program = resource_upload_program_variant(simple_material.features(), 2, "data/shaders/simple_material.vert", "data/shaders/simple_material.frag");
+    simple_material.upload_uniforms();
 
     terrain_material_t terrain_material;
-    terrain_material.grass_texture = grass_texture;
-    terrain_material.dirt_texture = dirt_texture;
-    terrain_material.sand_texture = sand_texture;
+    terrain_material.splat_layers = splat_layers;
     terrain_material.heightmap_texture = &heightmap_texture;
     terrain_material.heightmap_normal_map = &heightmap_normal_map;
     terrain_material.xyz_low = heightmap.xyz_low;
@@ -1890,33 +1481,32 @@ int main(int argc, char *argv[])
         };
         int index_count = sizeof(indices)/sizeof(indices[0]);
 
-        grass_straws_mesh.position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, positions, sizeof(positions));
-        grass_straws_mesh.normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normals, sizeof(normals));
-        grass_straws_mesh.tangent_buffer.handle = 0;
-        grass_straws_mesh.tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, tex_coords, sizeof(tex_coords));
-        grass_straws_mesh.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_BYTE, indices, sizeof(indices));
-        grass_straws_mesh.index_count = index_count;
-        grass_straws_mesh.primitive_type = GL_TRIANGLES;
+        int vertex_count = sizeof(positions) / sizeof(vec3_t<>);
+        grass_straws_mesh = renderm_create_mesh(vertex_count, (const vec3_t<> *)positions, (const vec3_t<> *)normals, NULL, (const vec2_t<> *)tex_coords, GL_UNSIGNED_BYTE, indices, index_count, GL_TRIANGLES, RENDERM_PACK_NORMALS | RENDERM_PACK_TEX_COORDS);
 
         grass_straws_texture = resource_upload_texture("data/images/grass_straws.png");
 
         grass_straws_material.program = resource_upload_program(3, "data/shaders/noise4D.glsl", "data/shaders/grass_straws.vert", "data/shaders/grass_straws.frag");
         grass_straws_material.diffuse_texture = grass_straws_texture;
 
+        // room for the wind sway in grass_straws.vert
+        grass_straws_mesh.bounds_radius += 1.0f;
         grass_straws_model = renderh_simple_model(&grass_straws_mesh, &grass_straws_material);
     }
 
     renderm_mesh_t cube_mesh = create_cube_mesh();
     renderh_model_t cube_model = renderh_simple_model(&cube_mesh, &simple_material);
-    renderh_model_t terrain_model = renderh_simple_model(&heightmap_mesh, &terrain_material);
+    terrain_t terrain;
+    terrain_init(&terrain, heightmap, &terrain_material);
+    engine.render_system.bake_terrain_noise(&terrain_material);
 
 
     {
         position_component_t *pos = new position_component_t;
         pos->xyz = vec3_t<>(0.0f, 0.0f, 0.0f);
 
-        render_model_component_t *model = new render_model_component_t;
-        model->model = &terrain_model;
+        render_terrain_component_t *render_terrain = new render_terrain_component_t;
+        render_terrain->terrain = &terrain;
 
         physics_component_t *physics = new physics_component_t;
         physics->rigid_body = engine_t::instance->physics_system.create_rigid_heightmap(heightmap);
@@ -1924,7 +1514,7 @@ int main(int argc, char *argv[])
 
         meta_entity_t me = meta_entity_t("terrain");
         me.add_component(pos);
-        me.add_component(model);
+        me.add_component(render_terrain);
         me.add_component(physics);
     }
 
@@ -2007,22 +1597,24 @@ int main(int argc, char *argv[])
     }
 
 
-    for (int z = 0; z < 30; z++)
+    // one entity for the whole field, every straw is an instance
     {
-        for (int x = 0; x < 30; x++)
+        render_model_instances_component_t *instances = new render_model_instances_component_t;
+        instances->model = &grass_straws_model;
+        for (int z = 0; z < 320; z++)
         {
-            position_component_t *pos = new position_component_t;
-            pos->xyz = vec3_t<>(0.5f * x - 20, 0.0f, 0.5f * z - 15);
-            pos->xyz.x += 0.5f * noise(pos->xyz);
-            pos->xyz.z += 0.5f * noise(pos->xyz + vec3_t<>(4.0f, 9.0f, 3.0f));
-            pos->xyz.y = sample_heightmap(heightmap, pos->xyz.x, pos->xyz.z);
-            render_model_component_t *model = new render_model_component_t;
-            model->model = &grass_straws_model;
-
-            //meta_entity_t me = meta_entity_t("grass");
-            //me.add_component(pos);
-            //me.add_component(model);
+            for (int x = 0; x < 320; x++)
+            {
+                vec3_t<> p = vec3_t<>(0.5f * x - 80, 0.0f, 0.5f * z - 80);
+                p.x += 0.5f * noise(p);
+                p.z += 0.5f * noise(p + vec3_t<>(4.0f, 9.0f, 3.0f));
+                p.y = sample_heightmap(heightmap, p.x, p.z);
+                instances->model_matrices.push_back(mat4_t<>::translation(p));
+            }
         }
+
+        meta_entity_t me = meta_entity_t("grass");
+        me.add_component(instances);
     }
 
     // add a sun!
@@ -2031,8 +1623,18 @@ int main(int argc, char *argv[])
         light->direction = vec3_t<>(-1.0f, -0.5f, 0.0f).normalized();
         light->color = vec3_t<>(1.0f, 1.0f, 1.0f);
 
+        cascaded_shadow_caster_component_t *shadow = new cascaded_shadow_caster_component_t;
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        {
+            shadow->cascades[i].tile = -1;
+            shadow->cascades[i].valid = false;
+            shadow->cascades[i].dirty = false;
+        }
+        shadow->max_distance = 120.0f;
+
         meta_entity_t me = meta_entity_t("sun");
         me.add_component(light);
+        me.add_component(shadow);
         me.add_component(new sun_component_t);
     }
 
@@ -2074,6 +1676,7 @@ int main(int argc, char *argv[])
 
         point_light_component_t *light = new point_light_component_t;
         light->color = vec3_t<>(1.0f, 1.0f, 1.0f);
+        light->radius = 30.0f;
 
         physics_component_t *physics = new physics_component_t;
         physics->rigid_body = engine_t::instance->physics_system.create_rigid_sphere(0.5f, 0);
@@ -2099,6 +1702,7 @@ int main(int argc, char *argv[])
 
         spot_light_component_t *light = new spot_light_component_t;
         light->color = vec3_t<>(1.0f, 1.0f, 1.0f);
+        light->radius = 40.0f;
 
         lens_component_t *lens = new lens_component_t;
         lens->fov = 45.0f * M_PI / 180.0f;
@@ -2107,9 +1711,9 @@ int main(int argc, char *argv[])
         lens->far = 100.0f;
 
         shadow_caster_component_t *shadow = new shadow_caster_component_t;
-        renderl_frame_buffer_t *fbo = new renderl_frame_buffer_t;
-        *fbo = renderl_create_frame_buffer(512, 512, 1, GL_RGBA, false);
-        shadow->shadow_fbo = fbo;
+        shadow->shadow_map.tile = -1;
+        shadow->shadow_map.valid = false;
+        shadow->shadow_map.dirty = false;
 
         meta_entity_t me("spotlight");
         me.add_component(pos);
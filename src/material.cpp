@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 
 #include "material.hpp"
 #include "renderm.hpp"
@@ -8,64 +9,91 @@
 extern double time_now;
 extern bool use_normal_mapping;
 
-void simple_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
+const char *simple_material_t::features() const
 {
-    // investigate why this needs to be static??
-    static struct
+    static char features[64];
+    features[0] = '\0';
+    if (this->ambient_texture)
+    {
+        strcat(features, "AMBIENT_MAP ");
+    }
+    if (this->diffuse_texture)
+    {
+        strcat(features, "DIFFUSE_MAP ");
+    }
+    if (this->specular_texture)
+    {
+        strcat(features, "SPECULAR_MAP ");
+    }
+    if (this->normal_texture)
+    {
+        strcat(features, "NORMAL_MAP ");
+    }
+    return features;
+}
+
+// camera and time, the same for every material. one buffer will do, it is
+// refilled when a batch for another eye is pushed
+static renderl_cached_uniform_buffer_t frame_uniforms;
+
+// the blocks only have to live until the batch is pushed or recorded, once
+// per thread since batches are filled on the workers too
+static void fill_draw_parameters(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh)
+{
+    static thread_local struct
     {
-        mat4_t<> projection;
-        mat4_t<> view;
         mat4_t<> model;
     } vertex_parameters;
-
-    static struct
+    static thread_local struct
     {
         mat4_t<> projection;
         mat4_t<> view;
-        mat4_t<> model;
+        float time;
+        float dummy0[3];
+    } frame_parameters;
+
+    vertex_parameters.model = model_matrix * renderm_mesh_dequantization(mesh);
+
+    frame_parameters.projection = eye.projection;
+    frame_parameters.view = eye.view;
+    frame_parameters.time = (float)time_now;
+    frame_parameters.dummy0[0] = frame_parameters.dummy0[1] = frame_parameters.dummy0[2] = 0.0f;
+
+    batch->vertex_parameters = &vertex_parameters;
+    batch->vertex_parameters_size = sizeof(vertex_parameters);
+    batch->fragment_parameters = NULL;
+    batch->fragment_parameters_size = 0;
+    batch->frame_uniforms = &frame_uniforms;
+    batch->frame_parameters = &frame_parameters;
+    batch->frame_parameters_size = sizeof(frame_parameters);
+}
+
+void simple_material_t::upload_uniforms()
+{
+    struct
+    {
         vec3_t<> ambient;
         float dummy0;
         vec3_t<> diffuse;
         float dummy1;
         vec3_t<> specular;
         float shininess;
-        int has_ambient_map;
-        int has_diffuse_map;
-        int has_specular_map;
-        int has_normal_map;
-        vec2_t<> normal_map_dimensions;
-    } fragment_parameters;
+    } material_parameters;
+
+    memset(&material_parameters, 0, sizeof(material_parameters));
+    material_parameters.ambient = this->ambient;
+    material_parameters.diffuse = this->diffuse;
+    material_parameters.specular = this->specular;
+    material_parameters.shininess = this->shininess;
+    renderm_upload_material_uniforms(this, &material_parameters, sizeof(material_parameters));
+}
 
+void simple_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
+{
     batch->program = this->program;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-
-    fragment_parameters.projection = eye.projection;
-    fragment_parameters.view = eye.view;
-    fragment_parameters.model = model_matrix;
-    fragment_parameters.ambient = this->ambient;
-    fragment_parameters.dummy0 = 0.0f;
-    fragment_parameters.diffuse = this->diffuse;
-    fragment_parameters.dummy1 = 0.0f;
-    fragment_parameters.specular = this->specular;
-    //fragment_parameters.dummy2 = 0.0f;
-    fragment_parameters.shininess = this->shininess;
-    fragment_parameters.has_ambient_map = this->ambient_texture != NULL;
-    fragment_parameters.has_diffuse_map = this->diffuse_texture != NULL;
-    fragment_parameters.has_specular_map = this->specular_texture != NULL;
-    fragment_parameters.has_normal_map = this->normal_texture != NULL;
-    if (this->normal_texture)
-    {
-        fragment_parameters.normal_map_dimensions.x = this->normal_texture->width;
-        fragment_parameters.normal_map_dimensions.y = this->normal_texture->height;
-    }
-
-    batch->vertex_parameters = &vertex_parameters;
-    batch->vertex_parameters_size = sizeof(vertex_parameters);
-    batch->fragment_parameters = &fragment_parameters;
-    batch->fragment_parameters_size = sizeof(fragment_parameters);
+    fill_draw_parameters(batch, eye, model_matrix, mesh);
+    batch->material_uniforms = &this->uniform_buffer;
 
     int next_index = 0;
     if (this->ambient_texture)
@@ -86,11 +114,8 @@ void simple_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &
     }
     batch->texture_count = next_index;
 
-    batch->vertex_buffer_count = 4;
-    batch->vertex_buffers[0] = &mesh.position_buffer;
-    batch->vertex_buffers[1] = &mesh.normal_buffer;
-    batch->vertex_buffers[2] = &mesh.tangent_buffer;
-    batch->vertex_buffers[3] = &mesh.tex_coord_buffer;
+    batch->vertex_format = &mesh.vertex_format;
+    batch->vertex_buffer = &mesh.vertex_buffer;
     batch->index_buffer = &mesh.index_buffer;
     batch->index_count = mesh.index_count;
     batch->primitive_type = mesh.primitive_type;
@@ -102,45 +127,15 @@ void simple_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &
 
 void grass_straws_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
 {
-    // investigate why this needs to be static??
-    static struct
-    {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
-        float time;
-    } vertex_parameters;
-
-    static struct
-    {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
-    } fragment_parameters;
-
     batch->program = this->program;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-    vertex_parameters.time = time_now;
-
-    fragment_parameters.projection = eye.projection;
-    fragment_parameters.view = eye.view;
-    fragment_parameters.model = model_matrix;
-
-    batch->vertex_parameters = &vertex_parameters;
-    batch->vertex_parameters_size = sizeof(vertex_parameters);
-    batch->fragment_parameters = &fragment_parameters;
-    batch->fragment_parameters_size = sizeof(fragment_parameters);
+    fill_draw_parameters(batch, eye, model_matrix, mesh);
 
     batch->texture_count = 1;
     batch->textures[0] = this->diffuse_texture;
 
-    batch->vertex_buffer_count = 3;
-    batch->vertex_buffers[0] = &mesh.position_buffer;
-    batch->vertex_buffers[1] = &mesh.normal_buffer;
-    batch->vertex_buffers[2] = &mesh.tex_coord_buffer;
+    batch->vertex_format = &mesh.vertex_format;
+    batch->vertex_buffer = &mesh.vertex_buffer;
     batch->index_buffer = &mesh.index_buffer;
     batch->index_count = mesh.index_count;
     batch->primitive_type = mesh.primitive_type;
@@ -150,60 +145,71 @@ void grass_straws_material_t::fill_batch(renderl_batch_t *batch, const renderm_e
     batch->use_blending = false;
 }
 
-void terrain_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
+void terrain_material_t::upload_uniforms()
 {
-    // investigate why this needs to be static??
-    static struct
+    // read by both stages
+    struct
     {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
         vec3_t<> xyz_low;
         float dummy0;
         vec3_t<> xyz_high;
-    } vertex_parameters;
+        float lod_range_ratio;
+        float grid_size;
+        float dummy1;
+        vec2_t<> heightmap_size;
+        vec3_t<> diffuse;
+        float dummy2;
+        vec3_t<> specular;
+        float shininess;
+        int use_baked_noise;
+        float dummy3[3];
+    } material_parameters;
+
+    memset(&material_parameters, 0, sizeof(material_parameters));
+    material_parameters.xyz_low = this->xyz_low;
+    material_parameters.xyz_high = this->xyz_high;
+    material_parameters.lod_range_ratio = this->lod_range_ratio;
+    material_parameters.grid_size = this->grid_size;
+    material_parameters.heightmap_size = this->heightmap_size;
+    material_parameters.diffuse = this->diffuse;
+    material_parameters.specular = this->specular;
+    material_parameters.shininess = this->shininess;
+    material_parameters.use_baked_noise = this->use_baked_noise && this->baked_noise.handle != 0;
+    renderm_upload_material_uniforms(this, &material_parameters, sizeof(material_parameters));
+}
 
-    static struct
+void terrain_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
+{
+    // the lod origin differs between the camera and the shadow passes, so
+    // it goes with every draw instead of the material's constants
+    static thread_local struct
     {
-        mat4_t<> projection;
-        mat4_t<> view;
         mat4_t<> model;
-        vec3_t<> diffuse;
+        vec3_t<> lod_origin;
         float dummy0;
-        vec3_t<> specular;
-        float shininess;
-    } fragment_parameters;
+    } vertex_parameters;
 
     batch->program = this->program;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-    vertex_parameters.xyz_low = this->xyz_low;
-    vertex_parameters.xyz_high = this->xyz_high;
-
-    fragment_parameters.projection = eye.projection;
-    fragment_parameters.view = eye.view;
-    fragment_parameters.model = model_matrix;
-    fragment_parameters.diffuse = this->diffuse;
-    fragment_parameters.specular = this->specular;
-    fragment_parameters.shininess = this->shininess;
-
+    fill_draw_parameters(batch, eye, model_matrix, mesh);
+    vertex_parameters.model = model_matrix * renderm_mesh_dequantization(mesh);
+    vertex_parameters.lod_origin = this->lod_origin;
+    vertex_parameters.dummy0 = 0.0f;
     batch->vertex_parameters = &vertex_parameters;
     batch->vertex_parameters_size = sizeof(vertex_parameters);
-    batch->fragment_parameters = &fragment_parameters;
-    batch->fragment_parameters_size = sizeof(fragment_parameters);
-
-    batch->texture_count = 5;
-    batch->textures[0] = this->grass_texture;
-    batch->textures[1] = this->dirt_texture;
-    batch->textures[2] = this->sand_texture;
-    batch->textures[3] = this->heightmap_texture;
-    batch->textures[4] = this->heightmap_normal_map;
-
-    batch->vertex_buffer_count = 2;
-    batch->vertex_buffers[0] = &mesh.position_buffer;
-    batch->vertex_buffers[1] = &mesh.normal_buffer;
+    batch->material_uniforms = &this->uniform_buffer;
+
+    batch->texture_count = 2;
+    batch->textures[0] = this->heightmap_texture;
+    batch->textures[1] = this->heightmap_normal_map;
+    if (this->use_baked_noise && this->baked_noise.handle != 0)
+    {
+        batch->textures[batch->texture_count++] = &this->baked_noise;
+    }
+    batch->texture_array = this->splat_layers;
+
+    batch->vertex_format = &mesh.vertex_format;
+    batch->vertex_buffer = &mesh.vertex_buffer;
     batch->index_buffer = &mesh.index_buffer;
     batch->index_count = mesh.index_count;
     batch->primitive_type = mesh.primitive_type;
@@ -215,44 +221,14 @@ void terrain_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t
 
 void march_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
 {
-    // investigate why this needs to be static??
-    static struct
-    {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
-    } vertex_parameters;
-
-    static struct
-    {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
-        float time;
-    } fragment_parameters;
-
     batch->program = this->program;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-
-    fragment_parameters.projection = eye.projection;
-    fragment_parameters.view = eye.view;
-    fragment_parameters.model = model_matrix;
-    fragment_parameters.time = time_now;
-
-    batch->vertex_parameters = &vertex_parameters;
-    batch->vertex_parameters_size = sizeof(vertex_parameters);
-    batch->fragment_parameters = &fragment_parameters;
-    batch->fragment_parameters_size = sizeof(fragment_parameters);
+    fill_draw_parameters(batch, eye, model_matrix, mesh);
 
     batch->texture_count = 0;
 
-    batch->vertex_buffer_count = 3;
-    batch->vertex_buffers[0] = &mesh.position_buffer;
-    batch->vertex_buffers[1] = &mesh.normal_buffer;
-    batch->vertex_buffers[2] = &mesh.tex_coord_buffer;
+    batch->vertex_format = &mesh.vertex_format;
+    batch->vertex_buffer = &mesh.vertex_buffer;
     batch->index_buffer = &mesh.index_buffer;
     batch->index_count = mesh.index_count;
     batch->primitive_type = mesh.primitive_type;
@@ -264,37 +240,14 @@ void march_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &e
 
 void water_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const
 {
-    // investigate why this needs to be static??
-    static struct
-    {
-        mat4_t<> projection;
-        mat4_t<> view;
-        mat4_t<> model;
-    } vertex_parameters;
-
-    static struct
-    {
-        float t;
-    } fragment_parameters;
-
     batch->program = this->program;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-
-    fragment_parameters.t = (float)time_now;
-
-    batch->vertex_parameters = &vertex_parameters;
-    batch->vertex_parameters_size = sizeof(vertex_parameters);
-    batch->fragment_parameters = &fragment_parameters;
-    batch->fragment_parameters_size = sizeof(fragment_parameters);
+    fill_draw_parameters(batch, eye, model_matrix, mesh);
 
     batch->texture_count = 0;
 
-    batch->vertex_buffer_count = 2;
-    batch->vertex_buffers[0] = &mesh.position_buffer;
-    batch->vertex_buffers[1] = &mesh.normal_buffer;
+    batch->vertex_format = &mesh.vertex_format;
+    batch->vertex_buffer = &mesh.vertex_buffer;
     batch->index_buffer = &mesh.index_buffer;
     batch->index_count = mesh.index_count;
     batch->primitive_type = mesh.primitive_type;
@@ -303,4 +256,3 @@ void water_material_t::fill_batch(renderl_batch_t *batch, const renderm_eye_t &e
     batch->use_back_face_culling = true;
     batch->use_blending = false;
 }
-
@@ -14,6 +14,10 @@ struct simple_material_t : public renderm_material_t
     const renderl_texture_t *diffuse_texture;
     const renderl_texture_t *specular_texture;
     const renderl_texture_t *normal_texture;
+    // simple_material.frag features for the maps that are set, pick the
+    // program variant with them once the maps are in place
+    const char *features() const;
+    void upload_uniforms();
     void fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const;
 };
 
@@ -30,11 +34,21 @@ struct terrain_material_t : public renderm_material_t
     float shininess;
     vec3_t<> xyz_low;
     vec3_t<> xyz_high;
-    const renderl_texture_t *grass_texture;
-    const renderl_texture_t *dirt_texture;
-    const renderl_texture_t *sand_texture;
+    // texture array of the surface layers, see terrain_material.frag for which is which
+    const renderl_texture_t *splat_layers;
     const renderl_texture_t *heightmap_texture;
     const renderl_texture_t *heightmap_normal_map;
+    // patch lod parameters, see terrain.hpp. lod_origin is set for every
+    // pass by terrain_emit_patch_batches and goes with each draw
+    vec3_t<> lod_origin;
+    float lod_range_ratio;
+    float grid_size;
+    vec2_t<> heightmap_size;
+    // static noise of the surface shading over the whole terrain, handle 0
+    // until baked. without it the noise is evaluated per pixel
+    renderl_texture_t baked_noise;
+    bool use_baked_noise;
+    void upload_uniforms();
     void fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const;
 };
 
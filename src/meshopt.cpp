@@ -0,0 +1,229 @@
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "meshopt.hpp"
+
+static unsigned int hash_bytes(const unsigned char *p, int size)
+{
+    // fnv-1a
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int meshopt_weld(int vertex_count, const void *vertices, int vertex_size, unsigned int *remap, void *unique_vertices)
+{
+    const unsigned char *in = (const unsigned char *)vertices;
+    unsigned char *out = (unsigned char *)unique_vertices;
+
+    // open addressing, at most half full
+    int table_size = 1;
+    while (table_size < 2 * vertex_count)
+    {
+        table_size *= 2;
+    }
+    std::vector<int> table(table_size, -1);
+
+    int unique_count = 0;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        const unsigned char *v = in + i * vertex_size;
+        unsigned int slot = hash_bytes(v, vertex_size) & (table_size - 1);
+        while (table[slot] != -1 && memcmp(out + table[slot] * vertex_size, v, vertex_size) != 0)
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == -1)
+        {
+            // memmove since unique_vertices may alias vertices
+            memmove(out + unique_count * vertex_size, v, vertex_size);
+            table[slot] = unique_count++;
+        }
+        remap[i] = table[slot];
+    }
+
+    return unique_count;
+}
+
+// see "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", Sander et al. 2007
+void meshopt_optimize_post_transform(unsigned int *indices, int index_count, int vertex_count, int cache_size)
+{
+    int triangle_count = index_count / 3;
+
+    // vertex to triangle adjacency
+    std::vector<int> live(vertex_count, 0);
+    for (int i = 0; i < index_count; i++)
+    {
+        live[indices[i]]++;
+    }
+    std::vector<int> offsets(vertex_count + 1, 0);
+    for (int i = 0; i < vertex_count; i++)
+    {
+        offsets[i + 1] = offsets[i] + live[i];
+    }
+    std::vector<int> adjacency(index_count);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (int i = 0; i < index_count; i++)
+    {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<int> dead_end;
+    std::vector<int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(index_count);
+
+    int time = cache_size + 1;
+    int cursor = 0;
+    int fanning = vertex_count > 0 ? 0 : -1;
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        // emit every remaining triangle around the fanning vertex
+        for (int k = offsets[fanning]; k < offsets[fanning + 1]; k++)
+        {
+            int t = adjacency[k];
+            if (emitted[t])
+            {
+                continue;
+            }
+            emitted[t] = true;
+
+            for (int j = 0; j < 3; j++)
+            {
+                int v = indices[t * 3 + j];
+                result.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cache_size)
+                {
+                    cache_time[v] = time++;
+                }
+            }
+        }
+
+        // pick the candidate that is still in the cache and has the fewest
+        // remaining triangles, so it leaves the cache soon anyway
+        int best = -1;
+        int best_priority = -1;
+        for (int i = 0; i < (int)candidates.size(); i++)
+        {
+            int v = candidates[i];
+            if (live[v] > 0)
+            {
+                int priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                {
+                    priority = time - cache_time[v];
+                }
+                if (priority > best_priority)
+                {
+                    best_priority = priority;
+                    best = v;
+                }
+            }
+        }
+
+        if (best == -1)
+        {
+            // dead end, backtrack through recently used vertices...
+            while (!dead_end.empty())
+            {
+                int v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                {
+                    best = v;
+                    break;
+                }
+            }
+            // ...or resume the linear scan
+            while (best == -1 && cursor < vertex_count)
+            {
+                if (live[cursor] > 0)
+                {
+                    best = cursor;
+                }
+                cursor++;
+            }
+        }
+
+        fanning = best;
+    }
+
+    assert((int)result.size() == triangle_count * 3);
+    memcpy(indices, &result[0], triangle_count * 3 * sizeof(unsigned int));
+}
+
+void meshopt_optimize_vertex_fetch(unsigned int *indices, int index_count, int vertex_count, unsigned int *remap)
+{
+    const unsigned int unused = ~0u;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        remap[i] = unused;
+    }
+
+    unsigned int next = 0;
+    for (int i = 0; i < index_count; i++)
+    {
+        unsigned int &r = remap[indices[i]];
+        if (r == unused)
+        {
+            r = next++;
+        }
+        indices[i] = r;
+    }
+
+    // unreferenced vertices go last
+    for (int i = 0; i < vertex_count; i++)
+    {
+        if (remap[i] == unused)
+        {
+            remap[i] = next++;
+        }
+    }
+}
+
+void meshopt_remap_vertices(int vertex_count, const unsigned int *remap, int vertex_size, const void *vertices, void *remapped_vertices)
+{
+    const unsigned char *in = (const unsigned char *)vertices;
+    unsigned char *out = (unsigned char *)remapped_vertices;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        memcpy(out + remap[i] * vertex_size, in + i * vertex_size, vertex_size);
+    }
+}
+
+float meshopt_acmr(const unsigned int *indices, int index_count, int vertex_count, int cache_size)
+{
+    if (index_count < 3)
+    {
+        return 0.0f;
+    }
+
+    // fifo cache, a vertex is in the cache if it entered less than cache_size misses ago
+    std::vector<int> entered(vertex_count, -cache_size - 1);
+    int misses = 0;
+    for (int i = 0; i < index_count; i++)
+    {
+        unsigned int v = indices[i];
+        if (misses - entered[v] > cache_size)
+        {
+            entered[v] = misses;
+            misses++;
+        }
+    }
+
+    return (float)misses / (index_count / 3);
+}
@@ -0,0 +1,24 @@
+#ifndef _MESHOPT_HPP
+#define _MESHOPT_HPP
+
+// import time mesh optimization, all functions work on indexed triangle lists
+
+// merges bitwise identical vertices. remap[i] receives the welded index of
+// vertex i, the welded vertices are written to unique_vertices (which may be
+// the same array as vertices). returns the number of unique vertices
+int meshopt_weld(int vertex_count, const void *vertices, int vertex_size, unsigned int *remap, void *unique_vertices);
+
+// reorders triangles for post-transform cache hits (tipsify)
+void meshopt_optimize_post_transform(unsigned int *indices, int index_count, int vertex_count, int cache_size);
+
+// renumbers vertices in order of first use so fetches walk the vertex buffer
+// linearly. rewrites indices and fills remap[old] = new
+void meshopt_optimize_vertex_fetch(unsigned int *indices, int index_count, int vertex_count, unsigned int *remap);
+
+// moves vertices to their remapped positions
+void meshopt_remap_vertices(int vertex_count, const unsigned int *remap, int vertex_size, const void *vertices, void *remapped_vertices);
+
+// average cache miss ratio, transformed vertices per triangle with a fifo cache
+float meshopt_acmr(const unsigned int *indices, int index_count, int vertex_count, int cache_size);
+
+#endif // _MESHOPT_HPP
@@ -0,0 +1,97 @@
+#include <cmath>
+#include <vector>
+
+#include "picking.hpp"
+#include "raycast.hpp"
+#include "renderh.hpp"
+#include "components.hpp"
+#include "engine.hpp"
+
+void picking_window_ray(const renderm_eye_t &eye, int x, int y, int width, int height, vec3_t<> *origin, vec3_t<> *direction)
+{
+    mat4_t<> inverse = (eye.projection * eye.view).inverted();
+
+    float ndc_x = 2.0f * (x + 0.5f) / width - 1.0f;
+    float ndc_y = 1.0f - 2.0f * (y + 0.5f) / height;
+    vec4_t<> near = inverse * vec4_t<>(ndc_x, ndc_y, -1.0f, 1.0f);
+    vec4_t<> far = inverse * vec4_t<>(ndc_x, ndc_y, 1.0f, 1.0f);
+
+    *origin = (1.0f / near.w) * near.xyz();
+    *direction = ((1.0f / far.w) * far.xyz() - *origin).normalized();
+}
+
+// entry distance of the ray into a sphere, 0 if it starts inside
+static bool intersect_sphere(const vec3_t<> &center, float radius, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, float *t)
+{
+    vec3_t<> m = origin - center;
+    float a = direction.dot(direction);
+    float b = m.dot(direction);
+    float c = m.dot(m) - radius * radius;
+    if (c <= 0.0f)
+    {
+        *t = 0.0f;
+        return true;
+    }
+
+    float discriminant = b * b - a * c;
+    if (b > 0.0f || discriminant < 0.0f)
+    {
+        return false;
+    }
+
+    *t = (-b - sqrtf(discriminant)) / a;
+    return *t < max_t;
+}
+
+bool picking_cast_ray(const vec3_t<> &origin, const vec3_t<> &direction, float max_t, picking_hit_t *hit)
+{
+    static std::vector<int> candidates;
+    candidates.clear();
+    engine_t::instance->spatial_system.query_ray(origin, direction, max_t, &candidates);
+
+    float best_t = max_t;
+    int best_entity = -1;
+    for (int i = 0; i < (int)candidates.size(); i++)
+    {
+        int entity = candidates[i];
+        render_model_component_t *model_component = entity_manager_t::default_manager->get_component<render_model_component_t>(entity);
+        if (model_component == NULL)
+        {
+            continue;
+        }
+        position_component_t *pos = entity_manager_t::default_manager->get_component<position_component_t>(entity);
+        orientation_component_t *orientation = entity_manager_t::default_manager->get_component<orientation_component_t>(entity);
+        const renderh_model_t &model = *model_component->model;
+
+        // the ray in model space. the model matrix is a rotation and a
+        // translation, so distances along the ray stay the same
+        mat4_t<> rotation = orientation ? orientation->rotation.rotation_matrix() : mat4_t<>::identity();
+        mat4_t<> to_model = rotation.transposed();
+        vec3_t<> model_origin = (to_model * vec4_t<>(origin - pos->xyz, 1.0f)).xyz();
+        vec3_t<> model_direction = (to_model * vec4_t<>(direction, 0.0f)).xyz();
+
+        float t;
+        if (!intersect_sphere(model.bounds_center, model.bounds_radius, model_origin, model_direction, best_t, &t))
+        {
+            continue;
+        }
+
+        if (model.bvh != NULL && !raycast_intersect_bvh(*model.bvh, model_origin, model_direction, best_t, &t))
+        {
+            continue;
+        }
+
+        best_t = t;
+        best_entity = entity;
+    }
+
+    if (best_entity == -1)
+    {
+        return false;
+    }
+
+    hit->entity = best_entity;
+    hit->t = best_t;
+    hit->position = origin + best_t * direction;
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef _PICKING_HPP
+#define _PICKING_HPP
+
+#include "math.hpp"
+#include "renderm.hpp"
+
+// cpu ray casts against the entities the spatial system knows about. the
+// spatial tree and the model bounds narrow the candidates down, then the
+// triangle bvh of the model (if any) decides. nothing here touches the gpu
+struct picking_hit_t
+{
+    int entity;
+    // distance along the ray, in units of its direction
+    float t;
+    vec3_t<> position;
+};
+
+// ray from the eye through window pixel (x, y), with y growing downwards like the mouse
+void picking_window_ray(const renderm_eye_t &eye, int x, int y, int width, int height, vec3_t<> *origin, vec3_t<> *direction);
+// nearest rendered entity hit within max_t, false if none
+bool picking_cast_ray(const vec3_t<> &origin, const vec3_t<> &direction, float max_t, picking_hit_t *hit);
+
+#endif // _PICKING_HPP
@@ -0,0 +1,335 @@
+#include <cmath>
+#include <cfloat>
+#include <cassert>
+#include <algorithm>
+
+#include "raycast.hpp"
+
+#define BIN_COUNT 12
+#define MAX_LEAF_TRIANGLES 4
+#define STACK_SIZE 256
+
+struct build_triangle_t
+{
+    aabb_t box;
+    vec3_t<> centroid;
+    int index;
+};
+
+static aabb_t empty_box()
+{
+    aabb_t box;
+    box.low = vec3_t<>(FLT_MAX, FLT_MAX, FLT_MAX);
+    box.high = vec3_t<>(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    return box;
+}
+
+static void grow(aabb_t *box, const vec3_t<> &p)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        box->low.c[i] = fminf(box->low.c[i], p.c[i]);
+        box->high.c[i] = fmaxf(box->high.c[i], p.c[i]);
+    }
+}
+
+static void grow(aabb_t *box, const aabb_t &b)
+{
+    grow(box, b.low);
+    grow(box, b.high);
+}
+
+static float half_area(const aabb_t &box)
+{
+    vec3_t<> d = box.high - box.low;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// splits build[begin, end) at the cheapest of the bin boundaries along the
+// longest centroid axis, returns the split point or -1 to make a leaf
+static int find_split(std::vector<build_triangle_t> &build, int begin, int end)
+{
+    int count = end - begin;
+    if (count <= MAX_LEAF_TRIANGLES)
+    {
+        return -1;
+    }
+
+    aabb_t centroid_box = empty_box();
+    for (int i = begin; i < end; i++)
+    {
+        grow(&centroid_box, build[i].centroid);
+    }
+
+    vec3_t<> extent = centroid_box.high - centroid_box.low;
+    int axis = 0;
+    if (extent.y > extent.c[axis])
+    {
+        axis = 1;
+    }
+    if (extent.z > extent.c[axis])
+    {
+        axis = 2;
+    }
+    if (extent.c[axis] <= 0.0f)
+    {
+        // every centroid in the same spot, no split separates them
+        return -1;
+    }
+
+    aabb_t bin_boxes[BIN_COUNT];
+    int bin_counts[BIN_COUNT];
+    for (int i = 0; i < BIN_COUNT; i++)
+    {
+        bin_boxes[i] = empty_box();
+        bin_counts[i] = 0;
+    }
+
+    float low = centroid_box.low.c[axis];
+    float scale = BIN_COUNT / extent.c[axis];
+    for (int i = begin; i < end; i++)
+    {
+        int bin = std::min(BIN_COUNT - 1, (int)((build[i].centroid.c[axis] - low) * scale));
+        grow(&bin_boxes[bin], build[i].box);
+        bin_counts[bin]++;
+    }
+
+    // sweep from the right to know the cost of everything past each boundary
+    float right_costs[BIN_COUNT];
+    aabb_t right_box = empty_box();
+    int right_count = 0;
+    for (int i = BIN_COUNT - 1; i > 0; i--)
+    {
+        grow(&right_box, bin_boxes[i]);
+        right_count += bin_counts[i];
+        right_costs[i] = right_count > 0 ? right_count * half_area(right_box) : 0.0f;
+    }
+
+    int best_bin = -1;
+    float best_cost = FLT_MAX;
+    aabb_t left_box = empty_box();
+    int left_count = 0;
+    for (int i = 0; i < BIN_COUNT - 1; i++)
+    {
+        grow(&left_box, bin_boxes[i]);
+        left_count += bin_counts[i];
+        if (left_count == 0 || left_count == count)
+        {
+            continue;
+        }
+        float cost = left_count * half_area(left_box) + right_costs[i + 1];
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_bin = i;
+        }
+    }
+    if (best_bin == -1)
+    {
+        return -1;
+    }
+
+    build_triangle_t *middle = std::partition(&build[begin], &build[0] + end, [axis, low, scale, best_bin](const build_triangle_t &t)
+    {
+        return std::min(BIN_COUNT - 1, (int)((t.centroid.c[axis] - low) * scale)) <= best_bin;
+    });
+    return middle - &build[0];
+}
+
+static void build_node(raycast_bvh_t *bvh, std::vector<build_triangle_t> &build, int node, int begin, int end)
+{
+    aabb_t box = empty_box();
+    for (int i = begin; i < end; i++)
+    {
+        grow(&box, build[i].box);
+    }
+    bvh->nodes[node].box = box;
+
+    int split = find_split(build, begin, end);
+    if (split == -1)
+    {
+        bvh->nodes[node].first = begin;
+        bvh->nodes[node].count = end - begin;
+        return;
+    }
+
+    // children are allocated as a pair, this may reallocate nodes
+    int children = bvh->nodes.size();
+    bvh->nodes.resize(children + 2);
+    bvh->nodes[node].first = children;
+    bvh->nodes[node].count = 0;
+
+    build_node(bvh, build, children + 0, begin, split);
+    build_node(bvh, build, children + 1, split, end);
+}
+
+void raycast_build_bvh(raycast_bvh_t *bvh, const vec3_t<> *positions, int triangle_count, const int *indices)
+{
+    std::vector<build_triangle_t> build(triangle_count);
+    for (int i = 0; i < triangle_count; i++)
+    {
+        build_triangle_t &t = build[i];
+        t.box = empty_box();
+        for (int j = 0; j < 3; j++)
+        {
+            grow(&t.box, positions[indices[i * 3 + j]]);
+        }
+        t.centroid = 0.5f * (t.box.low + t.box.high);
+        t.index = i;
+    }
+
+    bvh->nodes.clear();
+    bvh->nodes.reserve(triangle_count > 0 ? 2 * triangle_count : 1);
+    bvh->nodes.resize(1);
+    if (triangle_count == 0)
+    {
+        bvh->nodes[0].box = empty_box();
+        bvh->nodes[0].first = 0;
+        bvh->nodes[0].count = 0;
+    }
+    else
+    {
+        build_node(bvh, build, 0, 0, triangle_count);
+    }
+
+    // store the triangles in leaf order
+    bvh->triangles.resize(triangle_count);
+    for (int i = 0; i < triangle_count; i++)
+    {
+        const int *tri = &indices[build[i].index * 3];
+        raycast_triangle_t &t = bvh->triangles[i];
+        t.v0 = positions[tri[0]];
+        t.e1 = positions[tri[1]] - t.v0;
+        t.e2 = positions[tri[2]] - t.v0;
+    }
+}
+
+static int depth(const raycast_bvh_t &bvh, int node)
+{
+    const raycast_bvh_node_t &n = bvh.nodes[node];
+    if (n.count > 0 || bvh.triangles.empty())
+    {
+        return 1;
+    }
+    return 1 + std::max(depth(bvh, n.first), depth(bvh, n.first + 1));
+}
+
+int raycast_bvh_depth(const raycast_bvh_t &bvh)
+{
+    return depth(bvh, 0);
+}
+
+bool raycast_intersect_triangle(const raycast_triangle_t &triangle, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, float *t)
+{
+    // moller-trumbore
+    vec3_t<> p = direction.cross(triangle.e2);
+    float det = triangle.e1.dot(p);
+    if (fabsf(det) < 1e-12f)
+    {
+        return false;
+    }
+    float inv_det = 1.0f / det;
+
+    vec3_t<> s = origin - triangle.v0;
+    float u = s.dot(p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return false;
+    }
+
+    vec3_t<> q = s.cross(triangle.e1);
+    float v = direction.dot(q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return false;
+    }
+
+    float hit_t = triangle.e2.dot(q) * inv_det;
+    if (hit_t < 0.0f || hit_t >= max_t)
+    {
+        return false;
+    }
+
+    *t = hit_t;
+    return true;
+}
+
+// slab test giving the entry distance, inv_direction may hold infinities
+static bool enter_box(const aabb_t &box, const vec3_t<> &origin, const vec3_t<> &inv_direction, float max_t, float *t)
+{
+    float t0 = 0.0f;
+    float t1 = max_t;
+    for (int i = 0; i < 3; i++)
+    {
+        float near = (box.low.c[i] - origin.c[i]) * inv_direction.c[i];
+        float far = (box.high.c[i] - origin.c[i]) * inv_direction.c[i];
+        t0 = fmaxf(t0, fminf(near, far));
+        t1 = fminf(t1, fmaxf(near, far));
+    }
+    *t = t0;
+    return t0 <= t1;
+}
+
+bool raycast_intersect_bvh(const raycast_bvh_t &bvh, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, float *t)
+{
+    if (bvh.triangles.empty())
+    {
+        return false;
+    }
+
+    vec3_t<> inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float best_t = max_t;
+    bool hit = false;
+
+    float entry;
+    if (!enter_box(bvh.nodes[0].box, origin, inv_direction, best_t, &entry))
+    {
+        return false;
+    }
+
+    int stack[STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        const raycast_bvh_node_t &node = bvh.nodes[stack[--stack_size]];
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                float triangle_t;
+                if (raycast_intersect_triangle(bvh.triangles[i], origin, direction, best_t, &triangle_t))
+                {
+                    best_t = triangle_t;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first, a close hit lets the other one be skipped
+        float t0, t1;
+        bool hit0 = enter_box(bvh.nodes[node.first + 0].box, origin, inv_direction, best_t, &t0);
+        bool hit1 = enter_box(bvh.nodes[node.first + 1].box, origin, inv_direction, best_t, &t1);
+        assert(stack_size + 2 <= STACK_SIZE);
+        if (hit0 && hit1)
+        {
+            stack[stack_size++] = t0 < t1 ? node.first + 1 : node.first + 0;
+            stack[stack_size++] = t0 < t1 ? node.first + 0 : node.first + 1;
+        }
+        else if (hit0)
+        {
+            stack[stack_size++] = node.first + 0;
+        }
+        else if (hit1)
+        {
+            stack[stack_size++] = node.first + 1;
+        }
+    }
+
+    if (hit)
+    {
+        *t = best_t;
+    }
+    return hit;
+}
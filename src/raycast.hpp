@@ -0,0 +1,41 @@
+#ifndef _RAYCAST_HPP
+#define _RAYCAST_HPP
+
+#include <vector>
+
+#include "math.hpp"
+#include "aabb_tree.hpp"
+
+// a corner and the two edges leaving it, as the intersection test wants them
+struct raycast_triangle_t
+{
+    vec3_t<> v0;
+    vec3_t<> e1;
+    vec3_t<> e2;
+};
+
+struct raycast_bvh_node_t
+{
+    aabb_t box;
+    // leaves cover triangles [first, first + count), inner nodes have
+    // count 0 and their children at first and first + 1
+    int first;
+    int count;
+};
+
+// static bounding volume hierarchy over the triangles of a mesh, built once
+// with binned surface area heuristic splits
+struct raycast_bvh_t
+{
+    std::vector<raycast_triangle_t> triangles;
+    std::vector<raycast_bvh_node_t> nodes;
+};
+
+void raycast_build_bvh(raycast_bvh_t *bvh, const vec3_t<> *positions, int triangle_count, const int *indices);
+int raycast_bvh_depth(const raycast_bvh_t &bvh);
+
+// nearest hit with 0 <= t < max_t, in units of direction. both sides of a triangle are hit
+bool raycast_intersect_triangle(const raycast_triangle_t &triangle, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, float *t);
+bool raycast_intersect_bvh(const raycast_bvh_t &bvh, const vec3_t<> &origin, const vec3_t<> &direction, float max_t, float *t);
+
+#endif // _RAYCAST_HPP
@@ -0,0 +1,405 @@
+#include <cassert>
+#include <cstring>
+
+#include <GL/glew.h>
+#ifdef _OSX
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "render_graph.hpp"
+
+void render_graph_init(render_graph_t *graph)
+{
+    graph->frame = 0;
+    graph->culled_pass_count = 0;
+    graph->transient_count = 0;
+    render_graph_begin(graph);
+}
+
+void render_graph_begin(render_graph_t *graph)
+{
+    graph->resources.clear();
+    graph->passes.clear();
+
+    renderl_texture_t window;
+    window.handle = 0;
+    window.width = 0;
+    window.height = 0;
+    int resource = render_graph_import_texture(graph, "window", window, 0);
+    assert(resource == RENDER_GRAPH_WINDOW);
+}
+
+static int add_resource(render_graph_t *graph, const char *name, int width, int height, int format, bool imported)
+{
+    render_graph_resource_t resource;
+    resource.name = name;
+    resource.width = width;
+    resource.height = height;
+    resource.format = format;
+    resource.imported = imported;
+    resource.texture.handle = 0;
+    resource.texture.width = width;
+    resource.texture.height = height;
+    resource.pool_entry = -1;
+    resource.first_use = -1;
+    resource.last_use = -1;
+    graph->resources.push_back(resource);
+    return graph->resources.size() - 1;
+}
+
+int render_graph_create_texture(render_graph_t *graph, const char *name, int width, int height, int format)
+{
+    return add_resource(graph, name, width > 0 ? width : 1, height > 0 ? height : 1, format, false);
+}
+
+int render_graph_import_texture(render_graph_t *graph, const char *name, const renderl_texture_t &texture, int format)
+{
+    int resource = add_resource(graph, name, texture.width, texture.height, format, true);
+    graph->resources[resource].texture = texture;
+    return resource;
+}
+
+int render_graph_add_pass(render_graph_t *graph, const char *name, render_graph_execute_t execute, void *user_data, int flags)
+{
+    render_graph_pass_t pass;
+    pass.name = name;
+    pass.execute = execute;
+    pass.user_data = user_data;
+    pass.flags = flags;
+    pass.color_count = 0;
+    pass.depth.resource = -1;
+    pass.depth.load = RENDER_GRAPH_DONT_CARE;
+    pass.input_count = 0;
+    pass.kept = false;
+    graph->passes.push_back(pass);
+    return graph->passes.size() - 1;
+}
+
+void render_graph_write(render_graph_t *graph, int pass, int resource, int load)
+{
+    render_graph_pass_t &p = graph->passes[pass];
+    assert(p.color_count < 8);
+    // the window can't be combined with other attachments
+    assert(p.color_count == 0 || (resource == RENDER_GRAPH_WINDOW) == (p.colors[0].resource == RENDER_GRAPH_WINDOW));
+    p.colors[p.color_count].resource = resource;
+    p.colors[p.color_count].load = load;
+    p.color_count++;
+}
+
+void render_graph_write_depth(render_graph_t *graph, int pass, int resource, int load)
+{
+    render_graph_pass_t &p = graph->passes[pass];
+    p.depth.resource = resource;
+    p.depth.load = load;
+}
+
+void render_graph_read(render_graph_t *graph, int pass, int resource)
+{
+    render_graph_pass_t &p = graph->passes[pass];
+    assert(p.input_count < RENDER_GRAPH_MAX_INPUTS);
+    assert(resource != RENDER_GRAPH_WINDOW);
+    p.inputs[p.input_count++] = resource;
+}
+
+const renderl_texture_t &render_graph_texture(const render_graph_t &graph, int resource)
+{
+    const render_graph_resource_t &r = graph.resources[resource];
+    assert(r.imported || r.pool_entry != -1);
+    return r.texture;
+}
+
+// calls f(resource, load) for every attachment of the pass, load is -1 for inputs
+template <typename F>
+static void for_each_use(const render_graph_pass_t &pass, F f)
+{
+    for (int i = 0; i < pass.color_count; i++)
+    {
+        f(pass.colors[i].resource, pass.colors[i].load);
+    }
+    if (pass.depth.resource != -1)
+    {
+        f(pass.depth.resource, pass.depth.load);
+    }
+    for (int i = 0; i < pass.input_count; i++)
+    {
+        f(pass.inputs[i], -1);
+    }
+}
+
+// walks the passes backwards keeping track of which resources a kept pass
+// still wants the contents of. a pass is kept if it writes one of them
+static void cull_passes(render_graph_t *graph)
+{
+    std::vector<bool> needed(graph->resources.size(), false);
+    needed[RENDER_GRAPH_WINDOW] = true;
+
+    graph->culled_pass_count = 0;
+    for (int i = graph->passes.size() - 1; i >= 0; i--)
+    {
+        render_graph_pass_t &pass = graph->passes[i];
+        pass.kept = (pass.flags & RENDER_GRAPH_SIDE_EFFECTS) != 0;
+        for_each_use(pass, [&](int resource, int load)
+        {
+            if (load != -1 && needed[resource])
+            {
+                pass.kept = true;
+            }
+        });
+        if (!pass.kept)
+        {
+            graph->culled_pass_count++;
+            continue;
+        }
+
+        // writes satisfy the passes after this one, unless they draw on top
+        // of what was there
+        for_each_use(pass, [&](int resource, int load)
+        {
+            if (load != -1 && resource != RENDER_GRAPH_WINDOW)
+            {
+                needed[resource] = load == RENDER_GRAPH_LOAD;
+            }
+        });
+        for_each_use(pass, [&](int resource, int load)
+        {
+            if (load == -1)
+            {
+                needed[resource] = true;
+            }
+        });
+    }
+
+    // a transient resource is read before anything wrote it
+    for (int i = 0; i < (int)graph->resources.size(); i++)
+    {
+        assert(graph->resources[i].imported || !needed[i]);
+    }
+}
+
+static void compute_lifetimes(render_graph_t *graph)
+{
+    graph->transient_count = 0;
+    for (int i = 0; i < (int)graph->passes.size(); i++)
+    {
+        const render_graph_pass_t &pass = graph->passes[i];
+        if (!pass.kept)
+        {
+            continue;
+        }
+        for_each_use(pass, [&](int resource, int load)
+        {
+            render_graph_resource_t &r = graph->resources[resource];
+            if (r.first_use == -1)
+            {
+                r.first_use = i;
+                graph->transient_count += r.imported ? 0 : 1;
+            }
+            r.last_use = i;
+        });
+    }
+}
+
+static void acquire_texture(render_graph_t *graph, render_graph_resource_t *resource)
+{
+    for (int i = 0; i < (int)graph->pool.size(); i++)
+    {
+        render_graph_pool_entry_t &entry = graph->pool[i];
+        if (!entry.in_use && entry.width == resource->width && entry.height == resource->height && entry.format == resource->format)
+        {
+            entry.in_use = true;
+            entry.last_frame = graph->frame;
+            resource->pool_entry = i;
+            resource->texture = entry.texture;
+            return;
+        }
+    }
+
+    render_graph_pool_entry_t entry;
+    entry.width = resource->width;
+    entry.height = resource->height;
+    entry.format = resource->format;
+    if (resource->format == GL_DEPTH24_STENCIL8)
+    {
+        entry.texture = renderl_create_depth_stencil_buffer(resource->width, resource->height);
+    }
+    else
+    {
+        entry.texture = renderl_create_render_texture(resource->width, resource->height, resource->format);
+    }
+    entry.in_use = true;
+    entry.last_frame = graph->frame;
+    graph->pool.push_back(entry);
+
+    resource->pool_entry = graph->pool.size() - 1;
+    resource->texture = entry.texture;
+}
+
+static const renderl_frame_buffer_t *find_frame_buffer(render_graph_t *graph, const render_graph_pass_t &pass)
+{
+    render_graph_frame_buffer_t key;
+    memset(&key, 0, sizeof(key));
+    key.color_count = pass.color_count;
+    renderl_texture_t colors[8];
+    for (int i = 0; i < pass.color_count; i++)
+    {
+        colors[i] = graph->resources[pass.colors[i].resource].texture;
+        key.colors[i] = colors[i].handle;
+    }
+    const renderl_texture_t *depth = NULL;
+    bool depth_stencil = false;
+    if (pass.depth.resource != -1)
+    {
+        const render_graph_resource_t &r = graph->resources[pass.depth.resource];
+        depth = &r.texture;
+        depth_stencil = r.format == GL_DEPTH24_STENCIL8;
+        key.depth = depth->handle;
+    }
+
+    for (int i = 0; i < (int)graph->frame_buffers.size(); i++)
+    {
+        render_graph_frame_buffer_t &f = graph->frame_buffers[i];
+        if (f.color_count == key.color_count && f.depth == key.depth && memcmp(f.colors, key.colors, sizeof(key.colors)) == 0)
+        {
+            f.last_frame = graph->frame;
+            return &f.fbo;
+        }
+    }
+
+    int width = pass.color_count > 0 ? colors[0].width : depth->width;
+    int height = pass.color_count > 0 ? colors[0].height : depth->height;
+    key.fbo = renderl_assemble_frame_buffer_adv(width, height, depth, depth_stencil, pass.color_count, colors);
+    key.last_frame = graph->frame;
+    graph->frame_buffers.push_back(key);
+    return &graph->frame_buffers.back().fbo;
+}
+
+static void bind_attachments(render_graph_t *graph, const render_graph_pass_t &pass)
+{
+    bool window = (pass.color_count > 0 && pass.colors[0].resource == RENDER_GRAPH_WINDOW) || pass.depth.resource == RENDER_GRAPH_WINDOW;
+    if (window)
+    {
+        assert(pass.depth.resource == -1 || pass.depth.resource == RENDER_GRAPH_WINDOW);
+        renderl_bind_frame_buffer(NULL);
+
+        int bits = 0;
+        if (pass.color_count > 0 && pass.colors[0].load == RENDER_GRAPH_CLEAR)
+        {
+            bits |= GL_COLOR_BUFFER_BIT;
+        }
+        if (pass.depth.resource != -1 && pass.depth.load == RENDER_GRAPH_CLEAR)
+        {
+            bits |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+        }
+        if (bits != 0)
+        {
+            glClear(bits);
+        }
+        return;
+    }
+
+    renderl_bind_frame_buffer(find_frame_buffer(graph, pass));
+
+    const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (int i = 0; i < pass.color_count; i++)
+    {
+        if (pass.colors[i].load == RENDER_GRAPH_CLEAR)
+        {
+            glClearBufferfv(GL_COLOR, i, black);
+        }
+    }
+    if (pass.depth.resource != -1 && pass.depth.load == RENDER_GRAPH_CLEAR)
+    {
+        if (graph->resources[pass.depth.resource].format == GL_DEPTH24_STENCIL8)
+        {
+            glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+        }
+        else
+        {
+            const float one = 1.0f;
+            glClearBufferfv(GL_DEPTH, 0, &one);
+        }
+    }
+}
+
+// frame buffers first, they may be the only thing referring to a pooled texture
+static void delete_stale_entries(render_graph_t *graph)
+{
+    for (int i = 0; i < (int)graph->frame_buffers.size(); )
+    {
+        if (graph->frame - graph->frame_buffers[i].last_frame > RENDER_GRAPH_RETAIN_FRAMES)
+        {
+            renderl_release_frame_buffer(graph->frame_buffers[i].fbo);
+            graph->frame_buffers[i] = graph->frame_buffers.back();
+            graph->frame_buffers.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    for (int i = 0; i < (int)graph->pool.size(); )
+    {
+        render_graph_pool_entry_t &entry = graph->pool[i];
+        if (graph->frame - entry.last_frame > RENDER_GRAPH_RETAIN_FRAMES)
+        {
+            if (entry.format == GL_DEPTH24_STENCIL8)
+            {
+                renderl_delete_depth_stencil_buffer(entry.texture);
+            }
+            else
+            {
+                renderl_delete_texture(entry.texture);
+            }
+            graph->pool[i] = graph->pool.back();
+            graph->pool.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void render_graph_execute(render_graph_t *graph)
+{
+    cull_passes(graph);
+    compute_lifetimes(graph);
+
+    for (int i = 0; i < (int)graph->passes.size(); i++)
+    {
+        const render_graph_pass_t &pass = graph->passes[i];
+        if (!pass.kept)
+        {
+            continue;
+        }
+
+        for (int j = 0; j < (int)graph->resources.size(); j++)
+        {
+            render_graph_resource_t &r = graph->resources[j];
+            if (!r.imported && r.first_use == i)
+            {
+                acquire_texture(graph, &r);
+            }
+        }
+
+        bind_attachments(graph, pass);
+        pass.execute(*graph, pass.user_data);
+
+        // whatever is done with now can be handed to the next passes
+        for (int j = 0; j < (int)graph->resources.size(); j++)
+        {
+            const render_graph_resource_t &r = graph->resources[j];
+            if (!r.imported && r.last_use == i)
+            {
+                graph->pool[r.pool_entry].in_use = false;
+            }
+        }
+    }
+    renderl_bind_frame_buffer(NULL);
+
+    delete_stale_entries(graph);
+    graph->frame++;
+}
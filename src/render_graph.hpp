@@ -0,0 +1,118 @@
+#ifndef _RENDER_GRAPH_HPP
+#define _RENDER_GRAPH_HPP
+
+#include <vector>
+
+#include "renderl.hpp"
+
+#define RENDER_GRAPH_MAX_INPUTS 16
+
+// resource 0 of every frame, the default frame buffer
+#define RENDER_GRAPH_WINDOW 0
+
+// what happens to an attachment before a pass draws into it. with
+// RENDER_GRAPH_DONT_CARE the pass must cover every pixel it uses itself
+#define RENDER_GRAPH_LOAD       0
+#define RENDER_GRAPH_CLEAR      1
+#define RENDER_GRAPH_DONT_CARE  2
+
+// flags for render_graph_add_pass, such passes are never culled
+#define RENDER_GRAPH_SIDE_EFFECTS 1
+
+// pooled textures left unused for this many frames are deleted
+#define RENDER_GRAPH_RETAIN_FRAMES 60
+
+struct render_graph_t;
+
+typedef void (*render_graph_execute_t)(const render_graph_t &graph, void *user_data);
+
+struct render_graph_resource_t
+{
+    const char *name;
+    int width, height;
+    // GL_DEPTH24_STENCIL8 for depth and stencil attachments
+    int format;
+    // owned by the caller, never aliased. transient ones are taken from the
+    // pool for the passes between their first and last use
+    bool imported;
+    renderl_texture_t texture;
+    int pool_entry;
+    int first_use, last_use;
+};
+
+struct render_graph_attachment_t
+{
+    int resource;
+    int load;
+};
+
+struct render_graph_pass_t
+{
+    const char *name;
+    render_graph_execute_t execute;
+    void *user_data;
+    int flags;
+
+    int color_count;
+    render_graph_attachment_t colors[8];
+    // resource -1 when the pass has no depth attachment
+    render_graph_attachment_t depth;
+    int input_count;
+    int inputs[RENDER_GRAPH_MAX_INPUTS];
+
+    bool kept;
+};
+
+struct render_graph_pool_entry_t
+{
+    int width, height;
+    int format;
+    renderl_texture_t texture;
+    bool in_use;
+    int last_frame;
+};
+
+// frame buffer objects are kept per combination of attachments, the pool
+// hands out the same textures every frame so they are found again
+struct render_graph_frame_buffer_t
+{
+    int color_count;
+    unsigned int colors[8];
+    unsigned int depth;
+    renderl_frame_buffer_t fbo;
+    int last_frame;
+};
+
+// passes are declared in the order they run every frame along with the
+// attachments they draw into and the textures they sample. passes nothing
+// on the window depends on are dropped and transient targets whose lifetimes
+// don't overlap share one texture
+struct render_graph_t
+{
+    std::vector<render_graph_resource_t> resources;
+    std::vector<render_graph_pass_t> passes;
+    std::vector<render_graph_pool_entry_t> pool;
+    std::vector<render_graph_frame_buffer_t> frame_buffers;
+    int frame;
+
+    // of the last render_graph_execute
+    int culled_pass_count;
+    int transient_count;
+};
+
+void render_graph_init(render_graph_t *graph);
+// forgets the passes and resources of the previous frame, the pool is kept
+void render_graph_begin(render_graph_t *graph);
+int render_graph_create_texture(render_graph_t *graph, const char *name, int width, int height, int format);
+int render_graph_import_texture(render_graph_t *graph, const char *name, const renderl_texture_t &texture, int format);
+int render_graph_add_pass(render_graph_t *graph, const char *name, render_graph_execute_t execute, void *user_data, int flags);
+// color attachments are numbered in the order they are added
+void render_graph_write(render_graph_t *graph, int pass, int resource, int load);
+void render_graph_write_depth(render_graph_t *graph, int pass, int resource, int load);
+void render_graph_read(render_graph_t *graph, int pass, int resource);
+// the texture behind a resource, only valid while its passes execute
+const renderl_texture_t &render_graph_texture(const render_graph_t &graph, int resource);
+// culls, allocates and runs the passes, each with its attachments bound and cleared
+void render_graph_execute(render_graph_t *graph);
+
+#endif // _RENDER_GRAPH_HPP
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 
 #include <GL/glew.h>
 #ifdef _OSX
@@ -14,10 +15,16 @@
 #include "renderl.hpp"
 #include "renderm.hpp"
 #include "renderh.hpp"
+#include "frustum.hpp"
+#include "lightgrid.hpp"
+#include "terrain.hpp"
+#include "picking.hpp"
 #include "rendering.hpp"
 #include "resources.hpp"
 #include "components.hpp"
 #include "render_system.hpp"
+#include "render_graph.hpp"
+#include "jobs.hpp"
 #include "entity_system.hpp"
 
 #include "engine.hpp"
@@ -26,22 +33,16 @@ extern double time_now;
 extern int mouse_x;
 extern int mouse_y;
 
-static renderl_frame_buffer_t pre_deferred_fbo;
-static renderl_frame_buffer_t post_deferred_fbo;
-static renderl_frame_buffer_t render_water_fbo;
-
 extern int window_width;
 extern int window_height;
 extern float window_aspect;
 
-static const renderl_program_t *picking_program;
 static const renderl_program_t *water_program;
 static const renderl_program_t *apply_light_program;
+static const renderl_program_t *apply_light_volume_program;
+static const renderl_program_t *clustered_light_program;
 static const renderl_program_t *ssao_program;
 
-static renderl_texture_t dummy_texture0;
-static renderl_texture_t dummy_texture1;
-
 static renderm_mesh_t skydome_mesh;
 static const renderl_program_t *skydome_program;
 static const renderl_texture_t *skydome_texture;
@@ -49,6 +50,45 @@ static const renderl_texture_t *skydome_texture;
 
 static const renderl_texture_t *speaker_texture;
 
+// point lights are shaded in one pass over the clusters they reach
+static lightgrid_t lightgrid;
+
+static const renderl_program_t *terrain_noise_bake_program;
+// gpu time of the terrain in the g-buffer pass
+static renderl_timer_t terrain_timer;
+
+// the passes of a frame and the render targets between them, rebuilt every frame
+static render_graph_t render_graph;
+
+// every shadow map is a tile of one depth only atlas. a tile is only redrawn
+// when its light or something inside the light frustum changed
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_TILE_SIZE 1024
+#define SHADOW_TILES_PER_ROW (SHADOW_ATLAS_SIZE / SHADOW_TILE_SIZE)
+static struct
+{
+    renderl_frame_buffer_t fbo;
+    int tile_count;
+} shadow_atlas;
+static int shadow_frame = 0;
+
+// unit proxies rasterized around point and spot lights in light volume mode
+static renderm_mesh_t light_sphere_mesh;
+static renderm_mesh_t light_cone_mesh;
+
+// entity under the mouse cursor as of the last pick that came back, -1 if none
+static int picked_entity = -1;
+
+// the g-buffer id under the cursor is read back a few frames late. each slot
+// remembers which entity every id of its frame belonged to
+#define PICK_SLOT_COUNT 3
+static struct
+{
+    renderl_readback_t readback;
+    std::vector<int> entities;
+} pick_slots[PICK_SLOT_COUNT];
+static int pick_frame = 0;
+
 static struct
 {
     const renderl_program_t *program;
@@ -79,53 +119,105 @@ static struct
     int primitive_type;
 } fullscreen_quad;
 
+// hdr post processing: auto exposure from the log-average luminance and bloom
+#define BLOOM_LEVEL_COUNT 4
+static struct
+{
+    const renderl_program_t *luminance_program;
+    const renderl_program_t *adapt_program;
+    const renderl_program_t *bright_pass_program;
+    const renderl_program_t *blur_program;
+    const renderl_program_t *tonemap_program;
+
+    // 1x1 adapted luminance, written from the other one every frame
+    renderl_frame_buffer_t adapted_fbos[2];
+    int adapted_index;
+} postfx;
+
 extern renderm_mesh_t create_cube_mesh();
 
+// uv sphere around the origin, pushed out so its flat faces still enclose the unit sphere
+static renderm_mesh_t create_light_sphere_mesh()
+{
+    const int rings = 8;
+    const int segments = 16;
+    const float scale = 1.0f / (cosf(M_PI / (2 * rings)) * cosf(M_PI / segments));
 
+    std::vector<vec3_t<> > positions;
+    for (int i = 0; i <= rings; i++)
+    {
+        float theta = M_PI * i / rings;
+        for (int j = 0; j <= segments; j++)
+        {
+            float phi = 2.0f * M_PI * j / segments;
+            positions.push_back(scale * vec3_t<>(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi)));
+        }
+    }
 
-void render_system_t::init()
+    std::vector<unsigned int> indices;
+    for (int i = 0; i < rings; i++)
+    {
+        for (int j = 0; j < segments; j++)
+        {
+            unsigned int a = i * (segments + 1) + j;
+            unsigned int b = a + segments + 1;
+            unsigned int quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    return renderm_create_mesh(positions.size(), &positions[0], NULL, NULL, NULL, GL_UNSIGNED_INT, &indices[0], indices.size(), GL_TRIANGLES, 0);
+}
+
+// cone with its apex at the origin opening along -z to a unit disc at z = -1,
+// the disc is pushed out so the polygon encloses the circle
+static renderm_mesh_t create_light_cone_mesh()
 {
-    pre_deferred_fbo = renderl_create_frame_buffer(window_width, window_height, 4, GL_RGBA16F, true);
+    const int segments = 16;
+    const float scale = 1.0f / cosf(M_PI / segments);
+
+    std::vector<vec3_t<> > positions;
+    positions.push_back(vec3_t<>(0.0f, 0.0f, 0.0f));
+    positions.push_back(vec3_t<>(0.0f, 0.0f, -1.0f));
+    for (int j = 0; j < segments; j++)
     {
-        unsigned int tex;
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, window_width, window_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        dummy_texture0.handle = tex;
-        dummy_texture0.width = window_width;
-        dummy_texture0.height = window_height;
-
-        //render_water_fbo = renderl_assemble_frame_buffer(window_width, window_height, pre_deferred_fbo.depth_texture, 1, &post_deferred_fbo.textures[0]);
-        post_deferred_fbo = renderl_assemble_frame_buffer(window_width, window_height, pre_deferred_fbo.depth_texture, 1, &dummy_texture0);
+        float phi = 2.0f * M_PI * j / segments;
+        positions.push_back(vec3_t<>(scale * cosf(phi), scale * sinf(phi), -1.0f));
     }
+
+    std::vector<unsigned int> indices;
+    for (int j = 0; j < segments; j++)
+    {
+        unsigned int a = 2 + j;
+        unsigned int b = 2 + (j + 1) % segments;
+        unsigned int triangles[6] = { 0, a, b, 1, b, a };
+        indices.insert(indices.end(), triangles, triangles + 6);
+    }
+
+    return renderm_create_mesh(positions.size(), &positions[0], NULL, NULL, NULL, GL_UNSIGNED_INT, &indices[0], indices.size(), GL_TRIANGLES, 0);
+}
+
+
+
+void render_system_t::init()
+{
+    terrain_noise_bake_program = resource_upload_program(3, "data/shaders/noise4D.glsl", "data/shaders/fullscreen_quad.vert", "data/shaders/terrain_noise_bake.frag");
+    terrain_timer = renderl_create_timer();
+    render_graph_init(&render_graph);
+
+    for (int i = 0; i < PICK_SLOT_COUNT; i++)
     {
-        unsigned int tex;
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, window_width, window_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        dummy_texture1.handle = tex;
-        dummy_texture1.width = window_width;
-        dummy_texture1.height = window_height;
-
-        //render_water_fbo = renderl_assemble_frame_buffer(window_width, window_height, pre_deferred_fbo.depth_texture, 1, &post_deferred_fbo.textures[0]);
-        render_water_fbo = renderl_assemble_frame_buffer(window_width, window_height, pre_deferred_fbo.depth_texture, 1, &dummy_texture1);
+        pick_slots[i].readback = renderl_create_readback(sizeof(float));
     }
 
-    picking_program = resource_upload_program(2, "data/shaders/picking.vert", "data/shaders/picking.frag");
     water_program = resource_upload_program(3, "data/shaders/noise4D.glsl", "data/shaders/water.vert", "data/shaders/water.frag");
     apply_light_program = resource_upload_program(2, "data/shaders/apply_light.vert", "data/shaders/apply_light.frag");
+    apply_light_volume_program = resource_upload_program(2, "data/shaders/light_volume.vert", "data/shaders/apply_light.frag");
+    clustered_light_program = resource_upload_program(2, "data/shaders/apply_light.vert", "data/shaders/clustered_light.frag");
+    lightgrid_init(&lightgrid);
+
+    shadow_atlas.fbo = renderl_create_frame_buffer(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 0, GL_RGBA, false);
+    shadow_atlas.tile_count = 0;
 
     {
         float positions[] =
@@ -153,6 +245,26 @@ void render_system_t::init()
     }
     ssao_program = resource_upload_program(2, "data/shaders/ssao.vert", "data/shaders/ssao.frag");
 
+    {
+        postfx.luminance_program = resource_upload_program(2, "data/shaders/fullscreen_quad.vert", "data/shaders/luminance.frag");
+        postfx.adapt_program = resource_upload_program(2, "data/shaders/fullscreen_quad.vert", "data/shaders/adapt_luminance.frag");
+        postfx.bright_pass_program = resource_upload_program(2, "data/shaders/fullscreen_quad.vert", "data/shaders/bright_pass.frag");
+        postfx.blur_program = resource_upload_program(2, "data/shaders/fullscreen_quad.vert", "data/shaders/gaussian_blur.frag");
+        postfx.tonemap_program = resource_upload_program(2, "data/shaders/fullscreen_quad.vert", "data/shaders/tonemap.frag");
+
+        // start out adapted to an average scene
+        glClearColor(0.2f, 0.0f, 0.0f, 1.0f);
+        for (int i = 0; i < 2; i++)
+        {
+            postfx.adapted_fbos[i] = renderl_create_frame_buffer(1, 1, 1, GL_R16F, false);
+            renderl_bind_frame_buffer(&postfx.adapted_fbos[i]);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        renderl_bind_frame_buffer(NULL);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        postfx.adapted_index = 0;
+    }
+
     {
         float positions[] =
         {
@@ -208,19 +320,14 @@ void render_system_t::init()
     }
 
     skydome_mesh = create_cube_mesh();
+    light_sphere_mesh = create_light_sphere_mesh();
+    light_cone_mesh = create_light_cone_mesh();
     skydome_program = resource_upload_program(2, "data/shaders/skydome.vert", "data/shaders/skydome.frag");
     skydome_texture = resource_upload_texture("data/images/skydome.png");
 
     speaker_texture = resource_upload_texture("data/images/speaker-icon.png");
 }
 
-struct item_t
-{
-    int entity;
-    mat4_t<> model_matrix;
-    const renderh_model_t *model;
-};
-
 struct light_t
 {
     // pointlight = 0
@@ -238,45 +345,158 @@ struct light_t
     // valid when type == 2
     vec3_t<> direction;
     vec3_t<> color;
-    const renderl_texture_t *shadow_map;
-    const renderl_frame_buffer_t *shadow_fbo;
+    // valid when type == 0 or type == 1, the light has no effect beyond it
+    float radius;
+    // spot lights have one, shadowed directional lights one per cascade
+    shadow_map_t *shadow_maps;
+    int shadow_map_count;
+    // valid when type == 2 and it has shadow maps
+    float shadow_distance;
 };
 
 
 renderm_eye_t *HAX_camera_eye;
-static std::list<item_t> *HAX_items;
+static std::vector<renderh_model_group_t> *HAX_groups;
 static std::list<light_t> *HAX_lights;
 static vec3_t<> HAX_light_direction;
 
-static void extract_visible_stuff(const renderh_camera_t &camera, std::list<item_t> *items, std::list<light_t> *lights)
+// the frame being drawn, filled in by update for the passes of the render graph
+static struct
 {
-    // later it might be wise to use a smarter extract function. maybe even with frustum culling?!
-
-    // :(
-    HAX_items = items;
-    HAX_lights = lights;
+    float dt;
+    renderh_camera_t camera;
+    renderm_eye_t camera_eye;
+    frustum_t camera_frustum;
+    std::list<light_t> visible_lights;
+    std::vector<renderh_model_group_t> camera_groups;
+    std::vector<int> terrain_entities;
+    vec3_t<> sun_direction;
+
+    // the camera's batches, recorded by record_camera_batches one list per
+    // group and replayed by the g-buffer pass
+    std::vector<renderh_cull_stats_t> camera_group_stats;
+    std::vector<int> camera_base_ids;
+    std::vector<renderl_command_list_t> camera_commands;
+    renderl_command_list_t terrain_commands;
+    int camera_patch_count;
+
+    renderh_cull_stats_t camera_stats;
+    renderh_cull_stats_t shadow_stats;
+    int shadow_tiles_drawn;
+
+    // render graph resources
+    int shadow_atlas;
+    // position, normal, diffuse, specular and ids
+    int gbuffer[5];
+    int depth;
+    // lights on the g-buffer, then the water on top of that
+    int lit;
+    int scene;
+    // log luminance, averaged by its mip chain
+    int luminance;
+    int previous_adapted;
+    int adapted;
+    // level i is 1 / 2^(i + 1) of the window
+    struct
+    {
+        int blurred;
+        int horizontal;
+        // blurred of the level before, -1 for level 0
+        int above;
+    } bloom[BLOOM_LEVEL_COUNT];
+} frame;
+
+// models of the entities the spatial system finds in the frustum, plus all
+// instanced models. renderh_cull_model_groups then tests every instance
+static void extract_model_groups(const frustum_t &frustum, std::vector<renderh_model_group_t> *groups)
+{
+    static std::vector<int> entities;
+    entities.clear();
+    engine_t::instance->spatial_system.query_frustum(frustum, &entities);
 
-    entity_manager_t::default_manager->iterate_nodes<render_model_component_t, position_component_t, orientation_component_t>(2, [](int entity, render_model_component_t *model_component, position_component_t *pos, orientation_component_t *orientation)
+    // items sharing a model end up in the same group and are drawn instanced
+    renderh_clear_model_groups(groups);
+    for (int i = 0; i < (int)entities.size(); i++)
     {
-        item_t item;
-        item.entity = entity;
-        item.model_matrix = mat4_t<>::translation(pos->xyz);
+        int entity = entities[i];
+        render_model_component_t *model_component = entity_manager_t::default_manager->get_component<render_model_component_t>(entity);
+        if (model_component == NULL)
+        {
+            continue;
+        }
+        position_component_t *pos = entity_manager_t::default_manager->get_component<position_component_t>(entity);
+        orientation_component_t *orientation = entity_manager_t::default_manager->get_component<orientation_component_t>(entity);
+
+        mat4_t<> model_matrix = mat4_t<>::translation(pos->xyz);
         if (orientation)
         {
-            item.model_matrix *= orientation->rotation.rotation_matrix();
+            model_matrix *= orientation->rotation.rotation_matrix();
         }
-        item.model = model_component->model;
 
-        HAX_items->push_back(item);
+        renderh_add_to_model_groups(groups, model_component->model, model_matrix, entity);
+    }
+
+    HAX_groups = groups;
+    entity_manager_t::default_manager->iterate_nodes<render_model_instances_component_t>(1, [](int entity, render_model_instances_component_t *instances_component)
+    {
+        if (!instances_component->model_matrices.empty())
+        {
+            renderh_add_instances_to_model_groups(HAX_groups, instances_component->model, instances_component->model_matrices.size(), &instances_component->model_matrices[0], entity);
+        }
     });
+}
+
+// selects and draws the patches of every terrain in the frustum, the lod
+// always follows lod_origin. with a base_id each patch takes one id and
+// the entity of its terrain is appended to entities. returns the number of
+// patches drawn, or recorded into list when it isn't NULL
+static int emit_terrain_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const frustum_t &frustum, const vec3_t<> &lod_origin, int base_id, std::vector<int> *entities)
+{
+    static std::vector<terrain_patch_t> patches;
+    int patch_count = 0;
+
+    entity_list_t terrains = entity_manager_t::default_manager->entities_possessing_component_type(typeid(render_terrain_component_t));
+    for (entity_list_t::const_iterator iter = terrains.begin(); iter != terrains.end(); iter++)
+    {
+        render_terrain_component_t *terrain_component = entity_manager_t::default_manager->get_component<render_terrain_component_t>(*iter);
+        const terrain_t &terrain = *terrain_component->terrain;
+        // hold N to compare with the noise evaluated per pixel
+        bool use_baked_noise = !engine_t::instance->input_system.keys['N'];
+        if (terrain.material->use_baked_noise != use_baked_noise)
+        {
+            terrain.material->use_baked_noise = use_baked_noise;
+            terrain.material->upload_uniforms();
+        }
+
+        patches.clear();
+        terrain_select_patches(terrain, lod_origin, frustum, &patches);
+        terrain_emit_patch_batches(list, eye, terrain, lod_origin, patches, base_id);
+        patch_count += patches.size();
+
+        if (base_id != 0)
+        {
+            entities->insert(entities->end(), patches.size(), *iter);
+            base_id += patches.size();
+        }
+    }
+
+    return patch_count;
+}
+
+static void extract_visible_lights(std::list<light_t> *lights)
+{
+    // :(
+    HAX_lights = lights;
+
     entity_manager_t::default_manager->iterate_nodes<point_light_component_t, position_component_t>(2, [](point_light_component_t *light_component, position_component_t *position)
     {
         light_t light;
         light.type = 0;
         light.position = position->xyz;
         light.color = light_component->color;
-        light.shadow_map = NULL;
-        light.shadow_fbo = NULL;
+        light.radius = light_component->radius;
+        light.shadow_maps = NULL;
+        light.shadow_map_count = 0;
 
         HAX_lights->push_back(light);
     });
@@ -302,25 +522,21 @@ static void extract_visible_stuff(const renderh_camera_t &camera, std::list<item
         light.light_projection = light_eye.projection;
         light.position = position->xyz;
         light.color = light_component->color;
-        if (shadow == NULL)
-        {
-            light.shadow_fbo = NULL;
-        }
-        else
-        {
-            light.shadow_fbo = shadow->shadow_fbo;
-        }
+        light.radius = light_component->radius;
+        light.shadow_maps = shadow ? &shadow->shadow_map : NULL;
+        light.shadow_map_count = shadow ? 1 : 0;
 
         HAX_lights->push_back(light);
     });
-    entity_manager_t::default_manager->iterate_nodes<directional_light_component_t>(1, [](directional_light_component_t *light_component)
+    entity_manager_t::default_manager->iterate_nodes<directional_light_component_t, cascaded_shadow_caster_component_t>(1, [](directional_light_component_t *light_component, cascaded_shadow_caster_component_t *shadow)
     {
         light_t light;
         light.type = 2;
         light.direction = light_component->direction;
         light.color = light_component->color;
-        light.shadow_map = NULL;
-        light.shadow_fbo = NULL;
+        light.shadow_maps = shadow ? shadow->cascades : NULL;
+        light.shadow_map_count = shadow ? SHADOW_CASCADE_COUNT : 0;
+        light.shadow_distance = shadow ? shadow->max_distance : 0.0f;
 
         HAX_lights->push_back(light);
     });
@@ -379,12 +595,162 @@ void rendering_emit_ssao_fullscreen_quad_batch(const renderl_texture_t &depth_te
     renderl_push_batch(batch);
 }
 
-static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const light_t &light, const renderl_texture_t &position_texture, const renderl_texture_t &normal_texture, const renderl_texture_t &diffuse_texture, const renderl_texture_t &specular_texture, const renderl_texture_t *depth_texture)
+// -1 once the atlas is full
+static int allocate_shadow_tile()
+{
+    if (shadow_atlas.tile_count == SHADOW_TILES_PER_ROW * SHADOW_TILES_PER_ROW)
+    {
+        return -1;
+    }
+    return shadow_atlas.tile_count++;
+}
+
+// offset and size of the tile in atlas texture coordinates
+static vec4_t<> shadow_tile_rect(int tile)
+{
+    float size = (float)SHADOW_TILE_SIZE / SHADOW_ATLAS_SIZE;
+    return vec4_t<>(size * (tile % SHADOW_TILES_PER_ROW), size * (tile / SHADOW_TILES_PER_ROW), size, size);
+}
+
+// draws the casters in the frustum of eye into the tile of the bound atlas,
+// the rest of the atlas is left alone
+static void render_shadow_tile(int tile, const renderm_eye_t &eye, const vec3_t<> &lod_origin, renderh_cull_stats_t *stats)
+{
+    static std::vector<renderh_model_group_t> candidate_groups;
+    static std::vector<renderh_model_group_t> groups;
+
+    frustum_t frustum = frustum_from_matrix(eye.projection * eye.view);
+    extract_model_groups(frustum, &candidate_groups);
+    renderh_cull_model_groups(frustum, candidate_groups, &groups, stats);
+
+    int x = SHADOW_TILE_SIZE * (tile % SHADOW_TILES_PER_ROW);
+    int y = SHADOW_TILE_SIZE * (tile / SHADOW_TILES_PER_ROW);
+    glViewport(x, y, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, y, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    for (int i = 0; i < (int)groups.size(); i++)
+    {
+        renderh_emit_model_group_batches(NULL, eye, groups[i], 0);
+    }
+    emit_terrain_batches(NULL, eye, frustum, lod_origin, 0, NULL);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+// slice i of the camera frustum up to max_distance, splits blend a
+// logarithmic and a uniform distribution
+static void cascade_range(const renderm_eye_t &camera_eye, float max_distance, int i, float *near, float *far)
+{
+    const float lambda = 0.75f;
+    float camera_near = camera_eye.projection.c[14] / (camera_eye.projection.c[10] - 1.0f);
+    for (int j = 0; j < 2; j++)
+    {
+        float f = (float)(i + j) / SHADOW_CASCADE_COUNT;
+        float split = lambda * camera_near * powf(max_distance / camera_near, f) + (1.0f - lambda) * (camera_near + (max_distance - camera_near) * f);
+        *(j == 0 ? near : far) = split;
+    }
+}
+
+// orthographic eye looking along direction at a sphere around the slice
+// [near, far] of the camera frustum. the sphere keeps its size as the camera
+// turns and its center is snapped to whole texels, so the shadow edges
+// don't shimmer as the camera moves
+static renderm_eye_t cascade_eye(const renderm_eye_t &camera_eye, const vec3_t<> &direction, float near, float far)
+{
+    // casters this far beyond the slice towards the light still shadow it
+    const float caster_range = 200.0f;
+
+    // the slice corners are symmetric around the view axis
+    float sx = 1.0f / camera_eye.projection.c[0];
+    float sy = 1.0f / camera_eye.projection.c[5];
+    float near_r2 = near * near * (sx * sx + sy * sy);
+    float far_r2 = far * far * (sx * sx + sy * sy);
+    // center depth equidistant to the near and far corners, clamped to the slice
+    float z = 0.5f * (far + near) + 0.5f * (far_r2 - near_r2) / (far - near);
+    z = fminf(z, far);
+    float radius = sqrtf(fmaxf((z - near) * (z - near) + near_r2, (far - z) * (far - z) + far_r2));
+    radius = ceilf(radius * 16.0f) / 16.0f;
+    vec3_t<> center = (camera_eye.view.inverted() * vec4_t<>(0.0f, 0.0f, -z, 1.0f)).xyz();
+
+    vec3_t<> up(0.0f, 1.0f, 0.0f);
+    if (fabsf(direction.y) > 0.99f)
+    {
+        up = vec3_t<>(1.0f, 0.0f, 0.0f);
+    }
+    vec3_t<> side = direction.cross(up).normalized();
+    up = side.cross(direction);
+
+    renderm_eye_t eye;
+    eye.view = mat4_t<>::lookat(vec3_t<>(0.0f, 0.0f, 0.0f), direction, up);
+
+    vec3_t<> c = (eye.view * vec4_t<>(center, 1.0f)).xyz();
+    float texel = 2.0f * radius / SHADOW_TILE_SIZE;
+    c.x = floorf(c.x / texel) * texel;
+    c.y = floorf(c.y / texel) * texel;
+    eye.projection = mat4_t<>::orthogonal(c.x - radius, c.x + radius, c.y - radius, c.y + radius, -c.z - radius - caster_range, -c.z + radius);
+    return eye;
+}
+
+// true if the tile has never been drawn, the light matrix changed or
+// something moved inside the light frustum since it was drawn
+static bool shadow_tile_is_stale(const shadow_map_t &shadow, const mat4_t<> &view_projection)
+{
+    return !shadow.valid || shadow.dirty || memcmp(shadow.view_projection.c, view_projection.c, sizeof(view_projection.c)) != 0;
+}
+
+static void mark_dirty_shadow_map(shadow_map_t *shadow)
+{
+    if (!shadow->valid || shadow->dirty)
+    {
+        return;
+    }
+
+    frustum_t frustum = frustum_from_matrix(shadow->view_projection);
+    const std::vector<aabb_t> &changed = engine_t::instance->spatial_system.changed_boxes();
+    for (int i = 0; i < (int)changed.size(); i++)
+    {
+        if (frustum_test_box(frustum, changed[i].low, changed[i].high))
+        {
+            shadow->dirty = true;
+            return;
+        }
+    }
+}
+
+// the changed boxes are only those of the last spatial update, so every
+// drawn tile takes note of them every frame, also the ones not due for a
+// redraw and those of lights out of view
+static void mark_dirty_shadow_maps()
+{
+    if (engine_t::instance->spatial_system.changed_boxes().empty())
+    {
+        return;
+    }
+
+    entity_manager_t::default_manager->iterate_nodes<shadow_caster_component_t>(1, [](shadow_caster_component_t *shadow)
+    {
+        mark_dirty_shadow_map(&shadow->shadow_map);
+    });
+    entity_manager_t::default_manager->iterate_nodes<cascaded_shadow_caster_component_t>(1, [](cascaded_shadow_caster_component_t *shadow)
+    {
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        {
+            mark_dirty_shadow_map(&shadow->cascades[i]);
+        }
+    });
+}
+
+// with use_light_volume, point and spot lights rasterize the back faces of a
+// sphere or cone around their radius instead of a fullscreen quad. the depth
+// test passes where the scene lies in front of the back face, so only pixels
+// with geometry inside the volume's screen footprint are shaded
+static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const light_t &light, const renderl_texture_t &position_texture, const renderl_texture_t &normal_texture, const renderl_texture_t &diffuse_texture, const renderl_texture_t &specular_texture, bool use_light_volume)
 {
     static struct
     {
         mat4_t<> projection;
         mat4_t<> view;
+        mat4_t<> model;
     } vertex_parameters;
 
     static struct
@@ -401,7 +767,12 @@ static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const lig
         vec3_t<> light_direction;
         float dummy1;
         vec3_t<> light_color;
+        float radius;
+        vec2_t<> screen_size;
+        int shadow_map_count;
         float dummy2;
+        mat4_t<> shadow_matrices[SHADOW_CASCADE_COUNT];
+        vec4_t<> shadow_rects[SHADOW_CASCADE_COUNT];
     } fragment_parameters;
 
     vertex_parameters.projection = eye.projection;
@@ -414,6 +785,8 @@ static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const lig
     fragment_parameters.light_position = light.position;
     fragment_parameters.light_direction = light.direction;
     fragment_parameters.light_color = light.color;
+    fragment_parameters.radius = light.radius;
+    fragment_parameters.screen_size = vec2_t<>(window_width, window_height);
 
     renderl_batch_t batch = create_default_batch();
 
@@ -429,20 +802,68 @@ static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const lig
     batch.textures[1] = &normal_texture;
     batch.textures[2] = &diffuse_texture;
     batch.textures[3] = &specular_texture;
-    if (depth_texture != NULL)
+    // every drawn shadow map with the matrix it was drawn with, which may
+    // be a few frames old for distant cascades
+    fragment_parameters.shadow_map_count = 0;
+    mat4_t<> inverse_view = eye.view.inverted();
+    for (int i = 0; i < light.shadow_map_count; i++)
+    {
+        const shadow_map_t &shadow_map = light.shadow_maps[i];
+        if (shadow_map.tile == -1 || !shadow_map.valid)
+        {
+            continue;
+        }
+        int n = fragment_parameters.shadow_map_count++;
+        fragment_parameters.shadow_matrices[n] = shadow_map.view_projection * inverse_view;
+        fragment_parameters.shadow_rects[n] = shadow_tile_rect(shadow_map.tile);
+    }
+    if (fragment_parameters.shadow_map_count > 0)
     {
         batch.texture_count = 5;
-        batch.textures[4] = depth_texture;
+        batch.textures[4] = &shadow_atlas.fbo.depth_texture;
     }
 
-    batch.vertex_buffer_count = 2;
-    batch.vertex_buffers[0] = &fullscreen_quad.position_buffer;
-    batch.vertex_buffers[1] = &fullscreen_quad.tex_coord_buffer;
-    batch.index_buffer = &fullscreen_quad.index_buffer;
-    batch.index_count = fullscreen_quad.index_count;
-    batch.primitive_type = fullscreen_quad.primitive_type;
+    if (use_light_volume && light.type != 2)
+    {
+        const renderm_mesh_t *mesh;
+        if (light.type == 0)
+        {
+            mesh = &light_sphere_mesh;
+            vertex_parameters.model = mat4_t<>::translation(light.position) * mat4_t<>::scale(vec3_t<>(light.radius, light.radius, light.radius));
+        }
+        else
+        {
+            // widen the cone to the ellipse length(projected.xy) = 1 of the lens
+            mesh = &light_cone_mesh;
+            vec3_t<> s(light.radius / light.light_projection.c[0], light.radius / light.light_projection.c[5], light.radius);
+            vertex_parameters.model = light.light_view.inverted() * mat4_t<>::scale(s);
+        }
+
+        batch.program = apply_light_volume_program;
+        batch.vertex_format = &mesh->vertex_format;
+        batch.vertex_buffer = &mesh->vertex_buffer;
+        batch.index_buffer = &mesh->index_buffer;
+        batch.index_count = mesh->index_count;
+        batch.primitive_type = mesh->primitive_type;
+
+        // back faces also cover the screen when the camera is inside the volume
+        batch.use_depth_test = true;
+        batch.depth_func = GL_GEQUAL;
+        batch.disable_depth_write = true;
+        batch.use_front_face_culling = true;
+    }
+    else
+    {
+        batch.vertex_buffer_count = 2;
+        batch.vertex_buffers[0] = &fullscreen_quad.position_buffer;
+        batch.vertex_buffers[1] = &fullscreen_quad.tex_coord_buffer;
+        batch.index_buffer = &fullscreen_quad.index_buffer;
+        batch.index_count = fullscreen_quad.index_count;
+        batch.primitive_type = fullscreen_quad.primitive_type;
+
+        batch.use_depth_test = false;
+    }
 
-    batch.use_depth_test = false;
     batch.use_blending = true;
     batch.src_blend_func = GL_ONE;
     batch.dst_blend_func = GL_ONE;
@@ -451,65 +872,63 @@ static void rendering_emit_apply_light_batch(const renderm_eye_t &eye, const lig
 }
 
 
-static void renderer_emit_picking_id_batches(const renderm_eye_t &eye, const mat4_t<> &model_matrix, int id, const renderh_model_t &model)
+static void rendering_emit_clustered_light_batch(const renderl_texture_t &position_texture, const renderl_texture_t &normal_texture, const renderl_texture_t &diffuse_texture, const renderl_texture_t &specular_texture)
 {
     static struct
     {
         mat4_t<> projection;
         mat4_t<> view;
-        mat4_t<> model;
     } vertex_parameters;
 
     static struct
     {
-        float idr, idg, idb, ida;
+        vec2_t<> screen_size;
+        float near;
+        float far;
+        vec3_t<> cluster_counts;
+        float light_texture_height;
+        vec2_t<> index_texture_size;
+        vec2_t<> dummy0;
     } fragment_parameters;
 
-    vertex_parameters.projection = eye.projection;
-    vertex_parameters.view = eye.view;
-    vertex_parameters.model = model_matrix;
-
-    int idr = id % 256;
-    id /= 256;
-    int idg = id % 256;
-    id /= 256;
-    int idb = id % 256;
-    id /= 256;
-    int ida = id % 256;
-    id /= 256;
-
-    fragment_parameters.idr = idr / 255.0f;
-    fragment_parameters.idg = idg / 255.0f;
-    fragment_parameters.idb = idb / 255.0f;
-    fragment_parameters.ida = ida / 255.0f;
-
-    for (int i = 0; i < model.mesh_count; i++)
-    {
-        const renderm_mesh_t &mesh = *model.meshes[i];
+    fragment_parameters.screen_size = vec2_t<>(window_width, window_height);
+    fragment_parameters.near = lightgrid.near;
+    fragment_parameters.far = lightgrid.far;
+    fragment_parameters.cluster_counts = vec3_t<>(LIGHTGRID_TILES_X, LIGHTGRID_TILES_Y, LIGHTGRID_SLICES);
+    fragment_parameters.light_texture_height = LIGHTGRID_MAX_LIGHTS;
+    fragment_parameters.index_texture_size = vec2_t<>(LIGHTGRID_INDEX_TEXTURE_WIDTH, LIGHTGRID_INDEX_TEXTURE_HEIGHT);
 
-        renderl_batch_t batch = create_default_batch();
+    renderl_batch_t batch = create_default_batch();
 
-        batch.program = picking_program;
+    batch.program = clustered_light_program;
 
-        batch.vertex_parameters = &vertex_parameters;
-        batch.vertex_parameters_size = sizeof(vertex_parameters);
-        batch.fragment_parameters = &fragment_parameters;
-        batch.fragment_parameters_size = sizeof(fragment_parameters);
+    batch.vertex_parameters = &vertex_parameters;
+    batch.vertex_parameters_size = sizeof(vertex_parameters);
+    batch.fragment_parameters = &fragment_parameters;
+    batch.fragment_parameters_size = sizeof(fragment_parameters);
 
-        batch.texture_count = 0;
+    batch.texture_count = 7;
+    batch.textures[0] = &position_texture;
+    batch.textures[1] = &normal_texture;
+    batch.textures[2] = &diffuse_texture;
+    batch.textures[3] = &specular_texture;
+    batch.textures[4] = &lightgrid.light_texture;
+    batch.textures[5] = &lightgrid.cluster_texture;
+    batch.textures[6] = &lightgrid.index_texture;
 
-        batch.vertex_buffer_count = 1;
-        batch.vertex_buffers[0] = &mesh.position_buffer;
-        batch.index_buffer = &mesh.index_buffer;
-        batch.index_count = mesh.index_count;
-        batch.primitive_type = mesh.primitive_type;
+    batch.vertex_buffer_count = 2;
+    batch.vertex_buffers[0] = &fullscreen_quad.position_buffer;
+    batch.vertex_buffers[1] = &fullscreen_quad.tex_coord_buffer;
+    batch.index_buffer = &fullscreen_quad.index_buffer;
+    batch.index_count = fullscreen_quad.index_count;
+    batch.primitive_type = fullscreen_quad.primitive_type;
 
-        batch.use_depth_test = true;
-        batch.use_blending = false;
-        batch.use_back_face_culling = true;
+    batch.use_depth_test = false;
+    batch.use_blending = true;
+    batch.src_blend_func = GL_ONE;
+    batch.dst_blend_func = GL_ONE;
 
-        renderl_push_batch(batch);
-    }
+    renderl_push_batch(batch);
 }
 
 static void renderer_emit_billboard_batch(const renderm_eye_t &eye, const vec3_t<> &position, const renderl_texture_t *texture)
@@ -622,8 +1041,8 @@ static void renderer_emit_draw_skydome_batch(const renderm_eye_t &eye)
     batch.texture_count = 1;
     batch.textures[0] = skydome_texture;
 
-    batch.vertex_buffer_count = 1;
-    batch.vertex_buffers[0] = &skydome_mesh.position_buffer;
+    batch.vertex_format = &skydome_mesh.vertex_format;
+    batch.vertex_buffer = &skydome_mesh.vertex_buffer;
     batch.index_buffer = &skydome_mesh.index_buffer;
     batch.index_count = skydome_mesh.index_count;
     batch.primitive_type = skydome_mesh.primitive_type;
@@ -635,7 +1054,7 @@ static void renderer_emit_draw_skydome_batch(const renderm_eye_t &eye)
     renderl_push_batch(batch);
 }
 
-static void renderer_emit_draw_water_batch(const renderm_eye_t &eye, const vec3_t<> &light_direction, const mat4_t<> &model, const renderm_mesh_t &water_mesh)
+static void renderer_emit_draw_water_batch(const renderm_eye_t &eye, const vec3_t<> &light_direction, const mat4_t<> &model, const renderm_mesh_t &water_mesh, const renderl_texture_t &position_texture, const renderl_texture_t &scene_texture)
 {
     // investigate why this needs to be static??
     static struct
@@ -675,13 +1094,12 @@ static void renderer_emit_draw_water_batch(const renderm_eye_t &eye, const vec3_
     batch.fragment_parameters_size = sizeof(fragment_parameters);
 
     batch.texture_count = 3;
-    batch.textures[0] = &pre_deferred_fbo.textures[0];
-    batch.textures[1] = &post_deferred_fbo.textures[0];
+    batch.textures[0] = &position_texture;
+    batch.textures[1] = &scene_texture;
     batch.textures[2] = skydome_texture;
 
-    batch.vertex_buffer_count = 2;
-    batch.vertex_buffers[0] = &water_mesh.position_buffer;
-    batch.vertex_buffers[1] = &water_mesh.normal_buffer;
+    batch.vertex_format = &water_mesh.vertex_format;
+    batch.vertex_buffer = &water_mesh.vertex_buffer;
     batch.index_buffer = &water_mesh.index_buffer;
     batch.index_count = water_mesh.index_count;
     batch.primitive_type = water_mesh.primitive_type;
@@ -693,199 +1111,339 @@ static void renderer_emit_draw_water_batch(const renderm_eye_t &eye, const vec3_
     renderl_push_batch(batch);
 }
 
-void blur(int width, int height, float *in, float *out)
+// runs program once over every pixel of the bound frame buffer
+static void rendering_emit_fullscreen_program_batch(const renderl_program_t *program, const void *fragment_parameters, int fragment_parameters_size, int texture_count, const renderl_texture_t *const *textures)
 {
-    for (int y = 0; y < height; y++)
-    {
-        for (int x = 0; x < width; x++)
-        {
-            float ar = 0.0f;
-            float ag = 0.0f;
-            float ab = 0.0f;
+    renderl_batch_t batch = create_default_batch();
 
-            for (int dy = -1; dy <= 1; dy += 2)
-            {
-                for (int dx = -1; dx <= 1; dx += 2)
-                {
-                    int rindex = ((x + dx) + (y + dy) * width) * 3;
-                    ar += in[rindex + 0];
-                    ag += in[rindex + 1];
-                    ab += in[rindex + 2];
-                }
-            }
+    batch.program = program;
 
-            int windex = (x + y * width) * 3;
-            out[windex + 0] = 0.25f * ar;
-            out[windex + 1] = 0.25f * ag;
-            out[windex + 2] = 0.25f * ab;
-        }
+    batch.vertex_parameters = NULL;
+    batch.vertex_parameters_size = 0;
+    batch.fragment_parameters = fragment_parameters;
+    batch.fragment_parameters_size = fragment_parameters_size;
+
+    batch.texture_count = texture_count;
+    for (int i = 0; i < texture_count; i++)
+    {
+        batch.textures[i] = textures[i];
     }
+
+    batch.vertex_buffer_count = 2;
+    batch.vertex_buffers[0] = &fullscreen_quad.position_buffer;
+    batch.vertex_buffers[1] = &fullscreen_quad.tex_coord_buffer;
+    batch.index_buffer = &fullscreen_quad.index_buffer;
+    batch.index_count = fullscreen_quad.index_count;
+    batch.primitive_type = fullscreen_quad.primitive_type;
+
+    batch.use_depth_test = false;
+
+    renderl_push_batch(batch);
 }
 
-void render_system_t::update(float dt)
+// evaluates the static noise of the terrain shading once, at twice the
+// heightmap resolution so it stays as smooth as the procedural version
+void render_system_t::bake_terrain_noise(terrain_material_t *material)
 {
-    std::list<item_t> visible_items;
-    std::list<light_t> visible_lights;
-
-    entity_list_t players = entity_manager_t::default_manager->entities_possessing_component_type(typeid(player_component_t));
-    assert(players.size() == 1);
-    int player_entity = *players.begin();
-    position_component_t *position = entity_manager_t::default_manager->get_component<position_component_t>(player_entity);
-    orientation_component_t *orientation = entity_manager_t::default_manager->get_component<orientation_component_t>(player_entity);
-    assert(position);
-    assert(orientation);
+    static struct
+    {
+        vec3_t<> xyz_low;
+        float dummy0;
+        vec3_t<> xyz_high;
+        float dummy1;
+        vec2_t<> heightmap_size;
+    } fragment_parameters;
 
-    renderh_camera_t camera;
-    camera.position = position->xyz;
-    camera.forward = orientation->rotation.forward();
-    camera.right = orientation->rotation.right();
-    camera.up = orientation->rotation.up();
+    fragment_parameters.xyz_low = material->xyz_low;
+    fragment_parameters.xyz_high = material->xyz_high;
+    fragment_parameters.heightmap_size = material->heightmap_size;
 
-    renderm_eye_t camera_eye = renderh_camera_to_eye(camera);
-    HAX_camera_eye = &camera_eye;
+    int width = 2 * (int)material->heightmap_size.x;
+    int height = 2 * (int)material->heightmap_size.y;
+    renderl_frame_buffer_t fbo = renderl_create_frame_buffer(width, height, 1, GL_R16F, false);
+    renderl_bind_frame_buffer(&fbo);
+    const renderl_texture_t *textures[1] = { material->heightmap_texture };
+    rendering_emit_fullscreen_program_batch(terrain_noise_bake_program, &fragment_parameters, sizeof(fragment_parameters), 1, textures);
+    renderl_bind_frame_buffer(NULL);
 
-    extract_visible_stuff(camera, &visible_items, &visible_lights);
+    if (material->baked_noise.handle != 0)
+    {
+        renderl_delete_texture(material->baked_noise);
+    }
+    material->baked_noise = fbo.textures[0];
+    renderl_delete_frame_buffer(fbo);
+    material->upload_uniforms();
+}
 
-    // first, generate all shadow maps
-    for (std::list<light_t>::const_iterator iter = visible_lights.begin(); iter != visible_lights.end(); iter++)
+// brings the shadow map tiles that went stale up to date. cascade i of a
+// directional light is redrawn at most every 2^i frames
+static void shadow_pass(const render_graph_t &graph, void *user_data)
+{
+    shadow_frame++;
+    mark_dirty_shadow_maps();
+    for (std::list<light_t>::const_iterator iter = frame.visible_lights.begin(); iter != frame.visible_lights.end(); iter++)
     {
         const light_t &light = *iter;
-        if (light.shadow_fbo != NULL)
+        for (int i = 0; i < light.shadow_map_count; i++)
         {
+            shadow_map_t &shadow_map = light.shadow_maps[i];
+            if (shadow_map.tile == -1)
+            {
+                shadow_map.tile = allocate_shadow_tile();
+                if (shadow_map.tile == -1)
+                {
+                    continue;
+                }
+            }
+
             renderm_eye_t light_eye;
-            light_eye.projection = light.light_projection;
-            light_eye.view = light.light_view;
+            vec3_t<> lod_origin;
+            if (light.type == 2)
+            {
+                int period = 1 << i;
+                if (shadow_map.valid && shadow_frame % period != i % period)
+                {
+                    continue;
+                }
 
-            renderl_bind_frame_buffer(light.shadow_fbo);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            for (std::list<item_t>::const_iterator iter = visible_items.begin(); iter != visible_items.end(); iter++)
+                float near, far;
+                cascade_range(frame.camera_eye, light.shadow_distance, i, &near, &far);
+                light_eye = cascade_eye(frame.camera_eye, light.direction, near, far);
+                lod_origin = frame.camera.position;
+            }
+            else
             {
-                const item_t &item = *iter;
-                renderh_emit_model_batches(light_eye, item.model_matrix, *item.model);
+                light_eye.projection = light.light_projection;
+                light_eye.view = light.light_view;
+                // terrain lod from the light keeps the tile valid while the camera moves
+                lod_origin = light.position;
             }
-            renderl_bind_frame_buffer(NULL);
 
-            if (engine_t::instance->input_system.keys['K'])
+            mat4_t<> view_projection = light_eye.projection * light_eye.view;
+            if (!shadow_tile_is_stale(shadow_map, view_projection))
             {
-                rendering_emit_fullscreen_quad_batch(light.shadow_fbo->depth_texture);
-                return;
+                continue;
             }
+
+            render_shadow_tile(shadow_map.tile, light_eye, lod_origin, &frame.shadow_stats);
+            shadow_map.view_projection = view_projection;
+            shadow_map.valid = true;
+            shadow_map.dirty = false;
+            frame.shadow_tiles_drawn++;
         }
     }
+}
 
-    // do some picking
-    if (mouse_x >= 0 && mouse_x < window_width && mouse_y >= 0 && mouse_y < window_height)
-    {
-        int rendered_models = 0;
-
-        int pick_x = mouse_x;
-        int pick_y = window_height - mouse_y - 1;
+static void shadow_atlas_view_pass(const render_graph_t &graph, void *user_data)
+{
+    rendering_emit_fullscreen_quad_batch(render_graph_texture(graph, frame.shadow_atlas));
+}
 
-        glScissor(pick_x, pick_y, 1, 1);
-        glEnable(GL_SCISSOR_TEST);
+static void gbuffer_pass(const render_graph_t &graph, void *user_data)
+{
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 1, 0xffffffff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    for (int i = 0; i < (int)frame.camera_commands.size(); i++)
+    {
+        renderl_replay_command_list(frame.camera_commands[i]);
+    }
+    renderl_begin_timer(&terrain_timer);
+    renderl_replay_command_list(frame.terrain_commands);
+    renderl_end_timer(&terrain_timer);
+    glDisable(GL_STENCIL_TEST);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        for (std::list<item_t>::const_iterator iter = visible_items.begin(); iter != visible_items.end(); iter++)
+    // queue a read of the id under the cursor, skipped while the gpu is
+    // still behind on the slot
+    pick_frame = (pick_frame + 1) % PICK_SLOT_COUNT;
+    if (mouse_x >= 0 && mouse_x < window_width && mouse_y >= 0 && mouse_y < window_height && pick_slots[pick_frame].readback.fence == NULL)
+    {
+        std::vector<int> &entities = pick_slots[pick_frame].entities;
+        entities.clear();
+        for (int i = 0; i < (int)frame.camera_groups.size(); i++)
         {
-            const item_t &item = *iter;
-            renderer_emit_picking_id_batches(camera_eye, item.model_matrix, item.entity, *item.model);
+            entities.insert(entities.end(), frame.camera_groups[i].ids.begin(), frame.camera_groups[i].ids.end());
         }
-        glDisable(GL_SCISSOR_TEST);
-        glScissor(0, 0, window_width, window_height);
-
-        unsigned char res[4];
-        glReadPixels(pick_x, pick_y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &res);
-        int id = 0;
-        id += res[3];
-        id *= 256;
-        id += res[2];
-        id *= 256;
-        id += res[1];
-        id *= 256;
-        id += res[0];
-
-        //printf("(%d, %d): %d\n", pick_x, pick_y, id);
+        entities.insert(entities.end(), frame.terrain_entities.begin(), frame.terrain_entities.end());
+
+        glReadBuffer(GL_COLOR_ATTACHMENT4);
+        renderl_start_readback(&pick_slots[pick_frame].readback, mouse_x, window_height - mouse_y - 1, 1, 1, GL_RED, GL_FLOAT);
     }
 
-    renderl_bind_frame_buffer(&pre_deferred_fbo);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_ALWAYS, 1, 0xffffffff);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-    for (std::list<item_t>::const_iterator iter = visible_items.begin(); iter != visible_items.end(); iter++)
+    if (engine_t::instance->input_system.keys['C'])
     {
-        const item_t &item = *iter;
-        renderh_emit_model_batches(camera_eye, item.model_matrix, *item.model);
+        printf("culling: camera %d drawn, %d culled. shadows %d drawn, %d culled in %d tiles. %d terrain patches in %.2f ms (%s noise)\n", frame.camera_stats.drawn, frame.camera_stats.culled, frame.shadow_stats.drawn, frame.shadow_stats.culled, frame.shadow_tiles_drawn, frame.camera_patch_count, terrain_timer.milliseconds, engine_t::instance->input_system.keys['N'] ? "procedural" : "baked");
+        printf("render graph: %d passes, %d culled. %d transient targets in %d textures\n", (int)graph.passes.size(), graph.culled_pass_count, graph.transient_count, (int)graph.pool.size());
     }
-    glDisable(GL_STENCIL_TEST);
-    renderl_bind_frame_buffer(NULL);
 
-    renderl_bind_frame_buffer(&post_deferred_fbo);
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);// | GL_DEPTH_BUFFER_BIT);
-    glClearColor(0.0, 0.0, 0.0, 1.0);
+    // compare the gpu pick with a cpu ray cast through the cursor
+    if (engine_t::instance->input_system.keys['P'])
+    {
+        vec3_t<> origin, direction;
+        picking_window_ray(frame.camera_eye, mouse_x, mouse_y, window_width, window_height, &origin, &direction);
+        picking_hit_t hit;
+        if (picking_cast_ray(origin, direction, 300.0f, &hit))
+        {
+            printf("picking: gpu %d, cpu %d at %.2f\n", picked_entity, hit.entity, hit.t);
+        }
+        else
+        {
+            printf("picking: gpu %d, cpu nothing\n", picked_entity);
+        }
+    }
+}
+
+static void lighting_pass(const render_graph_t &graph, void *user_data)
+{
+    const renderl_texture_t &position_texture = render_graph_texture(graph, frame.gbuffer[0]);
+    const renderl_texture_t &normal_texture = render_graph_texture(graph, frame.gbuffer[1]);
+    const renderl_texture_t &diffuse_texture = render_graph_texture(graph, frame.gbuffer[2]);
+    const renderl_texture_t &specular_texture = render_graph_texture(graph, frame.gbuffer[3]);
+
     glEnable(GL_STENCIL_TEST);
     glStencilFunc(GL_EQUAL, 1, 0xffffffff);
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    for (std::list<light_t>::const_iterator iter = visible_lights.begin(); iter != visible_lights.end(); iter++)
+    static std::vector<lightgrid_light_t> point_lights;
+    point_lights.clear();
+    for (std::list<light_t>::const_iterator iter = frame.visible_lights.begin(); iter != frame.visible_lights.end(); iter++)
     {
         const light_t &light = *iter;
-        const renderl_texture_t *depth_texture;
-        if (light.shadow_fbo == NULL)
-        {
-            depth_texture = NULL;
-        }
-        else
+        // holding V shades point lights with light volumes instead of the clusters
+        if (light.type == 0 && !engine_t::instance->input_system.keys['V'])
         {
-            depth_texture = &light.shadow_fbo->depth_texture;
+            lightgrid_light_t point_light;
+            point_light.position = (frame.camera_eye.view * vec4_t<>(light.position, 1.0f)).xyz();
+            point_light.radius = light.radius;
+            point_light.color = light.color;
+            point_lights.push_back(point_light);
+            continue;
         }
-        rendering_emit_apply_light_batch(camera_eye, light, pre_deferred_fbo.textures[0], pre_deferred_fbo.textures[1], pre_deferred_fbo.textures[2], pre_deferred_fbo.textures[3], depth_texture);
+
+        rendering_emit_apply_light_batch(frame.camera_eye, light, position_texture, normal_texture, diffuse_texture, specular_texture, true);
+    }
+    if (!point_lights.empty())
+    {
+        lightgrid_build(&lightgrid, frame.camera_eye.projection, point_lights.size(), &point_lights[0]);
+        rendering_emit_clustered_light_batch(position_texture, normal_texture, diffuse_texture, specular_texture);
     }
 
     // draw skybox
     glEnable(GL_STENCIL_TEST);
     glStencilFunc(GL_EQUAL, 0, 0xffffffff);
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    renderer_emit_draw_skydome_batch(camera_eye);
+    renderer_emit_draw_skydome_batch(frame.camera_eye);
     glDisable(GL_STENCIL_TEST);
+}
 
-    // end by copying the result to dummy_texture
-    glBindTexture(GL_TEXTURE_2D, dummy_texture1.handle);
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
-    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, dummy_texture1.width, dummy_texture1.height);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    renderl_bind_frame_buffer(NULL);
-
-    renderl_bind_frame_buffer(&render_water_fbo);
-    //glClear(GL_COLOR_BUFFER_BIT);
-
-    entity_list_t suns = entity_manager_t::default_manager->entities_possessing_component_type(typeid(sun_component_t));
-    assert(suns.size() == 1);
-    int sun_entity = *suns.begin();
-    directional_light_component_t *light = entity_manager_t::default_manager->get_component<directional_light_component_t>(sun_entity);
-    assert(light);
+// the lit scene with the water surfaces drawn over it
+static void water_pass(const render_graph_t &graph, void *user_data)
+{
+    rendering_emit_fullscreen_quad_batch(render_graph_texture(graph, frame.lit));
 
-    HAX_light_direction = light->direction;
-    
+    HAX_light_direction = frame.sun_direction;
     entity_manager_t::default_manager->iterate_nodes<render_water_surface_component_t, position_component_t>(2, [](render_water_surface_component_t *water_component, position_component_t *pos)
     {
         mat4_t<> model = mat4_t<>::translation(pos->xyz);
-        renderer_emit_draw_water_batch(*HAX_camera_eye, HAX_light_direction, model, *water_component->mesh);
+        renderer_emit_draw_water_batch(*HAX_camera_eye, HAX_light_direction, model, *water_component->mesh, render_graph_texture(render_graph, frame.gbuffer[0]), render_graph_texture(render_graph, frame.lit));
     });
-    renderl_bind_frame_buffer(NULL);
+}
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    rendering_emit_fullscreen_quad_batch(post_deferred_fbo.textures[0]);
-    rendering_emit_fullscreen_quad_batch(render_water_fbo.textures[0]);
-    //renderh_emit_ssao_fullscreen_quad_batch(pre_deferred_fbo.depth_texture);
+// exposure and bloom, see add_postfx_passes
+static const float postfx_key = 0.4f;
+static const float postfx_white = 4.0f;
+static const float postfx_bloom_threshold = 0.8f;
+static const float postfx_bloom_strength = 0.3f;
+// how quickly the exposure follows the scene, per second
+static const float postfx_adaptation_rate = 1.5f;
 
-    glClear(GL_DEPTH_BUFFER_BIT);
+static struct
+{
+    float values[4];
+} postfx_parameters;
+
+// log luminance, averaged down to 1x1 by the mip chain
+static void luminance_pass(const render_graph_t &graph, void *user_data)
+{
+    const renderl_texture_t *textures[1] = { &render_graph_texture(graph, frame.scene) };
+    rendering_emit_fullscreen_program_batch(postfx.luminance_program, NULL, 0, 1, textures);
+    renderl_generate_mipmaps(render_graph_texture(graph, frame.luminance));
+}
+
+// moves the adapted luminance towards the average
+static void adapt_pass(const render_graph_t &graph, void *user_data)
+{
+    postfx_parameters.values[0] = 1.0f - expf(-frame.dt * postfx_adaptation_rate);
+    const renderl_texture_t *textures[2] = { &render_graph_texture(graph, frame.luminance), &render_graph_texture(graph, frame.previous_adapted) };
+    rendering_emit_fullscreen_program_batch(postfx.adapt_program, &postfx_parameters, sizeof(postfx_parameters), 2, textures);
+    postfx.adapted_index = 1 - postfx.adapted_index;
+}
+
+// bright parts of the exposed scene at half resolution
+static void bright_pass(const render_graph_t &graph, void *user_data)
+{
+    postfx_parameters.values[0] = postfx_key;
+    postfx_parameters.values[1] = postfx_bloom_threshold;
+    const renderl_texture_t *textures[2] = { &render_graph_texture(graph, frame.scene), &render_graph_texture(graph, frame.adapted) };
+    rendering_emit_fullscreen_program_batch(postfx.bright_pass_program, &postfx_parameters, sizeof(postfx_parameters), 2, textures);
+}
+
+// bilinear downsample of the blurred level above, user_data is the level
+static void bloom_downsample_pass(const render_graph_t &graph, void *user_data)
+{
+    rendering_emit_fullscreen_quad_batch(render_graph_texture(graph, *(const int *)user_data));
+}
+
+// one direction of the separable blur, user_data is the source resource
+static void bloom_blur_pass(const render_graph_t &graph, void *user_data, float dx, float dy)
+{
+    const renderl_texture_t &source = render_graph_texture(graph, *(const int *)user_data);
+    postfx_parameters.values[0] = dx / source.width;
+    postfx_parameters.values[1] = dy / source.height;
+    const renderl_texture_t *textures[1] = { &source };
+    rendering_emit_fullscreen_program_batch(postfx.blur_program, &postfx_parameters, sizeof(postfx_parameters), 1, textures);
+}
+
+static void bloom_horizontal_pass(const render_graph_t &graph, void *user_data)
+{
+    bloom_blur_pass(graph, user_data, 1.0f, 0.0f);
+}
+
+static void bloom_vertical_pass(const render_graph_t &graph, void *user_data)
+{
+    bloom_blur_pass(graph, user_data, 0.0f, 1.0f);
+}
+
+static void tonemap_pass(const render_graph_t &graph, void *user_data)
+{
+    postfx_parameters.values[0] = postfx_key;
+    postfx_parameters.values[1] = postfx_white;
+    postfx_parameters.values[2] = postfx_bloom_strength;
+    const renderl_texture_t *textures[2 + BLOOM_LEVEL_COUNT];
+    textures[0] = &render_graph_texture(graph, frame.scene);
+    textures[1] = &render_graph_texture(graph, frame.adapted);
+    for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
+    {
+        textures[2 + i] = &render_graph_texture(graph, frame.bloom[i].blurred);
+    }
+    rendering_emit_fullscreen_program_batch(postfx.tonemap_program, &postfx_parameters, sizeof(postfx_parameters), 2 + BLOOM_LEVEL_COUNT, textures);
+}
+
+// the scene without exposure and bloom
+static void present_pass(const render_graph_t &graph, void *user_data)
+{
+    rendering_emit_fullscreen_quad_batch(render_graph_texture(graph, frame.scene));
+}
+
+static void billboard_pass(const render_graph_t &graph, void *user_data)
+{
     entity_manager_t::default_manager->iterate_nodes<sound_source_component_t, position_component_t>(1, [](sound_source_component_t *sound, position_component_t *pos)
     {
         renderer_emit_billboard_batch(*HAX_camera_eye, pos->xyz, speaker_texture);
     });
-    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+static void crosshair_pass(const render_graph_t &graph, void *user_data)
+{
     entity_manager_t::default_manager->iterate_nodes<position_component_t, orientation_component_t>(1, [](position_component_t *pos, orientation_component_t *orientation)
     {
         mat4_t<> model_matrix = mat4_t<>::translation(pos->xyz);
@@ -897,141 +1455,234 @@ void render_system_t::update(float dt)
     });
 }
 
+// exposure and bloom passes up to, not including, the tone mapping. they are
+// declared every frame and culled when nothing reads them
+static void add_postfx_passes(render_graph_t *graph)
+{
+    frame.luminance = render_graph_create_texture(graph, "luminance", 256, 256, GL_R16F);
+    frame.previous_adapted = render_graph_import_texture(graph, "previous adapted", postfx.adapted_fbos[postfx.adapted_index].textures[0], GL_R16F);
+    frame.adapted = render_graph_import_texture(graph, "adapted", postfx.adapted_fbos[1 - postfx.adapted_index].textures[0], GL_R16F);
+    for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
+    {
+        int width = window_width >> (i + 1);
+        int height = window_height >> (i + 1);
+        frame.bloom[i].blurred = render_graph_create_texture(graph, "bloom", width, height, GL_RGBA16F);
+        frame.bloom[i].horizontal = render_graph_create_texture(graph, "bloom horizontal", width, height, GL_RGBA16F);
+        frame.bloom[i].above = i > 0 ? frame.bloom[i - 1].blurred : -1;
+    }
+
+    int pass = render_graph_add_pass(graph, "luminance", luminance_pass, NULL, 0);
+    render_graph_read(graph, pass, frame.scene);
+    render_graph_write(graph, pass, frame.luminance, RENDER_GRAPH_DONT_CARE);
+
+    pass = render_graph_add_pass(graph, "adapt", adapt_pass, NULL, 0);
+    render_graph_read(graph, pass, frame.luminance);
+    render_graph_read(graph, pass, frame.previous_adapted);
+    render_graph_write(graph, pass, frame.adapted, RENDER_GRAPH_DONT_CARE);
+
+    pass = render_graph_add_pass(graph, "bright", bright_pass, NULL, 0);
+    render_graph_read(graph, pass, frame.scene);
+    render_graph_read(graph, pass, frame.adapted);
+    render_graph_write(graph, pass, frame.bloom[0].blurred, RENDER_GRAPH_DONT_CARE);
 
-/*
-    bool hdr = false;
-    if (hdr)
+    for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
     {
-        float *data = new float[window_width * window_height * 3];
-        glBindFramebuffer(GL_FRAMEBUFFER, post_deferred_fbo.handle);
-        glReadBuffer(GL_COLOR_ATTACHMENT0);
-        glReadPixels(0, 0, window_width, window_height, GL_RGB, GL_FLOAT, data);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        float sum = 0.0f;
-        float max = 0.0f;
-        int count = 0;
-        //for (int y = 3 * window_height / 8; y < 5 * window_height / 8; y++)
-        for (int y = 0; y < window_height; y++)
+        if (i > 0)
         {
-            //for (int x = 3 * window_width / 8; x < 5 * window_width / 8; x++)
-            for (int x = 0; x < window_width; x++)
-            {
-                int index = (x + y * window_width) * 3;
-                float r = data[index + 0];
-                float g = data[index + 1];
-                float b = data[index + 2];
-                float luminance = 0.27f * r + 0.67f * g + 0.06f * b;
-                // avoid NaN
-                if (luminance == luminance)
-                {
-                    sum += logf(0.0001f + luminance);
-                    if (luminance > max)
-                    {
-                        max = luminance;
-                    }
-                    count += 1;
-                }
-            }
+            pass = render_graph_add_pass(graph, "bloom downsample", bloom_downsample_pass, &frame.bloom[i].above, 0);
+            render_graph_read(graph, pass, frame.bloom[i].above);
+            render_graph_write(graph, pass, frame.bloom[i].blurred, RENDER_GRAPH_DONT_CARE);
         }
-        float lw = expf(sum / count);//(window_width * window_height));
-        float a = 0.4f;
-        //max = 5000.0f;
-        float lwhite = 0.8f * max;
-        printf("%f\n", max);
-        for (int i = 0; i < window_width * window_height; i++)
+
+        pass = render_graph_add_pass(graph, "bloom horizontal", bloom_horizontal_pass, &frame.bloom[i].blurred, 0);
+        render_graph_read(graph, pass, frame.bloom[i].blurred);
+        render_graph_write(graph, pass, frame.bloom[i].horizontal, RENDER_GRAPH_DONT_CARE);
+
+        pass = render_graph_add_pass(graph, "bloom vertical", bloom_vertical_pass, &frame.bloom[i].horizontal, 0);
+        render_graph_read(graph, pass, frame.bloom[i].horizontal);
+        render_graph_write(graph, pass, frame.bloom[i].blurred, RENDER_GRAPH_DONT_CARE);
+    }
+}
+
+static void cull_camera_group(int index, void *user_data)
+{
+    const std::vector<renderh_model_group_t> &candidate_groups = *(const std::vector<renderh_model_group_t> *)user_data;
+    renderh_cull_stats_t *stats = &frame.camera_group_stats[index];
+    stats->drawn = 0;
+    stats->culled = 0;
+    renderh_cull_model_group(frame.camera_frustum, candidate_groups[index], &frame.camera_groups[index], stats);
+}
+
+static void record_camera_group(int index, void *user_data)
+{
+    renderl_command_list_t *list = &frame.camera_commands[index];
+    renderl_clear_command_list(list);
+    renderh_emit_model_group_batches(list, frame.camera_eye, frame.camera_groups[index], frame.camera_base_ids[index]);
+}
+
+// culls and fills the camera's batches on the workers, a group at a time,
+// so all the g-buffer pass has left to do is replay them. the base ids
+// depend on what survived culling, hence the two rounds
+static void record_camera_batches(const std::vector<renderh_model_group_t> &candidate_groups)
+{
+    int group_count = candidate_groups.size();
+    frame.camera_groups.resize(group_count);
+    frame.camera_group_stats.resize(group_count);
+    frame.camera_base_ids.resize(group_count);
+    frame.camera_commands.resize(group_count);
+    jobs_run(group_count, cull_camera_group, (void *)&candidate_groups);
+
+    // ids are 1 + the running index over all group members, 0 means nothing was hit
+    int base_id = 1;
+    for (int i = 0; i < group_count; i++)
+    {
+        frame.camera_base_ids[i] = base_id;
+        base_id += frame.camera_groups[i].ids.size();
+        frame.camera_stats.drawn += frame.camera_group_stats[i].drawn;
+        frame.camera_stats.culled += frame.camera_group_stats[i].culled;
+    }
+    jobs_run(group_count, record_camera_group, NULL);
+
+    // the terrain goes through the entity manager and hands its lod origin
+    // to the shared material, neither of which is safe on the workers
+    renderl_clear_command_list(&frame.terrain_commands);
+    frame.terrain_entities.clear();
+    frame.camera_patch_count = emit_terrain_batches(&frame.terrain_commands, frame.camera_eye, frame.camera_frustum, frame.camera.position, base_id, &frame.terrain_entities);
+}
+
+void render_system_t::update(float dt)
+{
+    static std::vector<renderh_model_group_t> candidate_groups;
+
+    entity_list_t players = entity_manager_t::default_manager->entities_possessing_component_type(typeid(player_component_t));
+    assert(players.size() == 1);
+    int player_entity = *players.begin();
+    position_component_t *position = entity_manager_t::default_manager->get_component<position_component_t>(player_entity);
+    orientation_component_t *orientation = entity_manager_t::default_manager->get_component<orientation_component_t>(player_entity);
+    assert(position);
+    assert(orientation);
+
+    frame.dt = dt;
+    frame.camera.position = position->xyz;
+    frame.camera.forward = orientation->rotation.forward();
+    frame.camera.right = orientation->rotation.right();
+    frame.camera.up = orientation->rotation.up();
+
+    frame.camera_eye = renderh_camera_to_eye(frame.camera);
+    HAX_camera_eye = &frame.camera_eye;
+
+    frame.visible_lights.clear();
+    extract_visible_lights(&frame.visible_lights);
+
+    renderh_cull_stats_t no_stats = { 0, 0 };
+    frame.camera_stats = no_stats;
+    frame.shadow_stats = no_stats;
+    frame.shadow_tiles_drawn = 0;
+
+    frame.camera_frustum = frustum_from_matrix(frame.camera_eye.projection * frame.camera_eye.view);
+    extract_model_groups(frame.camera_frustum, &candidate_groups);
+    record_camera_batches(candidate_groups);
+
+    entity_list_t suns = entity_manager_t::default_manager->entities_possessing_component_type(typeid(sun_component_t));
+    assert(suns.size() == 1);
+    int sun_entity = *suns.begin();
+    directional_light_component_t *light = entity_manager_t::default_manager->get_component<directional_light_component_t>(sun_entity);
+    assert(light);
+    frame.sun_direction = light->direction;
+
+    // take the newest pick result that has arrived, oldest slots first
+    for (int i = 1; i <= PICK_SLOT_COUNT; i++)
+    {
+        int slot = (pick_frame + i) % PICK_SLOT_COUNT;
+        float value;
+        if (renderl_poll_readback(&pick_slots[slot].readback, &value))
         {
-            int index = i * 3;
-            float r = data[index + 0];
-            float g = data[index + 1];
-            float b = data[index + 2];
-            float luminance = 0.27f * r + 0.67f * g + 0.06f * b;
-
-            // avoid NaN
-            if (luminance == luminance)
-            {
-                float l = a / lw * luminance;
-                float ld = (l * (1 + l / (lwhite*lwhite))) / (1 + l);
-                
-                float scale = 1.5f * ld / luminance;
-                r *= scale;
-                g *= scale;
-                b *= scale;
-                data[index + 0] = r;
-                data[index + 1] = g;
-                data[index + 2] = b;
-            }
+            int id = (int)(value + 0.5f);
+            const std::vector<int> &entities = pick_slots[slot].entities;
+            picked_entity = id > 0 && id <= (int)entities.size() ? entities[id - 1] : -1;
         }
-        float *blur_data1 = new float[window_width * window_height * 3];
-        float *blur_data2 = new float[window_width * window_height * 3];
-        for (int i = 0; i < window_width * window_height; i++)
-        {
-            int index = i * 3;
-            float r = data[index + 0];
-            float g = data[index + 1];
-            float b = data[index + 2];
-            float luminance = 0.27f * r + 0.67f * g + 0.06f * b;
-            float threshold = 0.3f;
-
-            if (luminance != luminance)
-            {
-                data[index + 0] = 0.0f;
-                data[index + 1] = 0.0f;
-                data[index + 2] = 0.0f;
-            }
+    }
 
-            if (luminance > threshold)
-            {
-                r = (luminance - threshold) * r;
-                g = (luminance - threshold) * g;
-                b = (luminance - threshold) * b;
-            }
-            else
-            {
-                r = 0.0f;
-                g = 0.0f;
-                b = 0.0f;
-            }
-            blur_data1[index + 0] = r;
-            blur_data1[index + 1] = g;
-            blur_data1[index + 2] = b;
-        }
+    render_graph_begin(&render_graph);
+    render_graph_t *graph = &render_graph;
+
+    frame.shadow_atlas = render_graph_import_texture(graph, "shadow atlas", shadow_atlas.fbo.depth_texture, GL_DEPTH_COMPONENT24);
+    frame.gbuffer[0] = render_graph_create_texture(graph, "position", window_width, window_height, GL_RGBA16F);
+    frame.gbuffer[1] = render_graph_create_texture(graph, "normal", window_width, window_height, GL_RGBA16F);
+    frame.gbuffer[2] = render_graph_create_texture(graph, "diffuse", window_width, window_height, GL_RGBA16F);
+    frame.gbuffer[3] = render_graph_create_texture(graph, "specular", window_width, window_height, GL_RGBA16F);
+    // ids of the drawn items, exact as floats up to 2^24
+    frame.gbuffer[4] = render_graph_create_texture(graph, "ids", window_width, window_height, GL_R32F);
+    frame.depth = render_graph_create_texture(graph, "depth", window_width, window_height, GL_DEPTH24_STENCIL8);
+    frame.lit = render_graph_create_texture(graph, "lit", window_width, window_height, GL_RGBA16F);
+    frame.scene = render_graph_create_texture(graph, "scene", window_width, window_height, GL_RGBA16F);
+
+    // tiles are kept from frame to frame, their validity is tracked on the cpu
+    int pass = render_graph_add_pass(graph, "shadows", shadow_pass, NULL, RENDER_GRAPH_SIDE_EFFECTS);
+    render_graph_write_depth(graph, pass, frame.shadow_atlas, RENDER_GRAPH_LOAD);
+
+    // sky pixels are never shaded, only what the water pass samples there
+    // and the ids need clearing
+    pass = render_graph_add_pass(graph, "g-buffer", gbuffer_pass, NULL, 0);
+    render_graph_write(graph, pass, frame.gbuffer[0], RENDER_GRAPH_CLEAR);
+    render_graph_write(graph, pass, frame.gbuffer[1], RENDER_GRAPH_DONT_CARE);
+    render_graph_write(graph, pass, frame.gbuffer[2], RENDER_GRAPH_DONT_CARE);
+    render_graph_write(graph, pass, frame.gbuffer[3], RENDER_GRAPH_DONT_CARE);
+    render_graph_write(graph, pass, frame.gbuffer[4], RENDER_GRAPH_CLEAR);
+    render_graph_write_depth(graph, pass, frame.depth, RENDER_GRAPH_CLEAR);
+
+    pass = render_graph_add_pass(graph, "lighting", lighting_pass, NULL, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        render_graph_read(graph, pass, frame.gbuffer[i]);
+    }
+    render_graph_read(graph, pass, frame.shadow_atlas);
+    render_graph_write(graph, pass, frame.lit, RENDER_GRAPH_CLEAR);
+    render_graph_write_depth(graph, pass, frame.depth, RENDER_GRAPH_LOAD);
 
-        for (int i = 0; i < 64; i++)
+    pass = render_graph_add_pass(graph, "water", water_pass, NULL, 0);
+    render_graph_read(graph, pass, frame.gbuffer[0]);
+    render_graph_read(graph, pass, frame.lit);
+    render_graph_write(graph, pass, frame.scene, RENDER_GRAPH_DONT_CARE);
+    render_graph_write_depth(graph, pass, frame.depth, RENDER_GRAPH_LOAD);
+
+    add_postfx_passes(graph);
+
+    if (engine_t::instance->input_system.keys['K'])
+    {
+        // everything but the shadows is culled
+        pass = render_graph_add_pass(graph, "shadow atlas view", shadow_atlas_view_pass, NULL, 0);
+        render_graph_read(graph, pass, frame.shadow_atlas);
+        render_graph_write(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_DONT_CARE);
+    }
+    else
+    {
+        // holding H shows the scene without exposure and bloom
+        if (engine_t::instance->input_system.keys['H'])
         {
-            blur(window_width, window_height, blur_data1, blur_data2);
-            blur(window_width, window_height, blur_data2, blur_data1);
+            pass = render_graph_add_pass(graph, "present", present_pass, NULL, 0);
+            render_graph_read(graph, pass, frame.scene);
         }
-
-        for (int i = 0; i < window_width * window_height; i++)
+        else
         {
-            int index = i * 3;
-            data[index + 0] += blur_data1[index + 0];
-            data[index + 1] += blur_data1[index + 1];
-            data[index + 2] += blur_data1[index + 2];
+            pass = render_graph_add_pass(graph, "tonemap", tonemap_pass, NULL, 0);
+            render_graph_read(graph, pass, frame.scene);
+            render_graph_read(graph, pass, frame.adapted);
+            for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
+            {
+                render_graph_read(graph, pass, frame.bloom[i].blurred);
+            }
         }
+        render_graph_write(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_DONT_CARE);
 
-        delete[] blur_data1;
-        delete[] blur_data2;
-
-        //glDrawBuffer(GL_FRONT);
-        //glDrawPixels(window_width, window_height, GL_RGBA, GL_FLOAT, data);
-        unsigned int temp_tex;
-        glGenTextures(1, &temp_tex);
-        glBindTexture(GL_TEXTURE_2D, temp_tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, window_width, window_height, 0, GL_RGB, GL_FLOAT, data);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        renderl_texture_t temp_texture;
-        temp_texture.handle = temp_tex;
-        temp_texture.width = window_width;
-        temp_texture.height = window_height;
-
-        delete[] data;
-        renderh_emit_fullscreen_quad_batch(temp_texture);
-        glDeleteTextures(1, &temp_tex);
+        pass = render_graph_add_pass(graph, "billboards", billboard_pass, NULL, 0);
+        render_graph_write(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_LOAD);
+        render_graph_write_depth(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_CLEAR);
+
+        pass = render_graph_add_pass(graph, "crosshairs", crosshair_pass, NULL, 0);
+        render_graph_write(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_LOAD);
+        render_graph_write_depth(graph, pass, RENDER_GRAPH_WINDOW, RENDER_GRAPH_CLEAR);
     }
-*/
+
+    render_graph_execute(graph);
+}
@@ -8,6 +8,9 @@ class render_system_t : public system_t
 public:
     void init();
     void update(float dt);
+
+    // fills material->baked_noise, needs the heightmap texture and extents set
+    void bake_terrain_noise(struct terrain_material_t *material);
 };
 
 
@@ -12,22 +12,61 @@
 
 extern float window_aspect;
 
-void renderh_init()
-{
-}
-
 renderh_model_t renderh_simple_model(const renderm_mesh_t *mesh, const renderm_material_t *material)
 {
     renderh_model_t model;
-    model.meshes[0] = mesh;
-    model.materials[0] = material;
-    model.mesh_count = 1;
+    model.meshes.push_back(mesh);
+    model.materials.push_back(material);
+    model.bvh = NULL;
+    renderh_update_model_bounds(&model);
     return model;
 }
 
-void renderh_emit_model_batches(const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderh_model_t &model)
+void renderh_update_model_bounds(renderh_model_t *model)
+{
+    if (model->meshes.empty())
+    {
+        model->bounds_center = vec3_t<>(0.0f, 0.0f, 0.0f);
+        model->bounds_radius = 0.0f;
+        return;
+    }
+
+    vec3_t<> low = model->meshes[0]->bounds_min;
+    vec3_t<> high = model->meshes[0]->bounds_max;
+    for (int i = 1; i < (int)model->meshes.size(); i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            low.c[j] = fminf(low.c[j], model->meshes[i]->bounds_min.c[j]);
+            high.c[j] = fmaxf(high.c[j], model->meshes[i]->bounds_max.c[j]);
+        }
+    }
+
+    model->bounds_center = 0.5f * (low + high);
+    model->bounds_radius = 0.0f;
+    for (int i = 0; i < (int)model->meshes.size(); i++)
+    {
+        const renderm_mesh_t &mesh = *model->meshes[i];
+        model->bounds_radius = fmaxf(model->bounds_radius, (mesh.bounds_center - model->bounds_center).length() + mesh.bounds_radius);
+    }
+}
+
+// pushed right away, or recorded for the gl thread when there is a list
+static void submit_batch(renderl_command_list_t *list, const renderl_batch_t &batch)
 {
-    for (int i = 0; i < model.mesh_count; i++)
+    if (list)
+    {
+        renderl_record_batch(list, batch);
+    }
+    else
+    {
+        renderl_push_batch(batch);
+    }
+}
+
+void renderh_emit_model_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderh_model_t &model, int base_id)
+{
+    for (int i = 0; i < (int)model.meshes.size(); i++)
     {
         renderl_batch_t batch = create_default_batch();
 
@@ -36,8 +75,136 @@ void renderh_emit_model_batches(const renderm_eye_t &eye, const mat4_t<> &model_
 
         // ask material to fill in fields about program, uniforms, textures and mesh fields
         material.fill_batch(&batch, eye, model_matrix, mesh);
+        batch.base_id = base_id;
 
-        renderl_push_batch(batch);
+        submit_batch(list, batch);
+    }
+}
+
+void renderh_emit_instanced_model_batches(renderl_command_list_t *list, const renderm_eye_t &eye, int instance_count, const mat4_t<> *model_matrices, const renderh_model_t &model, int base_id)
+{
+    for (int i = 0; i < (int)model.meshes.size(); i++)
+    {
+        renderl_batch_t batch = create_default_batch();
+
+        const renderm_mesh_t &mesh = *model.meshes[i];
+        const renderm_material_t &material = *model.materials[i];
+
+        // the per-instance matrices carry the whole model transform
+        material.fill_batch(&batch, eye, mat4_t<>::identity(), mesh);
+        batch.base_id = base_id;
+
+        batch.instance_matrices = model_matrices[0].c;
+        batch.instance_count = instance_count;
+
+        submit_batch(list, batch);
+    }
+}
+
+void renderh_clear_model_groups(std::vector<renderh_model_group_t> *groups)
+{
+    // groups are kept around so their storage can be reused next frame
+    for (int i = 0; i < (int)groups->size(); i++)
+    {
+        (*groups)[i].model_matrices.clear();
+        (*groups)[i].ids.clear();
+    }
+}
+
+static renderh_model_group_t &find_model_group(std::vector<renderh_model_group_t> *groups, const renderh_model_t *model)
+{
+    // there are only a handful of distinct models, a linear search will do
+    for (int i = 0; i < (int)groups->size(); i++)
+    {
+        if ((*groups)[i].model == model)
+        {
+            return (*groups)[i];
+        }
+    }
+
+    groups->push_back(renderh_model_group_t());
+    groups->back().model = model;
+    return groups->back();
+}
+
+void renderh_add_to_model_groups(std::vector<renderh_model_group_t> *groups, const renderh_model_t *model, const mat4_t<> &model_matrix, int id)
+{
+    renderh_model_group_t &group = find_model_group(groups, model);
+    group.model_matrices.push_back(model_matrix);
+    group.ids.push_back(id);
+}
+
+void renderh_add_instances_to_model_groups(std::vector<renderh_model_group_t> *groups, const renderh_model_t *model, int instance_count, const mat4_t<> *model_matrices, int id)
+{
+    renderh_model_group_t &group = find_model_group(groups, model);
+    group.model_matrices.insert(group.model_matrices.end(), model_matrices, model_matrices + instance_count);
+    group.ids.insert(group.ids.end(), instance_count, id);
+}
+
+void renderh_cull_model_group(const frustum_t &frustum, const renderh_model_group_t &group, renderh_model_group_t *visible_group, renderh_cull_stats_t *stats)
+{
+    // per thread, groups are culled on the workers
+    static thread_local std::vector<vec4_t<> > spheres;
+    static thread_local std::vector<unsigned char> visible;
+
+    visible_group->model = group.model;
+    visible_group->model_matrices.clear();
+    visible_group->ids.clear();
+
+    int count = group.model_matrices.size();
+    if (count == 0)
+    {
+        return;
+    }
+
+    // world space spheres, the radius grows with the largest axis scale
+    spheres.resize(count);
+    visible.resize(count);
+    const vec3_t<> &center = group.model->bounds_center;
+    for (int j = 0; j < count; j++)
+    {
+        const mat4_t<> &m = group.model_matrices[j];
+        vec4_t<> world_center = m * vec4_t<>(center, 1.0f);
+        float sx = m.c[0] * m.c[0] + m.c[1] * m.c[1] + m.c[2] * m.c[2];
+        float sy = m.c[4] * m.c[4] + m.c[5] * m.c[5] + m.c[6] * m.c[6];
+        float sz = m.c[8] * m.c[8] + m.c[9] * m.c[9] + m.c[10] * m.c[10];
+        float scale = sqrtf(fmaxf(sx, fmaxf(sy, sz)));
+        spheres[j] = vec4_t<>(world_center.x, world_center.y, world_center.z, scale * group.model->bounds_radius);
+    }
+
+    int visible_count = frustum_cull_spheres(frustum, count, &spheres[0], &visible[0]);
+    for (int j = 0; j < count; j++)
+    {
+        if (visible[j])
+        {
+            visible_group->model_matrices.push_back(group.model_matrices[j]);
+            visible_group->ids.push_back(group.ids[j]);
+        }
+    }
+
+    stats->drawn += visible_count;
+    stats->culled += count - visible_count;
+}
+
+void renderh_cull_model_groups(const frustum_t &frustum, const std::vector<renderh_model_group_t> &groups, std::vector<renderh_model_group_t> *visible_groups, renderh_cull_stats_t *stats)
+{
+    // one output group per input group so their storage is reused between passes
+    visible_groups->resize(groups.size());
+    for (int i = 0; i < (int)groups.size(); i++)
+    {
+        renderh_cull_model_group(frustum, groups[i], &(*visible_groups)[i], stats);
+    }
+}
+
+void renderh_emit_model_group_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const renderh_model_group_t &group, int base_id)
+{
+    if (group.model_matrices.size() == 1)
+    {
+        renderh_emit_model_batches(list, eye, group.model_matrices[0], *group.model, base_id);
+    }
+    else if (group.model_matrices.size() > 1)
+    {
+        renderh_emit_instanced_model_batches(list, eye, group.model_matrices.size(), &group.model_matrices[0], *group.model, base_id);
     }
 }
 
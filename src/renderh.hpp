@@ -1,14 +1,38 @@
 #ifndef _RENDERH_HPP
 #define _RENDERH_HPP
 
+#include <vector>
+
 #include "renderl.hpp"
 #include "renderm.hpp"
+#include "frustum.hpp"
 
 struct renderh_model_t
 {
-    const renderm_mesh_t *meshes[8];
-    const renderm_material_t *materials[8];
-    int mesh_count;
+    std::vector<const renderm_mesh_t *> meshes;
+    std::vector<const renderm_material_t *> materials;
+
+    // model space sphere around all meshes, see renderh_update_model_bounds
+    vec3_t<> bounds_center;
+    float bounds_radius;
+
+    // model space triangles for cpu ray casts, NULL when only the bounds are known
+    const struct raycast_bvh_t *bvh;
+};
+
+// all instances of one model, drawn with a single instanced batch per mesh
+struct renderh_model_group_t
+{
+    const renderh_model_t *model;
+    std::vector<mat4_t<> > model_matrices;
+    std::vector<int> ids;
+};
+
+// group members kept and rejected by renderh_cull_model_groups
+struct renderh_cull_stats_t
+{
+    int drawn;
+    int culled;
 };
 
 struct renderh_camera_t
@@ -19,10 +43,22 @@ struct renderh_camera_t
     vec3_t<> up;
 };
 
-void renderh_init();
 renderh_model_t renderh_simple_model(const renderm_mesh_t *mesh, const renderm_material_t *material);
 renderh_model_t renderh_load_obj(const char *filename);
-void renderh_emit_model_batches(const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderh_model_t &model);
+void renderh_update_model_bounds(renderh_model_t *model);
+// the emit functions record their batches into list, or push them right
+// away when it is NULL. recording may happen on any thread.
+// base_id is the g-buffer id of the (first) instance, 0 for none
+void renderh_emit_model_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderh_model_t &model, int base_id);
+void renderh_emit_instanced_model_batches(renderl_command_list_t *list, const renderm_eye_t &eye, int instance_count, const mat4_t<> *model_matrices, const renderh_model_t &model, int base_id);
+void renderh_clear_model_groups(std::vector<renderh_model_group_t> *groups);
+void renderh_add_to_model_groups(std::vector<renderh_model_group_t> *groups, const renderh_model_t *model, const mat4_t<> &model_matrix, int id);
+void renderh_add_instances_to_model_groups(std::vector<renderh_model_group_t> *groups, const renderh_model_t *model, int instance_count, const mat4_t<> *model_matrices, int id);
+// groups may be culled on different threads at once, each into a visible group of its own
+void renderh_cull_model_group(const frustum_t &frustum, const renderh_model_group_t &group, renderh_model_group_t *visible_group, renderh_cull_stats_t *stats);
+void renderh_cull_model_groups(const frustum_t &frustum, const std::vector<renderh_model_group_t> &groups, std::vector<renderh_model_group_t> *visible_groups, renderh_cull_stats_t *stats);
+// group member i is written to the g-buffer id channel as base_id + i
+void renderh_emit_model_group_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const renderh_model_group_t &group, int base_id);
 void renderh_emit_fullscreen_quad_batch(const renderl_texture_t &texture);
 void renderh_emit_ssao_fullscreen_quad_batch(const renderl_texture_t &depth_texture);
 renderm_eye_t renderh_camera_to_eye(const renderh_camera_t &camera);
@@ -29,11 +29,17 @@ void render_print_errors(const char *scope)
 
 static renderl_uniform_buffer_t fragment_uniform_buffer;
 static renderl_uniform_buffer_t vertex_uniform_buffer;
+static renderl_vertex_buffer_t instance_buffer;
+static unsigned int unpack_buffer;
+// what stands in for the default frame buffer, see renderl_set_window_frame_buffer
+static unsigned int window_frame_buffer;
 
 void renderl_init()
 {
     fragment_uniform_buffer = renderl_upload_uniform_buffer(NULL, 0);
     vertex_uniform_buffer = renderl_upload_uniform_buffer(NULL, 0);
+    instance_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 16, NULL, 0);
+    glGenBuffers(1, &unpack_buffer);
 }
 
 renderl_batch_t create_default_batch()
@@ -69,11 +75,211 @@ renderl_texture_t renderl_upload_texture(int width, int height, int source_forma
     return renderl_upload_texture_adv(width, height, GL_RGBA, source_format, GL_UNSIGNED_BYTE, data);
 }
 
+renderl_texture_t renderl_stream_texture(int width, int height, int target_format, const void *rgba)
+{
+    int size = width * height * 4;
+
+    // orphan the storage the last upload may still be reading from, then
+    // let the driver copy out of the buffer when it gets to it
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    void *p = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    assert(p);
+    memcpy(p, rgba, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    unsigned int handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, target_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+renderl_texture_t renderl_upload_texture_levels(int width, int height, int target_format, int level_count, const void *const *levels, const int *level_sizes)
+{
+    unsigned int handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    for (int i = 0; i < level_count; i++)
+    {
+        int w = width >> i > 1 ? width >> i : 1;
+        int h = height >> i > 1 ? height >> i : 1;
+        if (target_format == GL_RGBA)
+        {
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[i]);
+        }
+        else
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, target_format, w, h, 0, level_sizes[i], levels[i]);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+renderl_texture_t renderl_upload_texture_array(int width, int height, int target_format, int layer_count, int level_count, const void *const *levels, const int *level_sizes)
+{
+    unsigned int handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    for (int i = 0; i < level_count; i++)
+    {
+        int w = width >> i > 1 ? width >> i : 1;
+        int h = height >> i > 1 ? height >> i : 1;
+
+        // allocate the level for every layer, then fill in one layer at a time
+        if (target_format == GL_RGBA)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA, w, h, layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        else
+        {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, target_format, w, h, layer_count, 0, level_sizes[i] * layer_count, NULL);
+        }
+
+        for (int layer = 0; layer < layer_count; layer++)
+        {
+            int j = layer * level_count + i;
+            if (target_format == GL_RGBA)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, levels[j]);
+            }
+            else
+            {
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, w, h, 1, target_format, level_sizes[j], levels[j]);
+            }
+        }
+    }
+    if (target_format == GL_RGBA && level_count == 1)
+    {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    else
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+renderl_texture_t renderl_create_data_texture(int width, int height, int target_format)
+{
+    unsigned int handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, target_format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+void renderl_update_texture(const renderl_texture_t &texture, int source_format, int source_type, const void *data)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture.width, texture.height, source_format, source_type, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void renderl_set_texture_filter(const renderl_texture_t &texture, int filter)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void renderl_generate_mipmaps(const renderl_texture_t &texture)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void renderl_delete_texture(renderl_texture_t texture)
 {
     glDeleteTextures(1, &texture.handle);
 }
 
+renderl_texture_t renderl_create_render_texture(int width, int height, int target_format)
+{
+    unsigned int handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, target_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+renderl_texture_t renderl_create_depth_stencil_buffer(int width, int height)
+{
+    unsigned int handle;
+    glGenRenderbuffers(1, &handle);
+    glBindRenderbuffer(GL_RENDERBUFFER, handle);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    renderl_texture_t res;
+    res.handle = handle;
+    res.width = width;
+    res.height = height;
+    return res;
+}
+
+void renderl_delete_depth_stencil_buffer(renderl_texture_t buffer)
+{
+    glDeleteRenderbuffers(1, &buffer.handle);
+}
+
 renderl_frame_buffer_t renderl_create_frame_buffer(int width, int height, int color_attachment_count, int color_format, bool stencil_buffer)
 {
     renderl_frame_buffer_t res;
@@ -114,44 +320,33 @@ renderl_frame_buffer_t renderl_create_frame_buffer(int width, int height, int co
     res.depth_texture.width = width;
     res.depth_texture.height = height;
 
-    unsigned int stencil_buf;
-    glGenRenderbuffers(1, &stencil_buf);
-    render_print_errors("0");
-    glBindRenderbuffer(GL_RENDERBUFFER, stencil_buf);
-    render_print_errors("1");
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8, width, height);
-    render_print_errors("2");
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    render_print_errors("3");
-    //glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencil_buf);
-    render_print_errors("4");
-
     for (int i = 0; i < color_attachment_count; i++)
     {
-        unsigned int tex;
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, color_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, tex, 0);
+        res.textures[i] = renderl_create_render_texture(width, height, color_format);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, res.textures[i].handle, 0);
         //glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex, 0);
+    }
 
-        res.textures[i].handle = tex;
-        res.textures[i].width = width;
-        res.textures[i].height = height;
+    // depth only, e.g. for shadow maps
+    if (color_attachment_count == 0)
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
     }
 
     assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
 
     return res;
 }
 
+void renderl_delete_frame_buffer(const renderl_frame_buffer_t &fbo)
+{
+    glDeleteFramebuffers(1, &fbo.handle);
+    glDeleteTextures(1, &fbo.depth_texture.handle);
+}
+
 renderl_frame_buffer_t renderl_assemble_frame_buffer(int width, int height, const renderl_texture_t &depth_texture, int color_attachment_count, const renderl_texture_t *color_textures)
 {
     renderl_frame_buffer_t res;
@@ -182,11 +377,167 @@ renderl_frame_buffer_t renderl_assemble_frame_buffer(int width, int height, cons
 
     assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
 
     return res;
 }
 
+renderl_frame_buffer_t renderl_assemble_frame_buffer_adv(int width, int height, const renderl_texture_t *depth_texture, bool depth_stencil, int color_attachment_count, const renderl_texture_t *color_textures)
+{
+    renderl_frame_buffer_t res;
+
+    unsigned int handle;
+    glGenFramebuffers(1, &handle);
+    glBindFramebuffer(GL_FRAMEBUFFER, handle);
+
+    res.handle = handle;
+    res.texture_count = color_attachment_count;
+
+    res.depth_texture.handle = 0;
+    res.depth_texture.width = width;
+    res.depth_texture.height = height;
+    if (depth_texture && depth_stencil)
+    {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_texture->handle);
+        res.depth_texture = *depth_texture;
+    }
+    else if (depth_texture)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture->handle, 0);
+        res.depth_texture = *depth_texture;
+    }
+
+    for (int i = 0; i < color_attachment_count; i++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, color_textures[i].handle, 0);
+        res.textures[i] = color_textures[i];
+    }
+
+    if (color_attachment_count == 0)
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
+
+    return res;
+}
+
+void renderl_release_frame_buffer(const renderl_frame_buffer_t &fbo)
+{
+    glDeleteFramebuffers(1, &fbo.handle);
+}
+
+void renderl_add_color_attachment(renderl_frame_buffer_t *fbo, const renderl_texture_t &texture)
+{
+    assert(fbo->texture_count < 8);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo->handle);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + fbo->texture_count, GL_TEXTURE_2D, texture.handle, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
+
+    fbo->textures[fbo->texture_count++] = texture;
+}
+
+renderl_timer_t renderl_create_timer()
+{
+    renderl_timer_t res;
+    // timer queries are gl 3.3, without them the timer never has a result
+    if (GLEW_ARB_timer_query)
+    {
+        glGenQueries(RENDERL_TIMER_LATENCY, res.queries);
+    }
+    res.frame = 0;
+    res.milliseconds = -1.0f;
+    return res;
+}
+
+void renderl_begin_timer(renderl_timer_t *timer)
+{
+    if (!GLEW_ARB_timer_query)
+    {
+        return;
+    }
+
+    unsigned int query = timer->queries[timer->frame % RENDERL_TIMER_LATENCY];
+
+    // the query was last used RENDERL_TIMER_LATENCY frames ago, if the gpu
+    // still isn't done with it that result is skipped
+    if (timer->frame >= RENDERL_TIMER_LATENCY)
+    {
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 nanoseconds;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            timer->milliseconds = 1e-6f * nanoseconds;
+        }
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void renderl_end_timer(renderl_timer_t *timer)
+{
+    if (!GLEW_ARB_timer_query)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->frame++;
+}
+
+renderl_readback_t renderl_create_readback(int size)
+{
+    renderl_readback_t res;
+    glGenBuffers(1, &res.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, res.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    res.size = size;
+    res.fence = NULL;
+    return res;
+}
+
+void renderl_start_readback(renderl_readback_t *readback, int x, int y, int width, int height, int format, int type)
+{
+    assert(readback->fence == NULL);
+
+    // with a pack buffer bound glReadPixels only queues the copy
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    glReadPixels(x, y, width, height, format, type, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool renderl_poll_readback(renderl_readback_t *readback, void *data)
+{
+    if (readback->fence == NULL)
+    {
+        return false;
+    }
+
+    GLenum status = glClientWaitSync((GLsync)readback->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+    glDeleteSync((GLsync)readback->fence);
+    readback->fence = NULL;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, readback->size, data);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
 static int upload_shader(const renderl_source_t &source)
 {
     int shader = glCreateShader(source.type);
@@ -228,6 +579,14 @@ renderl_program_t renderl_upload_program(int shader_source_count, const renderl_
         glDeleteShader(shader);
     }
 
+    // the model matrix of instanced batches occupies four consecutive locations
+    glBindAttribLocation(program, RENDERL_INSTANCE_MODEL_LOCATION, "instance_model");
+
+    if (GLEW_ARB_get_program_binary)
+    {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(program);
     int result;
     glGetProgramiv(program, GL_LINK_STATUS, &result);
@@ -247,6 +606,52 @@ renderl_program_t renderl_upload_program(int shader_source_count, const renderl_
     return res;
 }
 
+renderl_program_t renderl_load_program_binary(int format, const void *binary, int size)
+{
+    renderl_program_t res;
+    res.handle = 0;
+    if (!GLEW_ARB_get_program_binary)
+    {
+        return res;
+    }
+
+    int program = glCreateProgram();
+    glProgramBinary(program, format, binary, size);
+
+    // a driver update or a different gpu makes old binaries fail to load
+    int result;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        return res;
+    }
+
+    res.handle = program;
+    return res;
+}
+
+void *renderl_get_program_binary(const renderl_program_t &program, int *format, int *size)
+{
+    if (!GLEW_ARB_get_program_binary)
+    {
+        return NULL;
+    }
+
+    int length = 0;
+    glGetProgramiv(program.handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return NULL;
+    }
+
+    void *binary = malloc(length);
+    GLenum binary_format;
+    glGetProgramBinary(program.handle, length, size, &binary_format, binary);
+    *format = binary_format;
+    return binary;
+}
+
 void renderl_delete_program(renderl_program_t program)
 {
     glDeleteProgram(program.handle);
@@ -267,6 +672,13 @@ renderl_vertex_buffer_t renderl_upload_vertex_buffer(int type, int component_cou
     return res;
 }
 
+void renderl_update_vertex_buffer(renderl_vertex_buffer_t &vertex_buffer, const void *data, int size)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer.handle);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 renderl_index_buffer_t renderl_upload_index_buffer(int type, const void *data, int size)
 {
     unsigned int handle;
@@ -301,32 +713,95 @@ void renderl_update_uniform_buffer(renderl_uniform_buffer_t &uniform_buffer, con
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
+static void sync_cached_uniform_buffer(renderl_cached_uniform_buffer_t *uniforms, const void *data, int size)
+{
+    if (uniforms == NULL || size == 0)
+    {
+        return;
+    }
+    assert(size <= RENDERL_MAX_CACHED_UNIFORMS);
+
+    if (uniforms->buffer.handle == 0)
+    {
+        uniforms->buffer = renderl_upload_uniform_buffer(data, size);
+    }
+    else if (size != uniforms->size || memcmp(uniforms->data, data, size) != 0)
+    {
+        renderl_update_uniform_buffer(uniforms->buffer, data, size);
+    }
+    else
+    {
+        return;
+    }
+
+    memcpy(uniforms->data, data, size);
+    uniforms->size = size;
+}
+
+// blocks the program does not declare are left alone
+static void bind_uniform_block(unsigned int program, const char *name, int binding, const renderl_uniform_buffer_t *uniform_buffer)
+{
+    if (uniform_buffer == NULL)
+    {
+        return;
+    }
+    unsigned int index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX)
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, uniform_buffer->handle);
+        glUniformBlockBinding(program, index, binding);
+    }
+}
+
 void renderl_push_batch(const renderl_batch_t &batch)
 {
     if (batch.use_depth_test)
     {
         glEnable(GL_DEPTH_TEST);
+        glDepthFunc(batch.depth_func != 0 ? batch.depth_func : GL_LESS);
+    }
+    if (batch.disable_depth_write)
+    {
+        glDepthMask(GL_FALSE);
     }
     if (batch.use_back_face_culling)
     {
         glCullFace(GL_BACK);
         glEnable(GL_CULL_FACE);
     }
+    else if (batch.use_front_face_culling)
+    {
+        glCullFace(GL_FRONT);
+        glEnable(GL_CULL_FACE);
+    }
     if (batch.use_blending)
     {
         glEnable(GL_BLEND);
         glBlendFunc(batch.src_blend_func, batch.dst_blend_func);
     }
 
-    renderl_update_uniform_buffer(fragment_uniform_buffer, batch.fragment_parameters, batch.fragment_parameters_size);
-    renderl_update_uniform_buffer(vertex_uniform_buffer, batch.vertex_parameters, batch.vertex_parameters_size);
+    if (batch.fragment_parameters_size > 0)
+    {
+        renderl_update_uniform_buffer(fragment_uniform_buffer, batch.fragment_parameters, batch.fragment_parameters_size);
+    }
+    if (batch.vertex_parameters_size > 0)
+    {
+        renderl_update_uniform_buffer(vertex_uniform_buffer, batch.vertex_parameters, batch.vertex_parameters_size);
+    }
+    sync_cached_uniform_buffer(batch.frame_uniforms, batch.frame_parameters, batch.frame_parameters_size);
 
     glUseProgram(batch.program->handle);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, vertex_uniform_buffer.handle);
-    glUniformBlockBinding(batch.program->handle, glGetUniformBlockIndex(batch.program->handle, "vertex_uniforms"), 0);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, fragment_uniform_buffer.handle);
-    glUniformBlockBinding(batch.program->handle, glGetUniformBlockIndex(batch.program->handle, "fragment_uniforms"), 1);
+    bind_uniform_block(batch.program->handle, "vertex_uniforms", 0, &vertex_uniform_buffer);
+    bind_uniform_block(batch.program->handle, "fragment_uniforms", 1, &fragment_uniform_buffer);
+    bind_uniform_block(batch.program->handle, "frame_uniforms", 2, batch.frame_uniforms ? &batch.frame_uniforms->buffer : NULL);
+    bind_uniform_block(batch.program->handle, "material_uniforms", 3, batch.material_uniforms);
+
+    int base_id_location = glGetUniformLocation(batch.program->handle, "base_id");
+    if (base_id_location != -1)
+    {
+        glUniform1f(base_id_location, batch.base_id);
+    }
 
     const int texture_units[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
     glUniform1iv(glGetUniformLocation(batch.program->handle, "tex"), batch.texture_count, texture_units);
@@ -338,6 +813,15 @@ void renderl_push_batch(const renderl_batch_t &batch)
     }
     glActiveTexture(GL_TEXTURE0);
 
+    // the unit after the ones tex[8] can take
+    if (batch.texture_array)
+    {
+        glUniform1i(glGetUniformLocation(batch.program->handle, "tex_array"), 8);
+        glActiveTexture(GL_TEXTURE0 + 8);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, batch.texture_array->handle);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
     // gah... words cannot describe the ugliness of
     // creating a vertex array for every batch
     // just to remove it afterwards
@@ -345,6 +829,23 @@ void renderl_push_batch(const renderl_batch_t &batch)
     glGenVertexArrays(1, &vertex_array);
     glBindVertexArray(vertex_array);
 
+    if (batch.vertex_format != NULL)
+    {
+        const renderl_vertex_format_t &format = *batch.vertex_format;
+        glBindBuffer(GL_ARRAY_BUFFER, batch.vertex_buffer->handle);
+        for (int i = 0; i < format.attribute_count; i++)
+        {
+            const renderl_vertex_attribute_t &attribute = format.attributes[i];
+            int location = glGetAttribLocation(batch.program->handle, attribute.name);
+            if (location != -1)
+            {
+                glEnableVertexAttribArray(location);
+                glVertexAttribPointer(location, attribute.component_count, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, format.stride, (const void *)(long)attribute.offset);
+            }
+        }
+        render_print_errors("2");
+    }
+
     for (int i = 0; i < batch.vertex_buffer_count; i++)
     {
         const renderl_vertex_buffer_t *buf = batch.vertex_buffers[i];
@@ -359,11 +860,41 @@ void renderl_push_batch(const renderl_batch_t &batch)
         }
     }
 
+    if (batch.instance_count > 0)
+    {
+        // orphan and refill the shared instance buffer, the driver takes care
+        // of not stalling on batches still using the previous contents
+        renderl_update_vertex_buffer(instance_buffer, batch.instance_matrices, batch.instance_count * 16 * sizeof(float));
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer.handle);
+        for (int i = 0; i < 4; i++)
+        {
+            int location = RENDERL_INSTANCE_MODEL_LOCATION + i;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (const void *)(4 * i * sizeof(float)));
+            glVertexAttribDivisorARB(location, 1);
+        }
+    }
+    else
+    {
+        // non-instanced batches see an identity instance_model
+        for (int i = 0; i < 4; i++)
+        {
+            glVertexAttrib4f(RENDERL_INSTANCE_MODEL_LOCATION + i, i == 0, i == 1, i == 2, i == 3);
+        }
+    }
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.index_buffer->handle);
 
     render_print_errors("3");
     // do actual drawing
-    glDrawElements(batch.primitive_type, batch.index_count, batch.index_buffer->type, 0);
+    if (batch.instance_count > 0)
+    {
+        glDrawElementsInstanced(batch.primitive_type, batch.index_count, batch.index_buffer->type, 0, batch.instance_count);
+    }
+    else
+    {
+        glDrawElements(batch.primitive_type, batch.index_count, batch.index_buffer->type, 0);
+    }
 
     render_print_errors("4");
     // clean up...
@@ -377,6 +908,11 @@ void renderl_push_batch(const renderl_batch_t &batch)
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
+    if (batch.texture_array)
+    {
+        glActiveTexture(GL_TEXTURE0 + 8);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
     glActiveTexture(GL_TEXTURE0);
 
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);
@@ -384,10 +920,69 @@ void renderl_push_batch(const renderl_batch_t &batch)
 
     glUseProgram(0);
     glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
     glDisable(GL_BLEND);
     glDisable(GL_CULL_FACE);
 }
 
+void renderl_clear_command_list(renderl_command_list_t *list)
+{
+    // the storage is kept for the next frame
+    list->commands.clear();
+    list->data.clear();
+}
+
+// appends size bytes to the list's data, 16 byte aligned like the blocks
+// they end up in
+static int record_data(renderl_command_list_t *list, const void *data, int size)
+{
+    if (data == NULL || size == 0)
+    {
+        return -1;
+    }
+
+    int offset = (list->data.size() + 15) & ~15;
+    list->data.resize(offset + size);
+    memcpy(&list->data[offset], data, size);
+    return offset;
+}
+
+void renderl_record_batch(renderl_command_list_t *list, const renderl_batch_t &batch)
+{
+    renderl_command_t command;
+    command.batch = batch;
+    command.vertex_parameters = record_data(list, batch.vertex_parameters, batch.vertex_parameters_size);
+    command.fragment_parameters = record_data(list, batch.fragment_parameters, batch.fragment_parameters_size);
+    command.frame_parameters = record_data(list, batch.frame_parameters, batch.frame_parameters_size);
+    command.instance_matrices = record_data(list, batch.instance_matrices, batch.instance_count * 16 * sizeof(float));
+    list->commands.push_back(command);
+}
+
+void renderl_replay_command_list(const renderl_command_list_t &list)
+{
+    for (int i = 0; i < (int)list.commands.size(); i++)
+    {
+        const renderl_command_t &command = list.commands[i];
+
+        // point the batch at the copies, the data may have moved while recording
+        renderl_batch_t batch = command.batch;
+        const char *data = list.data.empty() ? NULL : &list.data[0];
+        batch.vertex_parameters = command.vertex_parameters >= 0 ? data + command.vertex_parameters : NULL;
+        batch.fragment_parameters = command.fragment_parameters >= 0 ? data + command.fragment_parameters : NULL;
+        batch.frame_parameters = command.frame_parameters >= 0 ? data + command.frame_parameters : NULL;
+        batch.instance_matrices = command.instance_matrices >= 0 ? (const float *)(data + command.instance_matrices) : NULL;
+
+        renderl_push_batch(batch);
+    }
+}
+
+void renderl_set_window_frame_buffer(const renderl_frame_buffer_t *fbo)
+{
+    window_frame_buffer = fbo ? fbo->handle : 0;
+    glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
+}
+
 void renderl_bind_frame_buffer(const renderl_frame_buffer_t *fbo)
 {
     const GLenum bufs[] =
@@ -405,12 +1000,20 @@ void renderl_bind_frame_buffer(const renderl_frame_buffer_t *fbo)
     if (fbo)
     {
         glBindFramebuffer(GL_FRAMEBUFFER, fbo->handle);
-        glDrawBuffers(fbo->texture_count, bufs);
-        glViewport(0, 0, fbo->textures[0].width, fbo->textures[0].height);
+        if (fbo->texture_count == 0)
+        {
+            glDrawBuffer(GL_NONE);
+            glViewport(0, 0, fbo->depth_texture.width, fbo->depth_texture.height);
+        }
+        else
+        {
+            glDrawBuffers(fbo->texture_count, bufs);
+            glViewport(0, 0, fbo->textures[0].width, fbo->textures[0].height);
+        }
     }
     else
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, window_frame_buffer);
         glViewport(0, 0, window_width, window_height);
     }
 }
@@ -1,6 +1,11 @@
 #ifndef _RENDERL_HPP
 #define _RENDERL_HPP
 
+#include <vector>
+
+// per-instance model matrices are bound here, well above the per-vertex attributes
+#define RENDERL_INSTANCE_MODEL_LOCATION 12
+
 struct renderl_source_t
 {
     int type;
@@ -29,6 +34,27 @@ struct renderl_frame_buffer_t
     renderl_texture_t depth_texture;
 };
 
+// asynchronous copy of a few pixels into a pixel pack buffer, the fence
+// tells when the gpu has written it
+struct renderl_readback_t
+{
+    unsigned int buffer;
+    int size;
+    // GLsync, NULL while no read is in flight
+    void *fence;
+};
+
+// gpu time spent between begin and end. results are read a few frames
+// later, once the gpu is done with them, so timing never stalls a frame
+#define RENDERL_TIMER_LATENCY 4
+struct renderl_timer_t
+{
+    unsigned int queries[RENDERL_TIMER_LATENCY];
+    int frame;
+    // latest result, -1 until there is one
+    float milliseconds;
+};
+
 struct renderl_vertex_buffer_t
 {
     unsigned int handle;
@@ -36,6 +62,24 @@ struct renderl_vertex_buffer_t
     int component_count;
 };
 
+// one attribute of an interleaved vertex, matched by name against the
+// attributes of the program
+struct renderl_vertex_attribute_t
+{
+    const char *name;
+    int type;
+    int component_count;
+    bool normalized;
+    int offset;
+};
+
+struct renderl_vertex_format_t
+{
+    int stride;
+    int attribute_count;
+    renderl_vertex_attribute_t attributes[8];
+};
+
 struct renderl_index_buffer_t
 {
     unsigned int handle;
@@ -47,6 +91,18 @@ struct renderl_uniform_buffer_t
     unsigned int handle;
 };
 
+// largest block of constants a cached uniform buffer can hold
+#define RENDERL_MAX_CACHED_UNIFORMS 256
+
+// a uniform buffer and the constants last uploaded to it, so the upload is
+// skipped while batches keep asking for the same ones
+struct renderl_cached_uniform_buffer_t
+{
+    renderl_uniform_buffer_t buffer;
+    int size;
+    char data[RENDERL_MAX_CACHED_UNIFORMS];
+};
+
 struct renderl_batch_t
 {
     const struct renderl_program_t *program;
@@ -55,10 +111,25 @@ struct renderl_batch_t
     int vertex_parameters_size;
     const void *fragment_parameters;
     int fragment_parameters_size;
+    // bound to "frame_uniforms", renderl_push_batch uploads the parameters
+    // to it first unless that is what it already holds
+    renderl_cached_uniform_buffer_t *frame_uniforms;
+    const void *frame_parameters;
+    int frame_parameters_size;
+    // bound to "material_uniforms" as it is, the owner keeps it up to date
+    const renderl_uniform_buffer_t *material_uniforms;
 
     int texture_count;
     const renderl_texture_t *textures[8];
+    // GL_TEXTURE_2D_ARRAY bound to the "tex_array" sampler when not NULL
+    const renderl_texture_t *texture_array;
 
+    // interleaved vertices, every attribute of vertex_format that the
+    // program uses is fed from vertex_buffer
+    const struct renderl_vertex_format_t *vertex_format;
+    const struct renderl_vertex_buffer_t *vertex_buffer;
+
+    // alternatively one buffer per attribute, vertex_buffers[i] feeds attribute i
     int vertex_buffer_count;
     const struct renderl_vertex_buffer_t *vertex_buffers[8];
     const struct renderl_index_buffer_t *index_buffer;
@@ -66,13 +137,46 @@ struct renderl_batch_t
 
     int primitive_type;
 
+    // when instance_count > 0 the batch is drawn instanced, feeding one
+    // column-major model matrix per instance from instance_matrices into
+    // the "instance_model" attribute
+    const float *instance_matrices;
+    int instance_count;
+
+    // fed to the "base_id" uniform of programs that write the g-buffer id
+    // channel, instance i of the batch gets base_id + i
+    int base_id;
+
     bool use_depth_test;
+    // GL_LESS when 0
+    int depth_func;
+    bool disable_depth_write;
     bool use_back_face_culling;
+    bool use_front_face_culling;
     bool use_blending;
     int src_blend_func;
     int dst_blend_func;
 };
 
+// a batch recorded into a command list, its parameter blocks and instance
+// matrices are copied into the list's data at these offsets, -1 for none
+struct renderl_command_t
+{
+    renderl_batch_t batch;
+    int vertex_parameters;
+    int fragment_parameters;
+    int frame_parameters;
+    int instance_matrices;
+};
+
+// batches built away from the gl thread. recording makes no gl calls, so
+// any thread may fill a list of its own, only replaying needs the context
+struct renderl_command_list_t
+{
+    std::vector<renderl_command_t> commands;
+    std::vector<char> data;
+};
+
 void render_print_errors(const char *scope);
 void renderl_init();
 
@@ -80,17 +184,75 @@ renderl_batch_t create_default_batch();
 
 renderl_texture_t renderl_upload_texture(int width, int height, int source_format, void *data);
 renderl_texture_t renderl_upload_texture_adv(int width, int height, int target_format, int source_format, int source_type, void *data);
+// uploads width * height rgba bytes through a pixel buffer and builds the
+// mip chain on the gpu, returns without waiting for the copy
+renderl_texture_t renderl_stream_texture(int width, int height, int target_format, const void *rgba);
+// a ready made mip chain, largest level first. target_format is GL_RGBA for
+// rgba bytes or a compressed format the levels are already encoded in
+renderl_texture_t renderl_upload_texture_levels(int width, int height, int target_format, int level_count, const void *const *levels, const int *level_sizes);
+// layer_count layers of equal size in one GL_TEXTURE_2D_ARRAY. levels holds
+// level_count levels of the first layer, then of the second and so on. a
+// single GL_RGBA level per layer gets its mip chain generated
+renderl_texture_t renderl_upload_texture_array(int width, int height, int target_format, int layer_count, int level_count, const void *const *levels, const int *level_sizes);
+// unfiltered texture without mipmaps, for shaders to look up data in
+renderl_texture_t renderl_create_data_texture(int width, int height, int target_format);
+void renderl_update_texture(const renderl_texture_t &texture, int source_format, int source_type, const void *data);
+// min and mag filter, e.g. GL_LINEAR to interpolate a data texture
+void renderl_set_texture_filter(const renderl_texture_t &texture, int filter);
+// rebuilds the mip chain from level 0 on the gpu and samples it from then on
+void renderl_generate_mipmaps(const renderl_texture_t &texture);
+// linear filtered, clamped and without mipmaps, for drawing into
+renderl_texture_t renderl_create_render_texture(int width, int height, int target_format);
+// GL_DEPTH24_STENCIL8 render buffer, it can be attached but not sampled
+renderl_texture_t renderl_create_depth_stencil_buffer(int width, int height);
+void renderl_delete_depth_stencil_buffer(renderl_texture_t buffer);
+// color_attachment_count may be 0 for a depth only frame buffer
 renderl_frame_buffer_t renderl_create_frame_buffer(int width, int height, int color_attachment_count, int color_format, bool stencil_buffer);
 void renderl_delete_texture(renderl_texture_t texture);
+// deletes the frame buffer and its depth texture but not the color textures,
+// for frame buffers from renderl_create_frame_buffer without a stencil buffer
+void renderl_delete_frame_buffer(const renderl_frame_buffer_t &fbo);
 renderl_frame_buffer_t renderl_assemble_frame_buffer(int width, int height, const renderl_texture_t &depth_texture, int color_attachment_count, const renderl_texture_t *color_textures);
+// depth_texture may be NULL, otherwise a render buffer from
+// renderl_create_depth_stencil_buffer when depth_stencil is set and a depth
+// texture when not
+renderl_frame_buffer_t renderl_assemble_frame_buffer_adv(int width, int height, const renderl_texture_t *depth_texture, bool depth_stencil, int color_attachment_count, const renderl_texture_t *color_textures);
+// deletes only the frame buffer object, the attachments are left alone
+void renderl_release_frame_buffer(const renderl_frame_buffer_t &fbo);
+// attaches texture after the existing color attachments
+void renderl_add_color_attachment(renderl_frame_buffer_t *fbo, const renderl_texture_t &texture);
+renderl_timer_t renderl_create_timer();
+// only one timer may be running at a time
+void renderl_begin_timer(renderl_timer_t *timer);
+void renderl_end_timer(renderl_timer_t *timer);
+renderl_readback_t renderl_create_readback(int size);
+// reads from the current read buffer, the readback must not be in flight
+void renderl_start_readback(renderl_readback_t *readback, int x, int y, int width, int height, int format, int type);
+// copies the pixels to data and returns true once they have arrived, never waits for the gpu
+bool renderl_poll_readback(renderl_readback_t *readback, void *data);
 renderl_program_t renderl_upload_program(int shader_source_count, const renderl_source_t *shader_sources);
+// a program from renderl_get_program_binary, handle 0 if the driver rejects it
+renderl_program_t renderl_load_program_binary(int format, const void *binary, int size);
+// malloc'd copy of the linked program, NULL when the driver can't provide one
+void *renderl_get_program_binary(const renderl_program_t &program, int *format, int *size);
 void renderl_delete_program(renderl_program_t program);
 renderl_vertex_buffer_t renderl_upload_vertex_buffer(int type, int component_count, const void *data, int size);
+void renderl_update_vertex_buffer(renderl_vertex_buffer_t &vertex_buffer, const void *data, int size);
 renderl_index_buffer_t renderl_upload_index_buffer(int type, const void *data, int size);
 renderl_uniform_buffer_t renderl_upload_uniform_buffer(const void *data, int size);
 void renderl_update_uniform_buffer(renderl_uniform_buffer_t &uniform_buffer, const void *data, int size);
 void renderl_push_batch(const renderl_batch_t &batch);
+void renderl_clear_command_list(renderl_command_list_t *list);
+// copies everything batch points to that may not outlive the call, the
+// rest, like programs, meshes and textures, must live until the replay
+void renderl_record_batch(renderl_command_list_t *list, const renderl_batch_t &batch);
+// pushes the recorded batches in order
+void renderl_replay_command_list(const renderl_command_list_t &list);
+// NULL binds the window
 void renderl_bind_frame_buffer(const renderl_frame_buffer_t *fbo);
+// for running without a window, fbo is drawn into whenever the window is
+// bound. it must be window_width x window_height
+void renderl_set_window_frame_buffer(const renderl_frame_buffer_t *fbo);
 
 #endif // _RENDERL_HPP
 
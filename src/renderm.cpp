@@ -0,0 +1,274 @@
+#include <cmath>
+#include <cassert>
+#include <cstring>
+
+#include <GL/glew.h>
+#ifdef _OSX
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "renderm.hpp"
+
+static int index_size(int index_type)
+{
+    switch (index_type)
+    {
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: return 4;
+    }
+    assert(0);
+    return 0;
+}
+
+static float clamp(float v, float low, float high)
+{
+    return v < low ? low : (v > high ? high : v);
+}
+
+// signed normalized x, y, z in 10 bits each, w in the top two bits
+static unsigned int pack_snorm_2_10_10_10(const vec3_t<> &v)
+{
+    unsigned int x = (int)floorf(clamp(v.x, -1.0f, 1.0f) * 511.0f + 0.5f) & 0x3ff;
+    unsigned int y = (int)floorf(clamp(v.y, -1.0f, 1.0f) * 511.0f + 0.5f) & 0x3ff;
+    unsigned int z = (int)floorf(clamp(v.z, -1.0f, 1.0f) * 511.0f + 0.5f) & 0x3ff;
+    return x | (y << 10) | (z << 20);
+}
+
+static unsigned short float_to_half(float f)
+{
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        // too small even for a denormal half
+        if (exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        return sign | (mantissa >> (14 - exponent));
+    }
+    if (exponent >= 31)
+    {
+        // overflow, clamp to infinity
+        return sign | 0x7c00;
+    }
+    // round to nearest
+    mantissa += 0x1000;
+    if (mantissa & 0x800000)
+    {
+        mantissa = 0;
+        exponent += 1;
+        if (exponent >= 31)
+        {
+            return sign | 0x7c00;
+        }
+    }
+    return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+static void add_attribute(renderl_vertex_format_t *format, const char *name, int type, int component_count, bool normalized, int size)
+{
+    assert(format->attribute_count < 8);
+    renderl_vertex_attribute_t &attribute = format->attributes[format->attribute_count++];
+    attribute.name = name;
+    attribute.type = type;
+    attribute.component_count = component_count;
+    attribute.normalized = normalized;
+    attribute.offset = format->stride;
+    format->stride += size;
+}
+
+renderm_mesh_t renderm_create_mesh(int vertex_count, const vec3_t<> *positions, const vec3_t<> *normals, const vec3_t<> *tangents, const vec2_t<> *tex_coords, int index_type, const void *indices, int index_count, int primitive_type, int flags)
+{
+    renderm_mesh_t res;
+    res.position_bias = vec3_t<>(0.0f, 0.0f, 0.0f);
+    res.position_scale = 1.0f;
+
+    bool pack_normals = (flags & RENDERM_PACK_NORMALS) != 0;
+    bool pack_tex_coords = (flags & RENDERM_PACK_TEX_COORDS) != 0;
+    bool quantize_positions = (flags & RENDERM_QUANTIZE_POSITIONS) != 0;
+
+    // describe the interleaved layout
+    renderl_vertex_format_t &format = res.vertex_format;
+    memset(&format, 0, sizeof(format));
+    if (quantize_positions)
+    {
+        // padded to four shorts to keep attributes 4 byte aligned
+        add_attribute(&format, "pos", GL_SHORT, 3, true, 4 * sizeof(short));
+    }
+    else
+    {
+        add_attribute(&format, "pos", GL_FLOAT, 3, false, 3 * sizeof(float));
+    }
+    if (normals)
+    {
+        if (pack_normals)
+        {
+            add_attribute(&format, "normal", GL_INT_2_10_10_10_REV, 4, true, sizeof(unsigned int));
+        }
+        else
+        {
+            add_attribute(&format, "normal", GL_FLOAT, 3, false, 3 * sizeof(float));
+        }
+    }
+    if (tangents)
+    {
+        if (pack_normals)
+        {
+            add_attribute(&format, "tangent", GL_INT_2_10_10_10_REV, 4, true, sizeof(unsigned int));
+        }
+        else
+        {
+            add_attribute(&format, "tangent", GL_FLOAT, 3, false, 3 * sizeof(float));
+        }
+    }
+    if (tex_coords)
+    {
+        if (pack_tex_coords)
+        {
+            add_attribute(&format, "tex_coord", GL_HALF_FLOAT, 2, false, 2 * sizeof(unsigned short));
+        }
+        else
+        {
+            add_attribute(&format, "tex_coord", GL_FLOAT, 2, false, 2 * sizeof(float));
+        }
+    }
+
+    // bounds, used for culling and quantization
+    vec3_t<> low(0.0f, 0.0f, 0.0f);
+    vec3_t<> high(0.0f, 0.0f, 0.0f);
+    if (vertex_count > 0)
+    {
+        low = positions[0];
+        high = positions[0];
+    }
+    for (int i = 1; i < vertex_count; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            low.c[j] = fminf(low.c[j], positions[i].c[j]);
+            high.c[j] = fmaxf(high.c[j], positions[i].c[j]);
+        }
+    }
+    res.bounds_min = low;
+    res.bounds_max = high;
+    res.bounds_center = 0.5f * (low + high);
+    res.bounds_radius = 0.0f;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        res.bounds_radius = fmaxf(res.bounds_radius, (positions[i] - res.bounds_center).length());
+    }
+
+    if (quantize_positions && vertex_count > 0)
+    {
+        // a uniform scale keeps normals valid under the dequantization transform
+        float extent = fmaxf(high.x - low.x, fmaxf(high.y - low.y, high.z - low.z));
+        res.position_bias = res.bounds_center;
+        res.position_scale = extent > 0.0f ? 0.5f * extent : 1.0f;
+    }
+
+    // and fill it
+    unsigned char *vertices = new unsigned char[vertex_count * format.stride];
+    for (int i = 0; i < vertex_count; i++)
+    {
+        unsigned char *v = vertices + i * format.stride;
+        int attribute = 0;
+
+        if (quantize_positions)
+        {
+            vec3_t<> p = (1.0f / res.position_scale) * (positions[i] - res.position_bias);
+            short s[4];
+            for (int j = 0; j < 3; j++)
+            {
+                s[j] = (short)floorf(clamp(p.c[j], -1.0f, 1.0f) * 32767.0f + 0.5f);
+            }
+            s[3] = 0;
+            memcpy(v + format.attributes[attribute++].offset, s, sizeof(s));
+        }
+        else
+        {
+            memcpy(v + format.attributes[attribute++].offset, positions[i].c, 3 * sizeof(float));
+        }
+
+        const vec3_t<> *directions[] = { normals, tangents };
+        for (int k = 0; k < 2; k++)
+        {
+            if (directions[k])
+            {
+                if (pack_normals)
+                {
+                    unsigned int packed = pack_snorm_2_10_10_10(directions[k][i]);
+                    memcpy(v + format.attributes[attribute++].offset, &packed, sizeof(packed));
+                }
+                else
+                {
+                    memcpy(v + format.attributes[attribute++].offset, directions[k][i].c, 3 * sizeof(float));
+                }
+            }
+        }
+
+        if (tex_coords)
+        {
+            if (pack_tex_coords)
+            {
+                unsigned short h[2] = { float_to_half(tex_coords[i].x), float_to_half(tex_coords[i].y) };
+                memcpy(v + format.attributes[attribute++].offset, h, sizeof(h));
+            }
+            else
+            {
+                memcpy(v + format.attributes[attribute++].offset, tex_coords[i].c, 2 * sizeof(float));
+            }
+        }
+    }
+
+    res.vertex_buffer = renderl_upload_vertex_buffer(GL_UNSIGNED_BYTE, format.stride, vertices, vertex_count * format.stride);
+    // 32-bit indices are narrowed whenever the vertex count allows it
+    if (index_type == GL_UNSIGNED_INT && vertex_count <= 65536)
+    {
+        const unsigned int *wide_indices = (const unsigned int *)indices;
+        unsigned short *narrow_indices = new unsigned short[index_count];
+        for (int i = 0; i < index_count; i++)
+        {
+            narrow_indices[i] = wide_indices[i];
+        }
+        res.index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_SHORT, narrow_indices, index_count * sizeof(unsigned short));
+        delete[] narrow_indices;
+    }
+    else
+    {
+        res.index_buffer = renderl_upload_index_buffer(index_type, indices, index_count * index_size(index_type));
+    }
+    res.index_count = index_count;
+    res.primitive_type = primitive_type;
+
+    delete[] vertices;
+
+    return res;
+}
+
+mat4_t<> renderm_mesh_dequantization(const renderm_mesh_t &mesh)
+{
+    float s = mesh.position_scale;
+    return mat4_t<>::translation(mesh.position_bias) * mat4_t<>::scale(vec3_t<>(s, s, s));
+}
+
+void renderm_upload_material_uniforms(renderm_material_t *material, const void *data, int size)
+{
+    if (material->uniform_buffer.handle == 0)
+    {
+        material->uniform_buffer = renderl_upload_uniform_buffer(data, size);
+    }
+    else
+    {
+        renderl_update_uniform_buffer(material->uniform_buffer, data, size);
+    }
+}
@@ -4,15 +4,32 @@
 #include "renderl.hpp"
 #include "math.hpp"
 
+// flags for renderm_create_mesh
+// normals and tangents as GL_INT_2_10_10_10_REV, 4 bytes instead of 12
+#define RENDERM_PACK_NORMALS        1
+// texture coordinates as half floats, 4 bytes instead of 8
+#define RENDERM_PACK_TEX_COORDS     2
+// positions as normalized shorts relative to the mesh bounds, 8 bytes instead of 12
+#define RENDERM_QUANTIZE_POSITIONS  4
+
 struct renderm_mesh_t
 {
-    renderl_vertex_buffer_t position_buffer;
-    renderl_vertex_buffer_t normal_buffer;
-    renderl_vertex_buffer_t tangent_buffer;
-    renderl_vertex_buffer_t tex_coord_buffer;
+    renderl_vertex_format_t vertex_format;
+    renderl_vertex_buffer_t vertex_buffer;
     renderl_index_buffer_t index_buffer;
     int index_count;
     int primitive_type;
+
+    // model space position = position_bias + position_scale * stored position,
+    // identity unless the mesh was created with RENDERM_QUANTIZE_POSITIONS
+    vec3_t<> position_bias;
+    float position_scale;
+
+    // model space bounding box and sphere
+    vec3_t<> bounds_min;
+    vec3_t<> bounds_max;
+    vec3_t<> bounds_center;
+    float bounds_radius;
 };
 
 struct renderm_eye_t
@@ -24,8 +41,30 @@ struct renderm_eye_t
 struct renderm_material_t
 {
     const renderl_program_t *program;
+
+    // the constants every draw with the material shares, handle 0 for
+    // none. written by upload_uniforms only
+    renderl_uniform_buffer_t uniform_buffer;
+
+    renderm_material_t()
+    {
+        uniform_buffer.handle = 0;
+    }
+    // call once the material is set up and again after editing it
+    virtual void upload_uniforms()
+    {
+    }
+    // only fills in the batch, it may run on any thread while nothing edits the material
     virtual void fill_batch(renderl_batch_t *batch, const renderm_eye_t &eye, const mat4_t<> &model_matrix, const renderm_mesh_t &mesh) const = 0;
 };
 
+// normals, tangents and tex_coords may be NULL if the mesh has none.
+// GL_UNSIGNED_INT indices are stored as 16-bit when vertex_count fits
+renderm_mesh_t renderm_create_mesh(int vertex_count, const vec3_t<> *positions, const vec3_t<> *normals, const vec3_t<> *tangents, const vec2_t<> *tex_coords, int index_type, const void *indices, int index_count, int primitive_type, int flags);
+// creates the material's uniform buffer or refills it with data
+void renderm_upload_material_uniforms(renderm_material_t *material, const void *data, int size);
+// transform from stored to model space positions, materials apply it before the model matrix
+mat4_t<> renderm_mesh_dequantization(const renderm_mesh_t &mesh);
+
 #endif // _RENDERM_HPP
 
@@ -9,6 +9,12 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <GL/glew.h>
 #ifdef _OSX
 #include <OpenAL/al.h> // for AL_FORMAT_STEREO16
 #include <OpenGL/gl.h>
@@ -26,6 +32,10 @@
 #include "noise.hpp"
 #include "util.hpp"
 #include "fswatch.hpp"
+#include "jobs.hpp"
+#include "meshopt.hpp"
+#include "raycast.hpp"
+#include "texture_container.hpp"
 
 using namespace std;
 
@@ -33,6 +43,10 @@ struct resource_program_t
 {
     int shader_count;
     char shader_filenames[8][256];
+    // space separated names, each #defined at the top of every shader
+    char features[256];
+    // of the program binary cache entry, see program_cache_key
+    unsigned long long cache_key;
 
     renderl_program_t uploaded_program;
 };
@@ -52,6 +66,19 @@ struct resource_texture_t
 static resource_texture_t textures[MAX_TEXTURE_COUNT];
 static int texture_count = 0;
 
+#define MAX_TEXTURE_ARRAY_LAYERS 16
+struct resource_texture_array_t
+{
+    int layer_count;
+    char filenames[MAX_TEXTURE_ARRAY_LAYERS][256];
+
+    renderl_texture_t uploaded_texture;
+};
+
+#define MAX_TEXTURE_ARRAY_COUNT 10
+static resource_texture_array_t texture_arrays[MAX_TEXTURE_ARRAY_COUNT];
+static int texture_array_count = 0;
+
 struct resource_wave_t
 {
     char filename[256];
@@ -63,8 +90,23 @@ struct resource_wave_t
 static resource_wave_t waves[MAX_WAVE_COUNT];
 static int wave_count = 0;
 
+// linked programs are kept here between runs
+#define PROGRAM_CACHE_DIRECTORY "cache"
+
+// stand in for textures still being decoded
+static renderl_texture_t placeholder_texture;
+static renderl_texture_t placeholder_texture_array;
+
 void resource_init()
 {
+    mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+
+    unsigned char gray[4] = { 128, 128, 128, 255 };
+    placeholder_texture = renderl_upload_texture(1, 1, GL_RGBA, gray);
+
+    const void *level = gray;
+    int level_size = sizeof(gray);
+    placeholder_texture_array = renderl_upload_texture_array(1, 1, GL_RGBA, 1, 1, &level, &level_size);
 }
 
 static void get_dirname(const char* path, string& dirname)
@@ -257,46 +299,202 @@ extern stbi_uc *stbi_load            (char const *filename,     int *x, int *y,
 extern void     stbi_image_free      (void *retval_from_stbi_load);
 };
 
-static renderl_texture_t upload_texture(const char *filename)
+// state of one decode handed to a worker, owned by the job
+struct texture_decode_t
 {
-    int width, height, n;
-    unsigned char *data = stbi_load(filename, &width, &height, &n, 0);
-    if (!data)
+    resource_texture_t *record;
+    char filename[256];
+    int width, height;
+    unsigned char *pixels;
+    // the whole cooked file mapped in, when there is one newer than the image
+    const texture_container_header_t *container;
+    size_t container_size;
+};
+
+static bool valid_container(const texture_container_header_t *header, size_t size)
+{
+    if (size < sizeof(texture_container_header_t) || header->magic != TEXTURE_CONTAINER_MAGIC || header->version != TEXTURE_CONTAINER_VERSION)
     {
-        printf("Couldn't open '%s'\n", filename);
-        assert(0);
+        return false;
+    }
+    if (header->format > TEXTURE_CONTAINER_BC5 || header->mip_count < 1 || header->mip_count > TEXTURE_CONTAINER_MAX_MIPS)
+    {
+        return false;
     }
+    for (int i = 0; i < header->mip_count; i++)
+    {
+        if (header->mip_offsets[i] > size || header->mip_sizes[i] > size - header->mip_offsets[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    assert(n == 3 || n == 4);
+// maps the .tex that make cook writes next to the image
+static bool map_cooked_texture(texture_decode_t *decode)
+{
+    const char *extension = strrchr(decode->filename, '.');
+    if (!extension)
+    {
+        return false;
+    }
+    char cooked_filename[sizeof(decode->filename) + 4];
+    sprintf(cooked_filename, "%.*s.tex", (int)(extension - decode->filename), decode->filename);
 
-    int bpl = n * width;
+    // an image edited since cooking wins, so hot reloading keeps working
+    struct stat image_stat, cooked_stat;
+    if (stat(cooked_filename, &cooked_stat) != 0)
+    {
+        return false;
+    }
+    if (stat(decode->filename, &image_stat) == 0 && image_stat.st_mtime > cooked_stat.st_mtime)
+    {
+        return false;
+    }
 
-    void *flipped_data = malloc(bpl * height);
+    int fd = open(cooked_filename, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    size_t size = cooked_stat.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
 
-    unsigned char *d1 = (unsigned char *)data;
-    unsigned char *d2 = (unsigned char *)flipped_data;
-    for (int y = 0; y < height; y++)
+    const texture_container_header_t *header = (const texture_container_header_t *)p;
+    if (!valid_container(header, size))
     {
-        memcpy(&d2[(height - y - 1) * bpl], &d1[y * bpl], bpl);
+        printf("'%s' is not a texture container, decoding '%s' instead\n", cooked_filename, decode->filename);
+        munmap(p, size);
+        return false;
     }
 
-    renderl_texture_t res = renderl_upload_texture(width, height, n == 3 ? GL_RGB : GL_RGBA, flipped_data);
+    // fault the pages in here instead of in the upload on the main thread
+    volatile unsigned char touched = 0;
+    for (size_t offset = 0; offset < size; offset += 4096)
+    {
+        touched += ((const unsigned char *)p)[offset];
+    }
 
-    free(flipped_data);
-    stbi_image_free(data);
+    decode->container = header;
+    decode->container_size = size;
+    return true;
+}
 
-    return res;
+// stb_image only touches its arguments and the file, so this is safe on a worker
+static void decode_image(texture_decode_t *decode)
+{
+    int n;
+    decode->pixels = stbi_load(decode->filename, &decode->width, &decode->height, &n, 4);
+    if (!decode->pixels)
+    {
+        return;
+    }
+
+    // gl wants the bottom row first
+    int bpl = 4 * decode->width;
+    unsigned char *row = (unsigned char *)malloc(bpl);
+    for (int y = 0; y < decode->height / 2; y++)
+    {
+        unsigned char *a = &decode->pixels[y * bpl];
+        unsigned char *b = &decode->pixels[(decode->height - y - 1) * bpl];
+        memcpy(row, a, bpl);
+        memcpy(a, b, bpl);
+        memcpy(b, row, bpl);
+    }
+    free(row);
+}
+
+static void release_decode(texture_decode_t *decode)
+{
+    if (decode->container)
+    {
+        munmap((void *)decode->container, decode->container_size);
+        decode->container = NULL;
+    }
+    if (decode->pixels)
+    {
+        stbi_image_free(decode->pixels);
+        decode->pixels = NULL;
+    }
+}
+
+// worker side
+static void decode_texture(void *user_data)
+{
+    texture_decode_t *decode = (texture_decode_t *)user_data;
+    if (!map_cooked_texture(decode))
+    {
+        decode_image(decode);
+    }
+}
+
+static int container_gl_format(unsigned int format)
+{
+    static const int formats[] = { GL_RGBA, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 };
+    return formats[format];
+}
+
+// every level straight out of the mapping
+static renderl_texture_t upload_cooked_texture(const texture_container_header_t *header)
+{
+    const void *levels[TEXTURE_CONTAINER_MAX_MIPS];
+    int level_sizes[TEXTURE_CONTAINER_MAX_MIPS];
+    for (int i = 0; i < header->mip_count; i++)
+    {
+        levels[i] = (const unsigned char *)header + header->mip_offsets[i];
+        level_sizes[i] = header->mip_sizes[i];
+    }
+    return renderl_upload_texture_levels(header->width, header->height, container_gl_format(header->format), header->mip_count, levels, level_sizes);
+}
+
+// main thread side, swaps the placeholder or the previous version for the new texture
+static void upload_decoded_texture(void *user_data)
+{
+    texture_decode_t *decode = (texture_decode_t *)user_data;
+    if (!decode->container && !decode->pixels)
+    {
+        printf("Couldn't open '%s'\n", decode->filename);
+        assert(0);
+    }
+
+    resource_texture_t *record = decode->record;
+    if (record->uploaded_texture.handle != placeholder_texture.handle)
+    {
+        renderl_delete_texture(record->uploaded_texture);
+    }
+
+    if (decode->container)
+    {
+        record->uploaded_texture = upload_cooked_texture(decode->container);
+    }
+    else
+    {
+        record->uploaded_texture = renderl_stream_texture(decode->width, decode->height, GL_RGBA, decode->pixels);
+    }
+
+    release_decode(decode);
+    delete decode;
 }
 
-static void reload_texture_record(resource_texture_t *record)
+static void decode_texture_record(resource_texture_t *record)
 {
-    renderl_delete_texture(record->uploaded_texture);
-    record->uploaded_texture = upload_texture(record->filename);
+    texture_decode_t *decode = new texture_decode_t;
+    decode->record = record;
+    strcpy(decode->filename, record->filename);
+    decode->pixels = NULL;
+    decode->container = NULL;
+    jobs_submit(decode_texture, upload_decoded_texture, decode);
 }
 
 static void reload_texture_record_proxy(void *record)
 {
-    reload_texture_record((resource_texture_t *)record);
+    decode_texture_record((resource_texture_t *)record);
 }
 
 const renderl_texture_t *resource_upload_texture(const char *filename)
@@ -309,11 +507,166 @@ const renderl_texture_t *resource_upload_texture(const char *filename)
 
     fswatch_add_modified_callback(filename, reload_texture_record_proxy, &record);
 
-    record.uploaded_texture = upload_texture(filename);
+    // draws as the placeholder until the decode is done
+    record.uploaded_texture = placeholder_texture;
+    decode_texture_record(&record);
 
     return &record.uploaded_texture;
 }
 
+struct texture_array_decode_t
+{
+    resource_texture_array_t *record;
+    int layer_count;
+    texture_decode_t layers[MAX_TEXTURE_ARRAY_LAYERS];
+};
+
+static bool same_container_layout(const texture_container_header_t &a, const texture_container_header_t &b)
+{
+    if (a.format != b.format || a.width != b.width || a.height != b.height || a.mip_count != b.mip_count)
+    {
+        return false;
+    }
+    for (int i = 0; i < a.mip_count; i++)
+    {
+        if (a.mip_sizes[i] != b.mip_sizes[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// worker side. one array can't mix formats, so either every layer has a
+// cooked file of the same layout or every layer is decoded from its image
+static void decode_texture_array(void *user_data)
+{
+    texture_array_decode_t *decode = (texture_array_decode_t *)user_data;
+
+    bool cooked = true;
+    for (int i = 0; i < decode->layer_count && cooked; i++)
+    {
+        cooked = map_cooked_texture(&decode->layers[i]) && same_container_layout(*decode->layers[0].container, *decode->layers[i].container);
+    }
+    if (cooked)
+    {
+        return;
+    }
+
+    for (int i = 0; i < decode->layer_count; i++)
+    {
+        release_decode(&decode->layers[i]);
+        decode_image(&decode->layers[i]);
+    }
+}
+
+static void upload_decoded_texture_array(void *user_data)
+{
+    texture_array_decode_t *decode = (texture_array_decode_t *)user_data;
+    texture_decode_t *layers = decode->layers;
+
+    const void *levels[MAX_TEXTURE_ARRAY_LAYERS * TEXTURE_CONTAINER_MAX_MIPS];
+    int level_sizes[MAX_TEXTURE_ARRAY_LAYERS * TEXTURE_CONTAINER_MAX_MIPS];
+    int format, width, height, level_count;
+    if (layers[0].container)
+    {
+        const texture_container_header_t *header = layers[0].container;
+        format = container_gl_format(header->format);
+        width = header->width;
+        height = header->height;
+        level_count = header->mip_count;
+        for (int i = 0; i < decode->layer_count; i++)
+        {
+            for (int j = 0; j < level_count; j++)
+            {
+                levels[i * level_count + j] = (const unsigned char *)layers[i].container + layers[i].container->mip_offsets[j];
+                level_sizes[i * level_count + j] = layers[i].container->mip_sizes[j];
+            }
+        }
+    }
+    else
+    {
+        format = GL_RGBA;
+        width = layers[0].width;
+        height = layers[0].height;
+        level_count = 1;
+        for (int i = 0; i < decode->layer_count; i++)
+        {
+            if (!layers[i].pixels)
+            {
+                printf("Couldn't open '%s'\n", layers[i].filename);
+                assert(0);
+            }
+            if (layers[i].width != width || layers[i].height != height)
+            {
+                printf("'%s' is %dx%d, the first layer of its array is %dx%d\n", layers[i].filename, layers[i].width, layers[i].height, width, height);
+                assert(0);
+            }
+            levels[i] = layers[i].pixels;
+            level_sizes[i] = 4 * width * height;
+        }
+    }
+
+    resource_texture_array_t *record = decode->record;
+    if (record->uploaded_texture.handle != placeholder_texture_array.handle)
+    {
+        renderl_delete_texture(record->uploaded_texture);
+    }
+    record->uploaded_texture = renderl_upload_texture_array(width, height, format, decode->layer_count, level_count, levels, level_sizes);
+
+    for (int i = 0; i < decode->layer_count; i++)
+    {
+        release_decode(&layers[i]);
+    }
+    delete decode;
+}
+
+static void decode_texture_array_record(resource_texture_array_t *record)
+{
+    texture_array_decode_t *decode = new texture_array_decode_t;
+    decode->record = record;
+    decode->layer_count = record->layer_count;
+    for (int i = 0; i < record->layer_count; i++)
+    {
+        strcpy(decode->layers[i].filename, record->filenames[i]);
+        decode->layers[i].pixels = NULL;
+        decode->layers[i].container = NULL;
+    }
+    jobs_submit(decode_texture_array, upload_decoded_texture_array, decode);
+}
+
+static void reload_texture_array_record_proxy(void *record)
+{
+    decode_texture_array_record((resource_texture_array_t *)record);
+}
+
+const renderl_texture_t *resource_upload_texture_array(int layer_count, const char **filenames)
+{
+    assert(texture_array_count < MAX_TEXTURE_ARRAY_COUNT);
+    assert(layer_count > 0 && layer_count <= MAX_TEXTURE_ARRAY_LAYERS);
+
+    resource_texture_array_t &record = texture_arrays[texture_array_count++];
+    record.layer_count = layer_count;
+    for (int i = 0; i < layer_count; i++)
+    {
+        assert(strlen(filenames[i]) < sizeof(record.filenames[i]) - 1);
+        strcpy(record.filenames[i], filenames[i]);
+
+        // any layer changing rebuilds the whole array
+        fswatch_add_modified_callback(filenames[i], reload_texture_array_record_proxy, &record);
+    }
+
+    record.uploaded_texture = placeholder_texture_array;
+    decode_texture_array_record(&record);
+
+    return &record.uploaded_texture;
+}
+
+void resource_finish_textures()
+{
+    jobs_finish();
+}
+
 typedef struct stb_vorbis stb_vorbis;
 typedef struct
 {
@@ -452,6 +805,14 @@ struct mesh_in_progress_t
 	vector<int> texcoord_indices;
 };
 
+struct obj_vertex_t
+{
+    vec3_t<> position;
+    vec3_t<> normal;
+    vec2_t<> tex_coord;
+    vec3_t<> tangent;
+};
+
 struct wavefront_material_t
 {
     string name;
@@ -484,86 +845,165 @@ struct wavefront_material_t
     {}
 };
 
-static renderm_mesh_t *create_mesh(const mesh_in_progress_t &m)
+static renderm_mesh_t *upload_mesh(const vector<obj_vertex_t> &vertices, const vector<unsigned int> &indices)
+{
+    int vertex_count = vertices.size();
+    int index_count = indices.size();
+
+    vec3_t<> *position_array = new vec3_t<>[vertex_count];
+    vec3_t<> *normal_array = new vec3_t<>[vertex_count];
+    vec3_t<> *tangent_array = new vec3_t<>[vertex_count];
+    vec2_t<> *texture_coord_array = new vec2_t<>[vertex_count];
+
+    for (int i = 0; i < vertex_count; i++)
+    {
+        position_array[i] = vertices[i].position;
+        normal_array[i] = vertices[i].normal;
+        tangent_array[i] = vertices[i].tangent;
+        texture_coord_array[i] = vertices[i].tex_coord;
+    }
+
+    // renderm stores 16-bit indices when the vertex count allows it
+    renderm_mesh_t *res = new renderm_mesh_t;
+    *res = renderm_create_mesh(vertex_count, position_array, normal_array, tangent_array, texture_coord_array, GL_UNSIGNED_INT, &indices[0], index_count, GL_TRIANGLES, RENDERM_PACK_NORMALS | RENDERM_PACK_TEX_COORDS | RENDERM_QUANTIZE_POSITIONS);
+
+    delete[] position_array;
+    delete[] normal_array;
+    delete[] tangent_array;
+    delete[] texture_coord_array;
+
+    return res;
+}
+
+// model space triangle bvh of the whole group for cpu picking
+static const raycast_bvh_t *create_bvh(const mesh_in_progress_t &m)
 {
+    raycast_bvh_t *bvh = new raycast_bvh_t;
+    int triangle_count = m.position_indices.size() / 3;
+    raycast_build_bvh(bvh, &m.positions[0], triangle_count, triangle_count > 0 ? &m.position_indices[0] : NULL);
+    return bvh;
+}
+
+// welds, optimizes and uploads a group. groups with more than 64k unique
+// vertices are split into several meshes to keep 16-bit indices
+static void create_meshes(const mesh_in_progress_t &m, vector<const renderm_mesh_t *> *meshes)
+{
+    typedef obj_vertex_t vertex_t;
+
     int index_count = m.position_indices.size();
-    assert(index_count < 65536);
 
-    float *position_array = new float[3 * index_count];
-    float *normal_array = new float[3 * index_count];
-    float *tangent_array = new float[3 * index_count];
-    float *texture_coord_array = new float[2 * index_count];
-    unsigned short *index_array = new unsigned short[index_count];
+    // obj indexes each attribute separately, so expand every triangle corner
+    // and weld the identical ones back together
+    vertex_t *vertices = new vertex_t[index_count];
+    unsigned int *indices = new unsigned int[index_count];
+    unsigned int *remap = new unsigned int[index_count];
+    memset(vertices, 0, index_count * sizeof(vertex_t));
 
-    float max_length = 0.0f;
+    for (int i = 0; i < index_count; i++)
+    {
+        vertices[i].position = m.positions[m.position_indices[i]];
+        vertices[i].normal = m.normals[m.normal_indices[i]];
+        vertices[i].tex_coord = m.texture_coords[m.texcoord_indices[i]];
+        indices[i] = i;
+    }
+
+    float acmr_before = meshopt_acmr(indices, index_count, index_count, 16);
+    int vertex_count = meshopt_weld(index_count, vertices, sizeof(vertex_t), indices, vertices);
+
+    // tangents are summed over the faces sharing a vertex
+    vec3_t<> *bitangents = new vec3_t<>[vertex_count];
+    for (int i = 0; i < vertex_count; i++)
+    {
+        bitangents[i] = vec3_t<>(0.0f, 0.0f, 0.0f);
+    }
 
     for (int i = 0; i < index_count / 3; i++)
     {
-        struct
-        {
-            vec3_t<> position;
-            vec3_t<> normal;
-            vec3_t<> tangent;
-            vec2_t<> tex_coord;
-        } vertices[3];
+        const vertex_t &v0 = vertices[indices[i * 3 + 0]];
+        const vertex_t &v1 = vertices[indices[i * 3 + 1]];
+        const vertex_t &v2 = vertices[indices[i * 3 + 2]];
+
+        // stuff below stolen from http://www.terathon.com/code/tangent.html
+        vec3_t<> q0 = v1.position - v0.position;
+        vec3_t<> q1 = v2.position - v0.position;
+        vec2_t<> tc0 = v1.tex_coord - v0.tex_coord;
+        vec2_t<> tc1 = v2.tex_coord - v0.tex_coord;
+
+        vec3_t<> almost_bitangent(-tc1.x*q0.x+tc0.x*q1.x, -tc1.x*q0.y+tc0.x*q1.y, -tc1.x*q0.z+tc0.x*q1.z);
+        vec3_t<> bitangent = ((1.0f / (tc0.x * tc1.y - tc1.x * tc0.y)) * almost_bitangent).normalized();
 
-        // load data for vertices
         for (int j = 0; j < 3; j++)
         {
-            vertices[j].position = m.positions[m.position_indices[i * 3 + j]];
-            vertices[j].normal = m.normals[m.normal_indices[i * 3 + j]];
-            vertices[j].tex_coord = m.texture_coords[m.texcoord_indices[i * 3 + j]];
+            bitangents[indices[i * 3 + j]] = bitangents[indices[i * 3 + j]] + bitangent;
         }
+    }
 
-        // stuff below stolen from http://www.terathon.com/code/tangent.html
-        vec3_t<> q0 = vertices[1].position - vertices[0].position;
-        vec3_t<> q1 = vertices[2].position - vertices[0].position;
-        vec2_t<> tc0 = vertices[1].tex_coord - vertices[0].tex_coord;
-        vec2_t<> tc1 = vertices[2].tex_coord - vertices[0].tex_coord;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        vertices[i].tangent = bitangents[i].cross(vertices[i].normal).normalized();
+    }
 
-        vec3_t<> almost_bitangent(-tc1.x*q0.x+tc0.x*q1.x, -tc1.x*q0.y+tc0.x*q1.y, -tc1.x*q0.z+tc0.x*q1.z);
-        vec3_t<> bitangent = ((1.0f / (tc0.x * tc1.y - tc1.x * tc0.y)) * almost_bitangent).normalized();
+    meshopt_optimize_post_transform(indices, index_count, vertex_count, 16);
+    meshopt_optimize_vertex_fetch(indices, index_count, vertex_count, remap);
 
+    vertex_t *ordered_vertices = new vertex_t[vertex_count];
+    meshopt_remap_vertices(vertex_count, remap, sizeof(vertex_t), vertices, ordered_vertices);
+
+    printf("mesh: %d -> %d vertices, ACMR %.3f -> %.3f\n", index_count, vertex_count, acmr_before, meshopt_acmr(indices, index_count, vertex_count, 16));
+
+    // walk the optimized triangles and start a new sub-mesh whenever the
+    // next one would push the current one past 16-bit indices
+    vector<int> local_indices(vertex_count, -1);
+    vector<unsigned int> global_indices;
+    vector<vertex_t> sub_vertices;
+    vector<unsigned int> sub_indices;
+
+    for (int i = 0; i < index_count; i += 3)
+    {
+        int new_vertex_count = 0;
         for (int j = 0; j < 3; j++)
         {
-            vertices[j].tangent = bitangent.cross(vertices[j].normal).normalized();
+            if (local_indices[indices[i + j]] == -1)
+            {
+                new_vertex_count++;
+            }
+        }
+
+        if (sub_vertices.size() + new_vertex_count > 65536)
+        {
+            meshes->push_back(upload_mesh(sub_vertices, sub_indices));
+            for (int j = 0; j < (int)global_indices.size(); j++)
+            {
+                local_indices[global_indices[j]] = -1;
+            }
+            global_indices.clear();
+            sub_vertices.clear();
+            sub_indices.clear();
         }
 
-        // store triangle data in arrays
         for (int j = 0; j < 3; j++)
         {
-            position_array[i * 3 * 3 + j * 3 + 0] = vertices[j].position.c[0];
-            position_array[i * 3 * 3 + j * 3 + 1] = vertices[j].position.c[1];
-            position_array[i * 3 * 3 + j * 3 + 2] = vertices[j].position.c[2];
-            normal_array[i * 3 * 3 + j * 3 + 0] = vertices[j].normal.c[0];
-            normal_array[i * 3 * 3 + j * 3 + 1] = vertices[j].normal.c[1];
-            normal_array[i * 3 * 3 + j * 3 + 2] = vertices[j].normal.c[2];
-            tangent_array[i * 3 * 3 + j * 3 + 0] = vertices[j].tangent.c[0];
-            tangent_array[i * 3 * 3 + j * 3 + 1] = vertices[j].tangent.c[1];
-            tangent_array[i * 3 * 3 + j * 3 + 2] = vertices[j].tangent.c[2];
-            texture_coord_array[i * 2 * 3 + j * 2 + 0] = vertices[j].tex_coord.c[0];
-            texture_coord_array[i * 2 * 3 + j * 2 + 1] = vertices[j].tex_coord.c[1];
-
-            index_array[i * 3 + j] = i * 3 + j;
+            unsigned int index = indices[i + j];
+            if (local_indices[index] == -1)
+            {
+                local_indices[index] = sub_vertices.size();
+                global_indices.push_back(index);
+                sub_vertices.push_back(ordered_vertices[index]);
+            }
+            sub_indices.push_back(local_indices[index]);
         }
     }
 
-    renderm_mesh_t *res = new renderm_mesh_t;
-    res->position_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, position_array, 3 * sizeof(float) * index_count);
-    res->normal_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, normal_array, 3 * sizeof(float) * index_count);
-    res->tangent_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 3, tangent_array, 3 * sizeof(float) * index_count);
-    res->tex_coord_buffer = renderl_upload_vertex_buffer(GL_FLOAT, 2, texture_coord_array, 2 * sizeof(float) * index_count);
-    res->index_buffer = renderl_upload_index_buffer(GL_UNSIGNED_SHORT, index_array, sizeof(unsigned short) * index_count);
-    res->index_count = index_count;
-    res->primitive_type = GL_TRIANGLES;
-
-    delete[] position_array;
-    delete[] normal_array;
-    delete[] tangent_array;
-    delete[] texture_coord_array;
-    delete[] index_array;
+    if (sub_indices.size())
+    {
+        meshes->push_back(upload_mesh(sub_vertices, sub_indices));
+    }
 
-    return res;
+    delete[] vertices;
+    delete[] indices;
+    delete[] remap;
+    delete[] bitangents;
+    delete[] ordered_vertices;
 }
 
 static renderm_material_t *create_material(const wavefront_material_t &m)
@@ -606,7 +1046,8 @@ static renderm_material_t *create_material(const wavefront_material_t &m)
         }
 
         res = nmm;
-        res->program = resource_upload_program(2, "data/shaders/simple_material.vert", "data/shaders/simple_material.frag");
+        res->program = resource_upload_program_variant(nmm->features(), 2, "data/shaders/simple_material.vert", "data/shaders/simple_material.frag");
+        nmm->upload_uniforms();
     }
     else
     {
@@ -891,16 +1332,19 @@ void resource_load_obj_models(const char *filename, vector<renderh_model_t> *mod
                 cout << "finished working on " << processing_group << endl;
 
                 renderh_model_t model;
-                model.mesh_count = 1;
-                model.meshes[0] = create_mesh(mesh_in_progress);
+                create_meshes(mesh_in_progress, &model.meshes);
+                renderh_update_model_bounds(&model);
                 if (active_material == NULL)
                 {
                     assert(library.size() == 1);
                     active_material = &library[0];
                 }
-                model.materials[0] = create_material(*active_material);
-                if (model.materials[0])
+                const renderm_material_t *material = create_material(*active_material);
+                if (material)
                 {
+                    // sub-meshes of a split group share its material
+                    model.materials.assign(model.meshes.size(), material);
+                    model.bvh = create_bvh(mesh_in_progress);
                     models->push_back(model);
                     static int count = 5000;
                     if (count-- == 0)
@@ -929,16 +1373,19 @@ void resource_load_obj_models(const char *filename, vector<renderh_model_t> *mod
     {
         //cout << "finished working on " << processing_group << endl;
         renderh_model_t model;
-        model.mesh_count = 1;
-        model.meshes[0] = create_mesh(mesh_in_progress);
+        create_meshes(mesh_in_progress, &model.meshes);
+        renderh_update_model_bounds(&model);
         if (active_material == NULL)
         {
             assert(library.size() == 1);
             active_material = &library[0];
         }
-        model.materials[0] = create_material(*active_material);
-        if (model.materials[0])
+        const renderm_material_t *material = create_material(*active_material);
+        if (material)
         {
+            // sub-meshes of a split group share its material
+            model.materials.assign(model.meshes.size(), material);
+            model.bvh = create_bvh(mesh_in_progress);
             models->push_back(model);
         }
         mesh_in_progress.position_indices.clear();
@@ -966,11 +1413,127 @@ struct resource_program_t
 };
 */
 
-static renderl_program_t upload_program(int shader_count, char filenames[8][256])
+// fnv-1a
+static unsigned long long hash_bytes(unsigned long long hash, const void *data, int size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// every source and the driver, binaries only load on the driver that made them
+static unsigned long long program_cache_key(int shader_source_count, const renderl_source_t *shader_sources)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (int i = 0; i < 3; i++)
+    {
+        const char *string = (const char *)glGetString(driver_strings[i]);
+        hash = hash_bytes(hash, string, strlen(string) + 1);
+    }
+
+    for (int i = 0; i < shader_source_count; i++)
+    {
+        const renderl_source_t &source = shader_sources[i];
+        hash = hash_bytes(hash, &source.type, sizeof(source.type));
+        hash = hash_bytes(hash, source.name, strlen(source.name) + 1);
+        hash = hash_bytes(hash, source.source, source.source_size);
+    }
+    return hash;
+}
+
+static void program_cache_filename(unsigned long long key, char *filename)
+{
+    sprintf(filename, "%s/program_%016llx.bin", PROGRAM_CACHE_DIRECTORY, key);
+}
+
+static renderl_program_t load_cached_program(unsigned long long key)
+{
+    renderl_program_t res;
+    res.handle = 0;
+
+    char filename[256];
+    program_cache_filename(key, filename);
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        return res;
+    }
+
+    // the binary format followed by the binary
+    fseek(f, 0, SEEK_END);
+    int size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = (char *)malloc(size);
+    bool ok = size > (int)sizeof(int) && (int)fread(data, 1, size, f) == size;
+    fclose(f);
+
+    if (ok)
+    {
+        int format;
+        memcpy(&format, data, sizeof(int));
+        res = renderl_load_program_binary(format, data + sizeof(int), size - sizeof(int));
+    }
+    free(data);
+
+    if (res.handle == 0)
+    {
+        printf("Stale program cache entry '%s', compiling instead\n", filename);
+        unlink(filename);
+    }
+    return res;
+}
+
+static void store_cached_program(unsigned long long key, const renderl_program_t &program)
+{
+    int format, size;
+    void *binary = renderl_get_program_binary(program, &format, &size);
+    if (!binary)
+    {
+        return;
+    }
+
+    char filename[256];
+    program_cache_filename(key, filename);
+    FILE *f = fopen(filename, "wb");
+    if (f)
+    {
+        fwrite(&format, sizeof(int), 1, f);
+        fwrite(binary, 1, size, f);
+        fclose(f);
+    }
+    free(binary);
+}
+
+// "A B" becomes "#define A\n#define B\n"
+static int feature_defines(const char *features, char *defines, int defines_size)
+{
+    int length = 0;
+    defines[0] = '\0';
+
+    char copy[256];
+    strcpy(copy, features);
+    for (char *name = strtok(copy, " "); name; name = strtok(NULL, " "))
+    {
+        length += snprintf(defines + length, defines_size - length, "#define %s\n", name);
+        assert(length < defines_size);
+    }
+    return length;
+}
+
+static renderl_program_t upload_program(int shader_count, char filenames[8][256], const char *features, unsigned long long *cache_key)
 {
     renderl_source_t shader_sources[16];
     int shader_source_count = 0;
 
+    char defines[1024];
+    int defines_length = feature_defines(features, defines, sizeof(defines));
+
     for (int i = 0; i < shader_count; i++)
     {
         const char *filename = filenames[i];
@@ -979,49 +1542,49 @@ static renderl_program_t upload_program(int shader_count, char filenames[8][256]
         int read = slurp(filename, buffer, sizeof(buffer));
         assert(read > 0 && read != sizeof(buffer));
 
+        // libraries like noise4D.glsl go into both stages
+        int types[2];
+        int type_count = 0;
         if (strstr(filename, ".vert") != NULL)
         {
-            char *buffer_copy = new char[read];
-            memcpy(buffer_copy, buffer, read);
-            renderl_source_t &source = shader_sources[shader_source_count++];
-            source.type = GL_VERTEX_SHADER;
-            source.name = filename;
-            source.source = buffer_copy;
-            source.source_size = read;
+            types[type_count++] = GL_VERTEX_SHADER;
         }
         else if (strstr(filename, ".frag") != NULL)
         {
-            char *buffer_copy = new char[read];
-            memcpy(buffer_copy, buffer, read);
+            types[type_count++] = GL_FRAGMENT_SHADER;
+        }
+        else
+        {
+            types[type_count++] = GL_FRAGMENT_SHADER;
+            types[type_count++] = GL_VERTEX_SHADER;
+        }
+
+        for (int j = 0; j < type_count; j++)
+        {
+            char *buffer_copy = new char[defines_length + read];
+            memcpy(buffer_copy, defines, defines_length);
+            memcpy(buffer_copy + defines_length, buffer, read);
 
             renderl_source_t &source = shader_sources[shader_source_count++];
-            source.type = GL_FRAGMENT_SHADER;
+            source.type = types[j];
             source.name = filename;
             source.source = buffer_copy;
-            source.source_size = read;
+            source.source_size = defines_length + read;
         }
-        else
+    }
+
+    // the cache is keyed by content, so edited sources miss it and get compiled
+    *cache_key = program_cache_key(shader_source_count, shader_sources);
+    renderl_program_t res = load_cached_program(*cache_key);
+    if (res.handle == 0)
+    {
+        res = renderl_upload_program(shader_source_count, shader_sources);
+        if (res.handle != 0)
         {
-            char *buffer_copy0 = new char[read];
-            memcpy(buffer_copy0, buffer, read);
-            char *buffer_copy1 = new char[read];
-            memcpy(buffer_copy1, buffer, read);
-
-            renderl_source_t &source0 = shader_sources[shader_source_count++];
-            source0.type = GL_FRAGMENT_SHADER;
-            source0.name = filename;
-            source0.source = buffer_copy0;
-            source0.source_size = read;
-            renderl_source_t &source1 = shader_sources[shader_source_count++];
-            source1.type = GL_VERTEX_SHADER;
-            source1.name = filename;
-            source1.source = buffer_copy1;
-            source1.source_size = read;
+            store_cached_program(*cache_key, res);
         }
     }
 
-    renderl_program_t res = renderl_upload_program(shader_source_count, shader_sources);
-
     // clean up
     for (int i = 0; i < shader_source_count; i++)
     {
@@ -1034,11 +1597,21 @@ static renderl_program_t upload_program(int shader_count, char filenames[8][256]
 
 static void reload_program_record(resource_program_t *record)
 {
-    renderl_program_t res = upload_program(record->shader_count, record->shader_filenames);
+    unsigned long long cache_key;
+    renderl_program_t res = upload_program(record->shader_count, record->shader_filenames, record->features, &cache_key);
     if (res.handle != 0)
     {
         renderl_delete_program(record->uploaded_program);
         record->uploaded_program = res;
+
+        // the old entry will never be hit again
+        if (cache_key != record->cache_key)
+        {
+            char filename[256];
+            program_cache_filename(record->cache_key, filename);
+            unlink(filename);
+            record->cache_key = cache_key;
+        }
     }
 }
 
@@ -1055,33 +1628,66 @@ void resource_reload_programs()
     }
 }
 
-const renderl_program_t *resource_upload_program(int shader_count, ...)
+static const renderl_program_t *upload_program_record(const char *features, int shader_count, va_list argp)
 {
     assert(shader_count < 8);
+    assert(strlen(features) < sizeof(resource_program_t::features) - 1);
+
+    const char *filenames[8];
+    for (int i = 0; i < shader_count; i++)
+    {
+        filenames[i] = va_arg(argp, const char *);
+        assert(strlen(filenames[i]) < sizeof(resource_program_t::shader_filenames[0]) - 1);
+    }
+
+    // every variant is compiled the first time it is asked for and shared from then on
+    for (int i = 0; i < program_count; i++)
+    {
+        resource_program_t &record = programs[i];
+        bool same = record.shader_count == shader_count && strcmp(record.features, features) == 0;
+        for (int j = 0; j < shader_count && same; j++)
+        {
+            same = strcmp(record.shader_filenames[j], filenames[j]) == 0;
+        }
+        if (same)
+        {
+            return &record.uploaded_program;
+        }
+    }
 
     assert(program_count < MAX_PROGRAM_COUNT);
     resource_program_t &record = programs[program_count++];
 
     record.shader_count = shader_count;
-
-    va_list argp;
-    va_start(argp, shader_count);
-
+    strcpy(record.features, features);
     for (int i = 0; i < shader_count; i++)
     {
-        const char *filename = va_arg(argp, const char *);
-        assert(strlen(filename) < sizeof(resource_program_t::shader_filenames[0]) - 1);
-
-        strcpy(record.shader_filenames[i], filename);
+        strcpy(record.shader_filenames[i], filenames[i]);
 
-        fswatch_add_modified_callback(filename, reload_program_record_proxy, &record);
+        fswatch_add_modified_callback(filenames[i], reload_program_record_proxy, &record);
     }
 
-    va_end(argp);
-
-    record.uploaded_program = upload_program(record.shader_count, record.shader_filenames);
+    record.uploaded_program = upload_program(record.shader_count, record.shader_filenames, record.features, &record.cache_key);
     assert(record.uploaded_program.handle != 0);
 
     return &record.uploaded_program;
 }
 
+const renderl_program_t *resource_upload_program(int shader_count, ...)
+{
+    va_list argp;
+    va_start(argp, shader_count);
+    const renderl_program_t *res = upload_program_record("", shader_count, argp);
+    va_end(argp);
+    return res;
+}
+
+const renderl_program_t *resource_upload_program_variant(const char *features, int shader_count, ...)
+{
+    va_list argp;
+    va_start(argp, shader_count);
+    const renderl_program_t *res = upload_program_record(features, shader_count, argp);
+    va_end(argp);
+    return res;
+}
+
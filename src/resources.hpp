@@ -10,9 +10,17 @@ void resource_init();
 renderm_mesh_t resource_load_obj_mesh(const char *filename);
 renderm_material_t *resource_load_mtl_material(const char *filename);
 renderh_model_t resource_load_obj_model(const char *filename);
+// decodes on a worker, the texture is a placeholder until the upload is done
 const renderl_texture_t *resource_upload_texture(const char *filename);
+// one GL_TEXTURE_2D_ARRAY with a layer per image, all of the same size
+const renderl_texture_t *resource_upload_texture_array(int layer_count, const char **filenames);
+// blocks until every texture requested so far is uploaded
+void resource_finish_textures();
 renderl_texture_t resource_upload_noise_texture(int width, int height);
 const renderl_program_t *resource_upload_program(int shader_count, ...);
+// the program compiled with every name in the space separated features
+// #defined, e.g. "DIFFUSE_MAP NORMAL_MAP". asking again gives the same one
+const renderl_program_t *resource_upload_program_variant(const char *features, int shader_count, ...);
 const class audiol_wave_t *resource_upload_wave(const char *filename);
 
 void resource_load_obj_models(const char *filename, std::vector<renderh_model_t> *models);
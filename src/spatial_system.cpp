@@ -0,0 +1,164 @@
+#include <map>
+#include <cmath>
+
+#include "components.hpp"
+#include "spatial_system.hpp"
+#include "renderh.hpp"
+
+struct proxy_t
+{
+    int proxy;
+    int last_seen;
+    // as last placed, before the tree margin
+    aabb_t box;
+};
+
+static aabb_tree_t tree;
+static std::map<int, proxy_t> proxies;
+static std::vector<aabb_t> changed;
+// the bounds each entity gets this update, see add_box
+static std::map<int, aabb_t> boxes;
+static int update_count;
+
+// boxes are grown by this much, so small movements don't touch the tree
+static const float margin = 0.5f;
+
+void spatial_system_t::init()
+{
+    aabb_tree_init(&tree, margin);
+    proxies.clear();
+    changed.clear();
+    update_count = 0;
+}
+
+static bool same_box(const aabb_t &a, const aabb_t &b)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (a.low.c[i] != b.low.c[i] || a.high.c[i] != b.high.c[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// an entity has one proxy, so one that is both rendered and heard gets the
+// union of both boxes
+static void add_box(int entity, const aabb_t &box)
+{
+    std::map<int, aabb_t>::iterator it = boxes.find(entity);
+    if (it == boxes.end())
+    {
+        boxes[entity] = box;
+        return;
+    }
+
+    aabb_t &merged = it->second;
+    for (int i = 0; i < 3; i++)
+    {
+        merged.low.c[i] = fminf(merged.low.c[i], box.low.c[i]);
+        merged.high.c[i] = fmaxf(merged.high.c[i], box.high.c[i]);
+    }
+}
+
+static void place(int entity, const aabb_t &box)
+{
+    std::map<int, proxy_t>::iterator it = proxies.find(entity);
+    if (it == proxies.end())
+    {
+        proxy_t &p = proxies[entity];
+        p.proxy = aabb_tree_insert(&tree, box, entity);
+        p.last_seen = update_count;
+        p.box = box;
+        changed.push_back(box);
+    }
+    else
+    {
+        proxy_t &p = it->second;
+        if (!same_box(p.box, box))
+        {
+            changed.push_back(p.box);
+            changed.push_back(box);
+            p.box = box;
+        }
+        aabb_tree_move(&tree, p.proxy, box);
+        p.last_seen = update_count;
+    }
+}
+
+void spatial_system_t::update(float dt)
+{
+    update_count++;
+    changed.clear();
+    boxes.clear();
+
+    entity_manager_t::default_manager->iterate_nodes<position_component_t, render_model_component_t, orientation_component_t>(2, [](int entity, position_component_t *pos, render_model_component_t *model_component, orientation_component_t *orientation)
+    {
+        const renderh_model_t &model = *model_component->model;
+        vec3_t<> offset = model.bounds_center;
+        if (orientation)
+        {
+            offset = (orientation->rotation.rotation_matrix() * vec4_t<>(offset, 0.0f)).xyz();
+        }
+        vec3_t<> center = pos->xyz + offset;
+
+        vec3_t<> r(model.bounds_radius, model.bounds_radius, model.bounds_radius);
+        aabb_t box;
+        box.low = center - r;
+        box.high = center + r;
+        add_box(entity, box);
+    });
+    entity_manager_t::default_manager->iterate_nodes<sound_source_component_t, position_component_t>(2, [](int entity, sound_source_component_t *sound, position_component_t *pos)
+    {
+        aabb_t box;
+        box.low = pos->xyz;
+        box.high = pos->xyz;
+        add_box(entity, box);
+    });
+
+    for (std::map<int, aabb_t>::iterator it = boxes.begin(); it != boxes.end(); ++it)
+    {
+        place(it->first, it->second);
+    }
+
+    // drop entities which lost their components
+    for (std::map<int, proxy_t>::iterator it = proxies.begin(); it != proxies.end();)
+    {
+        if (it->second.last_seen != update_count)
+        {
+            changed.push_back(it->second.box);
+            aabb_tree_remove(&tree, it->second.proxy);
+            proxies.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void spatial_system_t::query_box(const aabb_t &box, std::vector<int> *entities) const
+{
+    aabb_tree_query_box(tree, box, entities);
+}
+
+void spatial_system_t::query_sphere(const vec3_t<> &center, float radius, std::vector<int> *entities) const
+{
+    aabb_tree_query_sphere(tree, center, radius, entities);
+}
+
+void spatial_system_t::query_frustum(const frustum_t &frustum, std::vector<int> *entities) const
+{
+    aabb_tree_query_frustum(tree, frustum, entities);
+}
+
+void spatial_system_t::query_ray(const vec3_t<> &origin, const vec3_t<> &direction, float max_t, std::vector<int> *entities) const
+{
+    aabb_tree_query_ray(tree, origin, direction, max_t, entities);
+}
+
+const std::vector<aabb_t> &spatial_system_t::changed_boxes() const
+{
+    return changed;
+}
@@ -0,0 +1,29 @@
+#ifndef _SPATIAL_SYSTEM_HPP
+#define _SPATIAL_SYSTEM_HPP
+
+#include <vector>
+
+#include "entity_system.hpp"
+#include "aabb_tree.hpp"
+#include "frustum.hpp"
+
+// keeps entities with a position and something to render or hear in an
+// aabb tree, so visibility, picking and audio don't have to visit them all
+class spatial_system_t : public system_t
+{
+public:
+    void init();
+    void update(float dt);
+
+    // queries append entities whose (slightly grown) bounds pass the test
+    void query_box(const aabb_t &box, std::vector<int> *entities) const;
+    void query_sphere(const vec3_t<> &center, float radius, std::vector<int> *entities) const;
+    void query_frustum(const frustum_t &frustum, std::vector<int> *entities) const;
+    void query_ray(const vec3_t<> &origin, const vec3_t<> &direction, float max_t, std::vector<int> *entities) const;
+
+    // exact bounds of everything that appeared, moved or disappeared in the
+    // last update, both the old and the new box of a move
+    const std::vector<aabb_t> &changed_boxes() const;
+};
+
+#endif // _SPATIAL_SYSTEM_HPP
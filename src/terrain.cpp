@@ -0,0 +1,202 @@
+#include <cmath>
+#include <cassert>
+
+#ifdef _OSX
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "terrain.hpp"
+
+// (TERRAIN_GRID_SIZE + 1)^2 vertices over [0, 1] in x and z, positions
+// only since heights and normals come from textures
+static renderm_mesh_t create_patch_mesh()
+{
+    const int n = TERRAIN_GRID_SIZE + 1;
+    std::vector<vec3_t<> > positions(n * n);
+    for (int z = 0; z < n; z++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            positions[x + z * n] = vec3_t<>((float)x / TERRAIN_GRID_SIZE, 0.0f, (float)z / TERRAIN_GRID_SIZE);
+        }
+    }
+
+    std::vector<unsigned int> indices;
+    indices.reserve(6 * TERRAIN_GRID_SIZE * TERRAIN_GRID_SIZE);
+    for (int z = 0; z < TERRAIN_GRID_SIZE; z++)
+    {
+        for (int x = 0; x < TERRAIN_GRID_SIZE; x++)
+        {
+            int a = x + z * n;
+            indices.push_back(a);
+            indices.push_back(a + n);
+            indices.push_back(a + 1);
+            indices.push_back(a + 1);
+            indices.push_back(a + n);
+            indices.push_back(a + n + 1);
+        }
+    }
+
+    return renderm_create_mesh(n * n, &positions[0], NULL, NULL, NULL, GL_UNSIGNED_INT, &indices[0], indices.size(), GL_TRIANGLES, 0);
+}
+
+static int clamp_int(int v, int low, int high)
+{
+    return v < low ? low : (v > high ? high : v);
+}
+
+void terrain_init(terrain_t *terrain, const heightmap_t &heightmap, terrain_material_t *material)
+{
+    terrain->heightmap = heightmap;
+    terrain->material = material;
+
+    // leaves about as wide as the patch grid in heightmap texels
+    float leaves = (float)(heightmap.width - 1) / TERRAIN_GRID_SIZE;
+    terrain->level_count = 1 + (leaves > 1.0f ? (int)floorf(log2f(leaves) + 0.5f) : 0);
+    if (terrain->level_count > TERRAIN_MAX_LEVELS)
+    {
+        terrain->level_count = TERRAIN_MAX_LEVELS;
+    }
+
+    // leaf bounds from the texels they touch, one extra on every side for
+    // the filtering in the vertex shader
+    int leaf_level = terrain->level_count - 1;
+    int n = 1 << leaf_level;
+    std::vector<vec2_t<> > &leaf_heights = terrain->node_heights[leaf_level];
+    leaf_heights.resize(n * n);
+    for (int z = 0; z < n; z++)
+    {
+        int z0 = clamp_int((z * (heightmap.height - 1)) / n - 1, 0, heightmap.height - 1);
+        int z1 = clamp_int(((z + 1) * (heightmap.height - 1) + n - 1) / n + 1, 0, heightmap.height - 1);
+        for (int x = 0; x < n; x++)
+        {
+            int x0 = clamp_int((x * (heightmap.width - 1)) / n - 1, 0, heightmap.width - 1);
+            int x1 = clamp_int(((x + 1) * (heightmap.width - 1) + n - 1) / n + 1, 0, heightmap.width - 1);
+
+            vec2_t<> range(heightmap.heights[x0 + z0 * heightmap.width], heightmap.heights[x0 + z0 * heightmap.width]);
+            for (int tz = z0; tz <= z1; tz++)
+            {
+                for (int tx = x0; tx <= x1; tx++)
+                {
+                    float h = heightmap.heights[tx + tz * heightmap.width];
+                    range.x = fminf(range.x, h);
+                    range.y = fmaxf(range.y, h);
+                }
+            }
+            leaf_heights[x + z * n] = range;
+        }
+    }
+
+    // every other level from the four children below it
+    for (int level = leaf_level - 1; level >= 0; level--)
+    {
+        int n = 1 << level;
+        const std::vector<vec2_t<> > &children = terrain->node_heights[level + 1];
+        std::vector<vec2_t<> > &heights = terrain->node_heights[level];
+        heights.resize(n * n);
+        for (int z = 0; z < n; z++)
+        {
+            for (int x = 0; x < n; x++)
+            {
+                vec2_t<> range = children[2 * x + 2 * z * 2 * n];
+                for (int i = 1; i < 4; i++)
+                {
+                    const vec2_t<> &child = children[(2 * x + (i & 1)) + (2 * z + (i >> 1)) * 2 * n];
+                    range.x = fminf(range.x, child.x);
+                    range.y = fmaxf(range.y, child.y);
+                }
+                heights[x + z * n] = range;
+            }
+        }
+    }
+
+    terrain->patch_mesh = create_patch_mesh();
+    terrain->patch_model = renderh_simple_model(&terrain->patch_mesh, material);
+
+    material->grid_size = TERRAIN_GRID_SIZE;
+    material->lod_range_ratio = TERRAIN_LOD_RANGE_RATIO;
+    material->heightmap_size = vec2_t<>(heightmap.width, heightmap.height);
+    material->baked_noise.handle = 0;
+    material->use_baked_noise = false;
+    material->upload_uniforms();
+}
+
+aabb_t terrain_node_box(const terrain_t &terrain, int level, int x, int z)
+{
+    const heightmap_t &heightmap = terrain.heightmap;
+    vec3_t<> diff = heightmap.xyz_high - heightmap.xyz_low;
+    float n = (float)(1 << level);
+    const vec2_t<> &heights = terrain.node_heights[level][x + z * (1 << level)];
+
+    aabb_t box;
+    box.low = heightmap.xyz_low + vec3_t<>(diff.x * x / n, diff.y * heights.x, diff.z * z / n);
+    box.high = heightmap.xyz_low + vec3_t<>(diff.x * (x + 1) / n, diff.y * heights.y, diff.z * (z + 1) / n);
+    return box;
+}
+
+// distance from the lod origin at which a node of the level is split
+static float lod_range(const terrain_t &terrain, int level)
+{
+    float node_size = (terrain.heightmap.xyz_high.x - terrain.heightmap.xyz_low.x) / (1 << level);
+    return TERRAIN_LOD_RANGE_RATIO * node_size;
+}
+
+static void select_node(const terrain_t &terrain, int level, int x, int z, const vec3_t<> &lod_origin, const frustum_t &frustum, std::vector<terrain_patch_t> *patches)
+{
+    aabb_t box = terrain_node_box(terrain, level, x, z);
+    if (!frustum_test_box(frustum, box.low, box.high))
+    {
+        return;
+    }
+
+    // children out of range of the origin are drawn as patches of their own,
+    // fully morphed to this level, so neighbours always meet on matching vertices
+    if (level == terrain.level_count - 1 || !aabb_overlap_sphere(box, lod_origin, lod_range(terrain, level + 1)))
+    {
+        terrain_patch_t patch;
+        patch.level = level;
+        patch.x = x;
+        patch.z = z;
+        patches->push_back(patch);
+        return;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        select_node(terrain, level + 1, 2 * x + (i & 1), 2 * z + (i >> 1), lod_origin, frustum, patches);
+    }
+}
+
+void terrain_select_patches(const terrain_t &terrain, const vec3_t<> &lod_origin, const frustum_t &frustum, std::vector<terrain_patch_t> *patches)
+{
+    select_node(terrain, 0, 0, 0, lod_origin, frustum, patches);
+}
+
+void terrain_emit_patch_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const terrain_t &terrain, const vec3_t<> &lod_origin, const std::vector<terrain_patch_t> &patches, int base_id)
+{
+    static std::vector<mat4_t<> > model_matrices;
+    if (patches.empty())
+    {
+        return;
+    }
+
+    const heightmap_t &heightmap = terrain.heightmap;
+    vec3_t<> diff = heightmap.xyz_high - heightmap.xyz_low;
+
+    // every patch is an instance of the grid mesh, scaled to its node
+    model_matrices.resize(patches.size());
+    for (int i = 0; i < (int)patches.size(); i++)
+    {
+        const terrain_patch_t &patch = patches[i];
+        float n = (float)(1 << patch.level);
+        vec3_t<> size(diff.x / n, 1.0f, diff.z / n);
+        vec3_t<> low(heightmap.xyz_low.x + size.x * patch.x, 0.0f, heightmap.xyz_low.z + size.z * patch.z);
+
+        model_matrices[i] = mat4_t<>::translation(low) * mat4_t<>::scale(size);
+    }
+
+    terrain.material->lod_origin = lod_origin;
+    renderh_emit_instanced_model_batches(list, eye, model_matrices.size(), &model_matrices[0], terrain.patch_model, base_id);
+}
@@ -0,0 +1,54 @@
+#ifndef _TERRAIN_HPP
+#define _TERRAIN_HPP
+
+#include <vector>
+
+#include "math.hpp"
+#include "frustum.hpp"
+#include "aabb_tree.hpp"
+#include "heightmap.hpp"
+#include "renderm.hpp"
+#include "renderh.hpp"
+#include "material.hpp"
+
+// quads along the side of the shared patch mesh
+#define TERRAIN_GRID_SIZE 16
+#define TERRAIN_MAX_LEVELS 12
+
+// a node is split while the lod origin is within this many node sizes of
+// it. patches have finished morphing to their parent level at that distance
+#define TERRAIN_LOD_RANGE_RATIO 8.0f
+
+// quadtree node picked for drawing, level 0 is the root
+struct terrain_patch_t
+{
+    int level;
+    int x, z;
+};
+
+// chunked lod terrain over a heightmap. every node is drawn with the same
+// grid mesh, displaced and morphed towards its parent level in the vertex shader
+struct terrain_t
+{
+    heightmap_t heightmap;
+    int level_count;
+    // per level the (min, max) heights of its 2^level x 2^level nodes, row
+    // major, as fractions of the heightmap range like the heights themselves
+    std::vector<vec2_t<> > node_heights[TERRAIN_MAX_LEVELS];
+
+    renderm_mesh_t patch_mesh;
+    renderh_model_t patch_model;
+    terrain_material_t *material;
+};
+
+void terrain_init(terrain_t *terrain, const heightmap_t &heightmap, terrain_material_t *material);
+aabb_t terrain_node_box(const terrain_t &terrain, int level, int x, int z);
+// appends the nodes that cover the terrain in the frustum, each at the finest
+// level the distance to lod_origin asks for
+void terrain_select_patches(const terrain_t &terrain, const vec3_t<> &lod_origin, const frustum_t &frustum, std::vector<terrain_patch_t> *patches);
+// one instanced draw, patch i is written to the g-buffer id channel as base_id + i.
+// recorded into list like the renderh_emit functions, but only on the main
+// thread since the lod origin is handed to the shared material
+void terrain_emit_patch_batches(renderl_command_list_t *list, const renderm_eye_t &eye, const terrain_t &terrain, const vec3_t<> &lod_origin, const std::vector<terrain_patch_t> &patches, int base_id);
+
+#endif // _TERRAIN_HPP
@@ -0,0 +1,33 @@
+#ifndef _TEXTURE_CONTAINER_HPP
+#define _TEXTURE_CONTAINER_HPP
+
+// layout of the .tex files written by tools/texture_cooker.cpp. a header
+// followed by every mip level ready to hand to gl, rows bottom first
+#define TEXTURE_CONTAINER_MAGIC 0x58455453 // "STEX"
+#define TEXTURE_CONTAINER_VERSION 1
+#define TEXTURE_CONTAINER_MAX_MIPS 16
+
+enum texture_container_format_t
+{
+    TEXTURE_CONTAINER_RGBA8,
+    // opaque color
+    TEXTURE_CONTAINER_BC1,
+    // color with alpha
+    TEXTURE_CONTAINER_BC3,
+    // two channels, tangent space normal maps with z left to the shader
+    TEXTURE_CONTAINER_BC5,
+};
+
+struct texture_container_header_t
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int format;
+    int width, height;
+    int mip_count;
+    // from the start of the file, largest level first
+    unsigned int mip_offsets[TEXTURE_CONTAINER_MAX_MIPS];
+    unsigned int mip_sizes[TEXTURE_CONTAINER_MAX_MIPS];
+};
+
+#endif // _TEXTURE_CONTAINER_HPP
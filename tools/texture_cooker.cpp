@@ -0,0 +1,424 @@
+// converts an image to a .tex container with its whole mip chain, block
+// compressed unless -u is given. build and run over data/images with make cook
+//
+//   texture_cooker [-n | -u] input.png output.tex
+//
+// -n cooks a tangent space normal map to bc5, keeping only x and y
+// -u keeps the levels as uncompressed rgba
+// otherwise images with any alpha below 255 become bc3 and the rest bc1
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "texture_container.hpp"
+
+typedef unsigned char stbi_uc;
+extern "C" {
+extern stbi_uc *stbi_load            (char const *filename,     int *x, int *y, int *comp, int req_comp);
+extern void     stbi_image_free      (void *retval_from_stbi_load);
+};
+
+struct image_t
+{
+    int width, height;
+    // rgba, bottom row first
+    std::vector<unsigned char> pixels;
+};
+
+static int clamp_int(int v, int low, int high)
+{
+    return v < low ? low : (v > high ? high : v);
+}
+
+static const unsigned char *pixel(const image_t &image, int x, int y)
+{
+    x = clamp_int(x, 0, image.width - 1);
+    y = clamp_int(y, 0, image.height - 1);
+    return &image.pixels[4 * (x + y * image.width)];
+}
+
+// 2x2 box filter, normal maps are renormalized so the lower levels don't flatten out
+static image_t downsample(const image_t &image, bool normal_map)
+{
+    image_t res;
+    res.width = image.width > 1 ? image.width / 2 : 1;
+    res.height = image.height > 1 ? image.height / 2 : 1;
+    res.pixels.resize(4 * res.width * res.height);
+
+    for (int y = 0; y < res.height; y++)
+    {
+        for (int x = 0; x < res.width; x++)
+        {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 4; i++)
+            {
+                const unsigned char *p = pixel(image, 2 * x + (i & 1), 2 * y + (i >> 1));
+                for (int c = 0; c < 4; c++)
+                {
+                    sum[c] += p[c] / 255.0f;
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                sum[c] *= 0.25f;
+            }
+
+            if (normal_map)
+            {
+                float n[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    n[c] = 2.0f * sum[c] - 1.0f;
+                }
+                float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c < 3 && length > 0.0f; c++)
+                {
+                    sum[c] = 0.5f * n[c] / length + 0.5f;
+                }
+            }
+
+            unsigned char *q = &res.pixels[4 * (x + y * res.width)];
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = (unsigned char)clamp_int((int)(255.0f * sum[c] + 0.5f), 0, 255);
+            }
+        }
+    }
+    return res;
+}
+
+static int to_565(const float *c)
+{
+    int r = clamp_int((int)(c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = clamp_int((int)(c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = clamp_int((int)(c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+static void from_565(int v, float *c)
+{
+    c[0] = ((v >> 11) & 31) * 255.0f / 31.0f;
+    c[1] = ((v >> 5) & 63) * 255.0f / 63.0f;
+    c[2] = (v & 31) * 255.0f / 31.0f;
+}
+
+// endpoints at the extremes of the colors along their principal axis,
+// every pixel takes the nearest of the four palette colors
+static void encode_color_block(const unsigned char block[16][4], unsigned char *out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    // power iteration for the dominant eigenvector
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float a[3] =
+        {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float length = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        if (length < 1e-6f)
+        {
+            break;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] = a[c] / length;
+        }
+    }
+
+    float low = 1e9f;
+    float high = -1e9f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+        low = fminf(low, t);
+        high = fmaxf(high, t);
+    }
+
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        e0[c] = mean[c] + high * axis[c];
+        e1[c] = mean[c] + low * axis[c];
+    }
+    int c0 = to_565(e0);
+    int c1 = to_565(e1);
+    // c0 > c1 selects the four color mode
+    if (c0 < c1)
+    {
+        int t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    float palette[4][3];
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    unsigned int indices = 0;
+    for (int i = 0; i < 16 && c0 != c1; i++)
+    {
+        int best = 0;
+        float best_distance = 1e9f;
+        for (int j = 0; j < 4; j++)
+        {
+            float distance = 0.0f;
+            for (int c = 0; c < 3; c++)
+            {
+                float d = block[i][c] - palette[j][c];
+                distance += d * d;
+            }
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = j;
+            }
+        }
+        indices |= best << (2 * i);
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+    {
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+// bc4 block of one channel, max and min as endpoints with the six values between
+static void encode_channel_block(const unsigned char block[16][4], int channel, unsigned char *out)
+{
+    int a0 = 0;
+    int a1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        a0 = block[i][channel] > a0 ? block[i][channel] : a0;
+        a1 = block[i][channel] < a1 ? block[i][channel] : a1;
+    }
+
+    float palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int j = 1; j < 7; j++)
+    {
+        palette[j + 1] = ((7 - j) * a0 + j * a1) / 7.0f;
+    }
+
+    unsigned long long indices = 0;
+    for (int i = 0; i < 16 && a0 != a1; i++)
+    {
+        int best = 0;
+        float best_distance = 1e9f;
+        for (int j = 0; j < 8; j++)
+        {
+            float distance = fabsf(block[i][channel] - palette[j]);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = j;
+            }
+        }
+        indices |= (unsigned long long)best << (3 * i);
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; i++)
+    {
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+static void encode_level(const image_t &image, texture_container_format_t format, std::vector<unsigned char> *out)
+{
+    if (format == TEXTURE_CONTAINER_RGBA8)
+    {
+        *out = image.pixels;
+        return;
+    }
+
+    int block_size = format == TEXTURE_CONTAINER_BC1 ? 8 : 16;
+    int blocks_x = (image.width + 3) / 4;
+    int blocks_y = (image.height + 3) / 4;
+    out->resize(block_size * blocks_x * blocks_y);
+
+    for (int by = 0; by < blocks_y; by++)
+    {
+        for (int bx = 0; bx < blocks_x; bx++)
+        {
+            // levels smaller than a block repeat their edge pixels
+            unsigned char block[16][4];
+            for (int i = 0; i < 16; i++)
+            {
+                memcpy(block[i], pixel(image, 4 * bx + (i & 3), 4 * by + (i >> 2)), 4);
+            }
+
+            unsigned char *b = &(*out)[block_size * (bx + by * blocks_x)];
+            switch (format)
+            {
+            case TEXTURE_CONTAINER_BC1:
+                encode_color_block(block, b);
+                break;
+            case TEXTURE_CONTAINER_BC3:
+                encode_channel_block(block, 3, b);
+                encode_color_block(block, b + 8);
+                break;
+            case TEXTURE_CONTAINER_BC5:
+                encode_channel_block(block, 0, b);
+                encode_channel_block(block, 1, b + 8);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static bool has_alpha(const image_t &image)
+{
+    for (int i = 3; i < (int)image.pixels.size(); i += 4)
+    {
+        if (image.pixels[i] != 255)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    bool normal_map = false;
+    bool uncompressed = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        normal_map |= strcmp(argv[arg], "-n") == 0;
+        uncompressed |= strcmp(argv[arg], "-u") == 0;
+    }
+    if (argc - arg != 2)
+    {
+        printf("usage: %s [-n | -u] input.png output.tex\n", argv[0]);
+        return 1;
+    }
+    const char *input_filename = argv[arg];
+    const char *output_filename = argv[arg + 1];
+
+    image_t image;
+    int n;
+    unsigned char *data = stbi_load(input_filename, &image.width, &image.height, &n, 4);
+    if (!data)
+    {
+        printf("Couldn't open '%s'\n", input_filename);
+        return 1;
+    }
+
+    // gl wants the bottom row first, like the runtime loader flips them
+    int bpl = 4 * image.width;
+    image.pixels.resize(bpl * image.height);
+    for (int y = 0; y < image.height; y++)
+    {
+        memcpy(&image.pixels[(image.height - y - 1) * bpl], &data[y * bpl], bpl);
+    }
+    stbi_image_free(data);
+
+    texture_container_format_t format;
+    if (uncompressed)
+    {
+        format = TEXTURE_CONTAINER_RGBA8;
+    }
+    else if (normal_map)
+    {
+        format = TEXTURE_CONTAINER_BC5;
+    }
+    else
+    {
+        format = has_alpha(image) ? TEXTURE_CONTAINER_BC3 : TEXTURE_CONTAINER_BC1;
+    }
+
+    texture_container_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TEXTURE_CONTAINER_MAGIC;
+    header.version = TEXTURE_CONTAINER_VERSION;
+    header.format = format;
+    header.width = image.width;
+    header.height = image.height;
+
+    std::vector<std::vector<unsigned char> > levels;
+    image_t level = image;
+    for (;;)
+    {
+        levels.push_back(std::vector<unsigned char>());
+        encode_level(level, format, &levels.back());
+        if ((level.width == 1 && level.height == 1) || levels.size() == TEXTURE_CONTAINER_MAX_MIPS)
+        {
+            break;
+        }
+        level = downsample(level, normal_map);
+    }
+
+    // levels start 16 byte aligned
+    unsigned int offset = (sizeof(header) + 15) & ~15;
+    header.mip_count = levels.size();
+    for (int i = 0; i < header.mip_count; i++)
+    {
+        header.mip_offsets[i] = offset;
+        header.mip_sizes[i] = levels[i].size();
+        offset = (offset + levels[i].size() + 15) & ~15;
+    }
+
+    FILE *f = fopen(output_filename, "wb");
+    if (!f)
+    {
+        printf("Couldn't open '%s' for writing\n", output_filename);
+        return 1;
+    }
+    std::vector<unsigned char> contents(offset, 0);
+    memcpy(&contents[0], &header, sizeof(header));
+    for (int i = 0; i < header.mip_count; i++)
+    {
+        memcpy(&contents[header.mip_offsets[i]], &levels[i][0], levels[i].size());
+    }
+    bool ok = fwrite(&contents[0], 1, contents.size(), f) == contents.size();
+    fclose(f);
+    if (!ok)
+    {
+        printf("Couldn't write '%s'\n", output_filename);
+        return 1;
+    }
+
+    static const char *format_names[] = { "rgba8", "bc1", "bc3", "bc5" };
+    printf("%s: %dx%d, %d levels of %s, %d bytes\n", output_filename, image.width, image.height, header.mip_count, format_names[format], (int)contents.size());
+    return 0;
+}